@@ -5,10 +5,43 @@
 
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include <SFML/Network.hpp>
+#include <SFML/OpenGL.hpp>
 #include <vector>
 #include <ctime>
 #include <algorithm>
 #include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <filesystem>
+#include <cstring>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <bitset>
+#include <memory>
+#include <new>
+#include <csignal>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace sf;
@@ -20,18 +53,48 @@ const int W = 15;                   // Board width (columns)
 const int SIDEBAR_W = 6 * TILE_SIZE; // Sidebar width for score display
 const int PLAY_W_PX = W * TILE_SIZE; // Playfield width in pixels
 const int PLAY_H_PX = H * TILE_SIZE; // Playfield height in pixels
+const float TICK_SECONDS = 1.f / 60.f; // Fixed simulation step (60 ticks per second)
+const int GRAVITY_UNIT = 256;       // Sub-rows per row: 256 sub-rows per tick = 1G
+const int LOCK_DELAY_TICKS = 30;    // Ticks a grounded piece waits before locking
+const int MAX_LOCK_RESETS = 15;     // Moves/rotations that may restart the lock delay
+const int INPUT_REPEAT_TICKS = 6;   // Ticks between repeated moves while a key is held
+
+// Player input for one simulation tick (bit mask)
+enum InputBits : uint8_t {
+    IN_LEFT   = 1 << 0,             // Held: move left
+    IN_RIGHT  = 1 << 1,             // Held: move right
+    IN_DOWN   = 1 << 2,             // Held: soft drop
+    IN_ROTATE = 1 << 3,             // Pressed this tick: rotate
+    IN_DROP   = 1 << 4,             // Pressed this tick: hard drop
+};
+const uint8_t IN_HELD_MASK = IN_LEFT | IN_RIGHT | IN_DOWN;
 
 // ==================== GAME STATE ====================
-char board[H][W] = {};              // Game board (H x W grid)
-int x = 4, y = 0;                   // Current piece position
-float gameDelay = 0.8f;             // Gravity speed (lower = faster)
-bool isGameOver = false;            // Game over flag
+// One running game. Engine state is per thread, so batch tools can simulate
+// a game on every core with the same code the window uses.
+thread_local char board[H][W] = {};         // Game board (H x W grid)
+thread_local int x = 4, y = 0;              // Current piece position
+thread_local int gravity = 5;               // Gravity in sub-rows per tick (see GRAVITY_TABLE)
+thread_local int gravityAcc = 0;            // Sub-rows accumulated towards the next row
+thread_local int lockTicks = 0;             // Ticks the current piece has spent grounded
+thread_local int lockResets = 0;            // Lock delay restarts used at the current lowest row
+thread_local int lowestY = 0;               // Lowest row reached by the current piece
+thread_local int inputTicks = 0;            // Ticks since the last held-key move
+thread_local int gameTick = 0;              // Ticks simulated in the current game
+thread_local bool isGameOver = false;       // Game over flag
+thread_local uint32_t gameSeed = 0;         // Seed of the current game (same seed = same pieces)
+thread_local uint32_t rngState = 1;         // Piece bag random generator
+thread_local uint32_t garbageRngState = 1;  // Garbage hole random generator (versus)
+thread_local int garbageIn = 0;             // Garbage rows waiting to be added to this board
+thread_local int garbageOut = 0;            // Garbage rows produced for the opponent
+thread_local bool simSilent = false;        // Skip sounds/telemetry (rollback re-simulation, remote boards)
+thread_local uint64_t boardHash = 0;        // Zobrist key of the filled cells (see ZOBRIST HASHING)
 
 // ==================== PLAYER STATISTICS ====================
-int gScore = 0;                     // Total score
-int gLines = 0;                     // Lines cleared
-int gLevel = 0;                     // Current level (based on lines cleared)
-int currentLevel = 0;               // Track level for speed increment
+thread_local int gScore = 0;                // Total score
+thread_local int gLines = 0;                // Lines cleared
+thread_local int gLevel = 0;                // Current level (based on lines cleared)
+thread_local int currentLevel = 0;          // Track level for speed increment
 
 // ==================== GAME SETTINGS ====================
 float musicVolume = 50.f;           // Music volume (0-100%)
@@ -40,24 +103,13 @@ float brightness = 255.f;           // Screen brightness (0-255)
 bool ghostPieceEnabled = true;      // Show ghost piece preview
 
 // ==================== AUDIO SYSTEM ====================
-// Line clear sound
-sf::SoundBuffer clearBuffer;
-sf::Sound* clearSound = nullptr;
-
-// Piece landing sound
-sf::SoundBuffer landBuffer;
-sf::Sound* landSound = nullptr;
-
-// Game over sound
-sf::SoundBuffer gameOverBuffer;
-sf::Sound* gameOverSound = nullptr;
-
-// UI button click sound
-sf::SoundBuffer settingClickBuffer;
-sf::Sound* settingClickSound = nullptr;
-
-// Background music
-sf::Music bgMusic;
+// Loaded by main(); once the audio thread starts only it touches these
+// (see ENGINE EVENTS and AUDIO THREAD)
+sf::SoundBuffer clearBuffer;        // Line clear sound
+sf::SoundBuffer landBuffer;         // Piece landing sound
+sf::SoundBuffer gameOverBuffer;     // Game over sound
+sf::SoundBuffer settingClickBuffer; // UI button click sound
+sf::Music bgMusic;                  // Background music
 
 // ==================== GAME STATE MACHINE ====================
 enum class GameState {
@@ -70,10 +122,49 @@ GameState gameState = GameState::MENU;
 GameState stateBeforePause = GameState::MENU;  // Tracks where we came from before pause/settings
 
 // ==================== TETROMINO PIECE CLASSES ====================
+// A game creates and deletes a piece every lock. Pieces come from a per-thread
+// free list instead of the heap, so steady play doesn't allocate: the list
+// grows to the most pieces a thread ever had alive at once (a handful) and
+// its blocks are returned when the thread ends.
+const size_t PIECE_BLOCK_SIZE = 64;  // Every piece class must fit (checked below)
+
+struct PiecePool {
+    struct Block { Block* next; };
+    Block* freeList = nullptr;
+    bool closed = false;                     // Thread is ending: deletes go straight to the heap
+
+    void* take() {
+        if (!freeList) return ::operator new(PIECE_BLOCK_SIZE);
+        Block* b = freeList;
+        freeList = b->next;
+        return b;
+    }
+    void give(void* p) {
+        if (closed) { ::operator delete(p); return; }
+        Block* b = static_cast<Block*>(p);
+        b->next = freeList;
+        freeList = b;
+    }
+    ~PiecePool() {
+        while (freeList) {
+            Block* b = freeList;
+            freeList = b->next;
+            ::operator delete(b);
+        }
+        closed = true;
+    }
+};
+thread_local PiecePool piecePool;
+
 // Base Piece class with rotation logic and wall kick system
 class Piece {
 public:
+    static void* operator new(size_t) { return piecePool.take(); }
+    static void operator delete(void* p) { piecePool.give(p); }
+
     char shape[4][4];  // 4x4 grid representing piece shape
+    int type = 0;      // Piece type ID (see createPieceFromType)
+    int rotation = 0;  // Rotation state 0-3 (clockwise quarter turns)
 
     Piece() {
         // Initialize empty piece
@@ -86,16 +177,23 @@ public:
 
     virtual ~Piece() {}
 
-    // Rotate piece with wall kick (allows rotation near walls)
-    virtual void rotate(int currentX, int currentY) {
-        char temp[4][4];
+    virtual bool canRotate() const { return true; }
 
-        // Rotate 90 degrees clockwise
+    // Shape after one clockwise turn, before any wall kick
+    virtual void turnedShape(char out[4][4]) const {
         for (int i = 0; i < 4; i++) {
             for (int j = 0; j < 4; j++) {
-                temp[j][3 - i] = shape[i][j];
+                out[j][3 - i] = shape[i][j];
             }
         }
+    }
+
+    // Rotate piece with wall kick (allows rotation near walls)
+    // Returns false if no kick position fits
+    bool rotate(int currentX, int currentY) {
+        if (!canRotate()) return false;
+        char temp[4][4];
+        turnedShape(temp);
 
         // Try multiple wall kick positions: center, left, right, left2, right2
         int kicks[] = {0, -1, 1, -2, 2};
@@ -131,9 +229,11 @@ public:
                     }
                 }
                 ::x += kick;  // Apply wall kick offset
-                return;
+                rotation = (rotation + 1) % 4;
+                return true;
             }
         }
+        return false;
     }
 };
 
@@ -155,15 +255,14 @@ public:
         shape[1][1] = 'O'; shape[1][2] = 'O';
         shape[2][1] = 'O'; shape[2][2] = 'O';
     }
-    void rotate(int, int) override {}  // Override to prevent rotation
+    bool canRotate() const override { return false; }  // Square looks the same every way
 };
 
 // T-Piece (purple, T shape) - with proper 90-degree rotation states
 class TPiece : public Piece {
 private:
-    int rotationState = 0;  // 0=Up, 1=Right, 2=Down, 3=Left
-    
-    void applyRotationState(int state) {
+    // Uses Piece::rotation as its state: 0=Up, 1=Right, 2=Down, 3=Left
+    static void stateShape(int state, char shape[4][4]) {
         // Clear entire shape
         for (int i = 0; i < 4; i++) {
             for (int j = 0; j < 4; j++) {
@@ -196,46 +295,13 @@ private:
     
 public:
     TPiece() {
-        rotationState = 0;
-        applyRotationState(0);
+        rotation = 0;
+        stateShape(0, shape);
     }
-    
-    void rotate(int currentX, int currentY) override {
-        int nextState = (rotationState + 1) % 4;
-        applyRotationState(nextState);
-        
-        // Test with wall kicks: center, left 1, right 1, left 2, right 2
-        int kicks[] = {0, -1, 1, -2, 2};
-        for (int kick : kicks) {
-            bool canPlace = true;
-            for (int i = 0; i < 4; i++) {
-                for (int j = 0; j < 4; j++) {
-                    if (shape[i][j] != ' ') {
-                        int tx = currentX + j + kick;
-                        int ty = currentY + i;
-                        
-                        if (tx < 1 || tx >= W - 1 || ty >= H - 1) {
-                            canPlace = false;
-                            break;
-                        }
-                        if (board[ty][tx] != ' ') {
-                            canPlace = false;
-                            break;
-                        }
-                    }
-                }
-                if (!canPlace) break;
-            }
-            
-            if (canPlace) {
-                rotationState = nextState;
-                ::x += kick;
-                return;
-            }
-        }
-        
-        // Revert if no valid position found
-        applyRotationState(rotationState);
+
+    // T turns between its fixed states instead of rotating the 4x4 grid
+    void turnedShape(char out[4][4]) const override {
+        stateShape(rotation + 1, out);
     }
 };
 
@@ -275,6 +341,11 @@ public:
     }
 };
 
+static_assert(sizeof(IPiece) <= PIECE_BLOCK_SIZE && sizeof(OPiece) <= PIECE_BLOCK_SIZE
+              && sizeof(TPiece) <= PIECE_BLOCK_SIZE && sizeof(SPiece) <= PIECE_BLOCK_SIZE
+              && sizeof(ZPiece) <= PIECE_BLOCK_SIZE && sizeof(JPiece) <= PIECE_BLOCK_SIZE
+              && sizeof(LPiece) <= PIECE_BLOCK_SIZE, "piece classes must fit a PIECE_BLOCK_SIZE block");
+
 // ==================== UTILITY FUNCTIONS ====================
 // Get color for tetromino type
 Color getColor(char c) {
@@ -286,11 +357,753 @@ Color getColor(char c) {
         case 'S': return Color::Green;
         case 'T': return Color(128, 0, 128);  // Purple
         case 'Z': return Color::Red;
+        case 'X': return Color(150, 150, 150); // Garbage
         case '#': return Color(100, 100, 100); // Wall
         default:  return Color::Black;
     }
 }
 
+// ==================== TRACING ====================
+// Timings of individual scopes, for finding the call behind one slow frame.
+// TRACE_SCOPE("name") records the start and length of the enclosing block
+// into a ring owned by the calling thread, so the hot path shares nothing and
+// takes no lock; with tracing off a scope costs one relaxed load. --trace
+// starts recording, F9 writes the last TRACE_EVENTS scopes of every thread to
+// traces/trace_<date>_<time>.json (Chrome trace format: open it in
+// ui.perfetto.dev or chrome://tracing). Names must be string literals.
+const uint32_t TRACE_EVENTS = 1 << 16;       // Per thread, must be a power of two
+const int TRACE_MAX_THREADS = 32;            // Threads beyond this aren't traced
+
+struct TraceEvent {
+    const char* name;
+    uint64_t startNs;                        // Since traceEpoch
+    uint64_t durationNs;
+};
+
+struct TraceBuffer {
+    TraceEvent events[TRACE_EVENTS];
+    std::atomic<uint32_t> head{0};           // Events ever written; the ring keeps the last TRACE_EVENTS
+    const char* threadName = "thread";
+    int id = 0;
+};
+
+std::atomic<bool> traceEnabled{false};
+const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+std::atomic<TraceBuffer*> traceBuffers[TRACE_MAX_THREADS] = {};
+std::atomic<int> traceBufferCount{0};
+thread_local TraceBuffer* traceBuffer = nullptr;
+thread_local const char* traceThreadName = "thread";
+
+static uint64_t traceNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+// Name shown for the calling thread in the trace viewer
+void traceSetThreadName(const char* name) {
+    traceThreadName = name;
+    if (traceBuffer) traceBuffer->threadName = name;
+}
+
+// The calling thread's buffer, made on its first traced scope. Buffers are
+// never freed, so a dump still shows threads that have already ended.
+static TraceBuffer* traceThreadBuffer() {
+    if (traceBuffer) return traceBuffer;
+    int id = traceBufferCount.load(std::memory_order_relaxed);
+    do {
+        if (id >= TRACE_MAX_THREADS) return nullptr;
+    } while (!traceBufferCount.compare_exchange_weak(id, id + 1, std::memory_order_relaxed));
+    TraceBuffer* b = new TraceBuffer;
+    b->threadName = traceThreadName;
+    b->id = id + 1;
+    traceBuffers[id].store(b, std::memory_order_release);
+    return traceBuffer = b;
+}
+
+struct TraceScope {
+    const char* name;
+    uint64_t start = 0;                      // 0 = not recording
+
+    explicit TraceScope(const char* scopeName) : name(scopeName) {
+        if (traceEnabled.load(std::memory_order_relaxed)) start = traceNowNs() | 1;
+    }
+    ~TraceScope() { end(); }
+
+    // Close the scope before the end of the block
+    void end() {
+        if (!start) return;
+        TraceBuffer* b = traceThreadBuffer();
+        if (b) {
+            uint32_t head = b->head.load(std::memory_order_relaxed);
+            b->events[head & (TRACE_EVENTS - 1)] = { name, start, traceNowNs() - start };
+            b->head.store(head + 1, std::memory_order_release);
+        }
+        start = 0;
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+// Write every thread's recorded scopes as Chrome trace JSON. Threads still
+// recording may overwrite their oldest events meanwhile; those can come out
+// garbled, the recent ones are intact. Returns false if the file can't be made.
+bool traceDump() {
+    std::error_code ec;
+    std::filesystem::create_directories("traces", ec);
+    char name[64], stamp[32];
+    time_t now = time(0);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+    snprintf(name, sizeof(name), "traces/trace_%s.json", stamp);
+    FILE* f = fopen(name, "w");
+    if (!f) {
+        fprintf(stderr, "trace: cannot write %s\n", name);
+        return false;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    size_t written = 0;
+    int count = traceBufferCount.load(std::memory_order_acquire);
+    for (int t = 0; t < count; t++) {
+        const TraceBuffer* b = traceBuffers[t].load(std::memory_order_acquire);
+        if (!b) continue;  // Still being registered
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", b->id, b->threadName);
+        first = false;
+        uint32_t head = b->head.load(std::memory_order_acquire);
+        uint32_t begin = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+        for (uint32_t i = begin; i != head; i++) {
+            const TraceEvent& e = b->events[i & (TRACE_EVENTS - 1)];
+            fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e.name, b->id,
+                    e.startNs / 1000.0, e.durationNs / 1000.0);
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    printf("trace: %zu events written to %s\n", written, name);
+    return true;
+}
+
+// ==================== ENGINE EVENTS ====================
+// The engine and the menus never call the audio backend. They report what
+// happened as small typed records in a single-producer ring (the window
+// thread writes, the audio thread reads), the same way telemetry is handed
+// to its writer. Without a running audio thread, or while simSilent is set,
+// events are dropped at once - headless and worker-thread games stay silent.
+enum class EngineEvent : uint8_t {
+    LOCK,           // a = piece letter
+    CLEAR,          // a = lines cleared at once
+    LEVEL_UP,       // a = new level
+    GAME_OVER,
+    UI_CLICK,       // Menu or settings button
+    MUSIC_PLAY,     // Start, resume or restart the background music
+    MUSIC_PAUSE,
+    VOLUME,         // a = music volume %, b = sound effect volume %
+};
+
+struct EngineEventRecord {
+    EngineEvent type;
+    int32_t a, b;           // Event fields, see EngineEvent
+};
+
+const uint32_t EVENT_RING_SIZE = 256;                // Must be a power of two
+EngineEventRecord eventRing[EVENT_RING_SIZE];
+std::atomic<uint32_t> eventHead{0};                  // Next slot written by the window thread
+std::atomic<uint32_t> eventTail{0};                  // Next slot read by the audio thread
+std::atomic<uint32_t> eventDropped{0};               // Events lost because the ring was full
+std::atomic<bool> audioRunning{false};
+bool audioEnabled = true;                            // --no-audio: never start the audio thread
+std::thread audioThread;
+
+// Fast-forwarded games (see FAST FORWARD) thin out their lock, clear and
+// level-up sounds: one of each kind per frame, or none at high speeds
+enum class EventThinning : uint8_t { OFF, ONCE_PER_FRAME, MUTED };
+EventThinning eventThinning = EventThinning::OFF;
+uint32_t eventsThisFrame = 0;                        // Bit per EngineEvent already queued this frame
+
+// Queue one event; never blocks - if the audio thread falls behind it is dropped
+void emitEvent(EngineEvent type, int a = 0, int b = 0) {
+    if (simSilent || !audioRunning.load(std::memory_order_relaxed)) return;
+    if (eventThinning != EventThinning::OFF &&
+        (type == EngineEvent::LOCK || type == EngineEvent::CLEAR || type == EngineEvent::LEVEL_UP)) {
+        if (eventThinning == EventThinning::MUTED || (eventsThisFrame >> (int)type & 1)) return;
+        eventsThisFrame |= 1u << (int)type;
+    }
+    uint32_t head = eventHead.load(std::memory_order_relaxed);
+    if (head - eventTail.load(std::memory_order_acquire) >= EVENT_RING_SIZE) {
+        eventDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    eventRing[head & (EVENT_RING_SIZE - 1)] = { type, a, b };
+    eventHead.store(head + 1, std::memory_order_release);
+}
+
+// Send the current volume settings to the audio thread
+void emitVolume() {
+    emitEvent(EngineEvent::VOLUME, (int)musicVolume, (int)sfxVolume);
+}
+
+// ==================== AUDIO THREAD ====================
+// Owns every sf::Sound and the music once started. Sounds play on a fixed
+// pool of voices made at start, with one rule per cue:
+//   land       up to 2 at once, a third restarts the oldest
+//   clear      one voice, pitched up with the lines cleared
+//   level up   the clear sound higher still; replaces a clear from the same lock
+//   game over  stops every other voice and the music
+//   click      up to 2 at once
+const int AUDIO_VOICES = 8;
+const int AUDIO_POLL_MS = 2;                 // Sleep between ring checks when idle
+
+enum AudioCue { CUE_LAND, CUE_CLEAR, CUE_LEVEL_UP, CUE_GAME_OVER, CUE_CLICK, CUE_COUNT };
+
+struct AudioCueRule {
+    const sf::SoundBuffer* buffer;
+    float pitch;
+    int group;              // Cues of a group share the voice limit and steal from each other
+    int maxVoices;
+    bool stopsAll;
+};
+const AudioCueRule AUDIO_RULES[CUE_COUNT] = {
+    { &landBuffer,         1.0f, CUE_LAND,      2, false },
+    { &clearBuffer,        1.0f, CUE_CLEAR,     1, false },
+    { &clearBuffer,        1.5f, CUE_CLEAR,     1, false },
+    { &gameOverBuffer,     1.0f, CUE_GAME_OVER, 1, true  },
+    { &settingClickBuffer, 1.0f, CUE_CLICK,     2, false },
+};
+
+struct AudioVoice {
+    std::optional<sf::Sound> sound;
+    int group = -1;         // Group of the cue it played last
+    uint32_t started = 0;   // Order of the last start, for stealing the oldest
+};
+AudioVoice audioVoices[AUDIO_VOICES];
+
+static bool voicePlaying(const AudioVoice& v) {
+    return v.sound->getStatus() == sf::SoundSource::Status::Playing;
+}
+
+static void audioPlayCue(AudioCue cue, float pitch, float volume) {
+    TRACE_SCOPE("audio.play");
+    static uint32_t starts = 0;
+    const AudioCueRule& rule = AUDIO_RULES[cue];
+    if (rule.stopsAll) {
+        for (AudioVoice& v : audioVoices) v.sound->stop();
+        bgMusic.stop();
+    }
+
+    // At the group's limit the oldest voice of the group is restarted,
+    // otherwise a free voice, otherwise the oldest voice of all
+    AudioVoice* oldestInGroup = nullptr;
+    AudioVoice* freeVoice = nullptr;
+    AudioVoice* oldest = &audioVoices[0];
+    int inGroup = 0;
+    for (AudioVoice& v : audioVoices) {
+        bool playing = voicePlaying(v);
+        if (playing && v.group == rule.group) {
+            inGroup++;
+            if (!oldestInGroup || v.started < oldestInGroup->started) oldestInGroup = &v;
+        }
+        if (!playing && !freeVoice) freeVoice = &v;
+        if (v.started < oldest->started) oldest = &v;
+    }
+    AudioVoice& voice = inGroup >= rule.maxVoices ? *oldestInGroup : freeVoice ? *freeVoice : *oldest;
+
+    voice.sound->stop();
+    voice.sound->setBuffer(*rule.buffer);
+    voice.sound->setPitch(rule.pitch * pitch);
+    voice.sound->setVolume(volume);
+    voice.sound->play();
+    voice.group = rule.group;
+    voice.started = ++starts;
+}
+
+static void audioHandle(const EngineEventRecord& e) {
+    static float sfxGain = sfxVolume;
+    switch (e.type) {
+        case EngineEvent::LOCK:      audioPlayCue(CUE_LAND, 1.f, sfxGain); break;
+        case EngineEvent::CLEAR:     audioPlayCue(CUE_CLEAR, 1.f + 0.08f * (min(e.a, 4) - 1), sfxGain); break;
+        case EngineEvent::LEVEL_UP:  audioPlayCue(CUE_LEVEL_UP, 1.f, sfxGain); break;
+        case EngineEvent::GAME_OVER: audioPlayCue(CUE_GAME_OVER, 1.f, sfxGain); break;
+        case EngineEvent::UI_CLICK:  audioPlayCue(CUE_CLICK, 1.f, sfxGain); break;
+        case EngineEvent::MUSIC_PLAY: {
+            TRACE_SCOPE("music.play");
+            bgMusic.play();
+            break;
+        }
+        case EngineEvent::MUSIC_PAUSE: bgMusic.pause(); break;
+        case EngineEvent::VOLUME:
+            bgMusic.setVolume((float)e.a);
+            sfxGain = (float)e.b;
+            for (AudioVoice& v : audioVoices) v.sound->setVolume(sfxGain);
+            break;
+    }
+}
+
+// Audio thread: drain the event ring and drive the backend
+static void audioLoop() {
+    traceSetThreadName("audio");
+    while (true) {
+        uint32_t tail = eventTail.load(std::memory_order_relaxed);
+        uint32_t head = eventHead.load(std::memory_order_acquire);
+        if (tail == head) {
+            if (!audioRunning.load()) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(AUDIO_POLL_MS));
+            continue;
+        }
+        for (; tail != head; tail++) audioHandle(eventRing[tail & (EVENT_RING_SIZE - 1)]);
+        eventTail.store(tail, std::memory_order_release);
+    }
+    for (AudioVoice& v : audioVoices) v.sound->stop();
+    bgMusic.stop();
+}
+
+// Start the audio thread; the buffers and music must already be loaded
+void audioStart() {
+    for (AudioVoice& v : audioVoices) v.sound.emplace(clearBuffer);
+    bgMusic.setLooping(true);
+    audioRunning = true;
+    audioThread = std::thread(audioLoop);
+    emitVolume();
+}
+
+// Play what is still queued and stop the audio thread
+void audioStop() {
+    if (!audioThread.joinable()) return;
+    audioRunning = false;
+    audioThread.join();
+    for (AudioVoice& v : audioVoices) v.sound.reset();
+    if (eventDropped > 0) {
+        fprintf(stderr, "audio: %u events dropped\n", eventDropped.load());
+    }
+}
+
+// ==================== ALLOCATION TRACKING ====================
+// Builds made with -DTETRIS_ALLOC_TRACKING replace the global operator
+// new/delete with versions that count calls and bytes per thread, split by
+// the main-loop phase set with allocSetPhase(). --alloc-stats prints the
+// window thread's allocations per frame once a second; --alloc-assert aborts
+// on the first steady gameplay frame that allocates. Normal builds keep the
+// library allocator and allocSetPhase() compiles to nothing.
+enum AllocPhase { ALLOC_OTHER, ALLOC_EVENTS, ALLOC_SIMULATION, ALLOC_RENDER, ALLOC_DISPLAY, ALLOC_PHASES };
+const char* const ALLOC_PHASE_NAMES[ALLOC_PHASES] = { "other", "events", "simulation", "render", "display" };
+const int ALLOC_WARMUP_TICKS = 120;          // Ticks into a game before its frames must be allocation-free
+
+struct AllocCounters {
+    uint64_t count[ALLOC_PHASES] = {};
+    uint64_t bytes[ALLOC_PHASES] = {};
+};
+
+bool allocStats = false;                     // --alloc-stats: print per-frame allocations every second
+bool allocAssert = false;                    // --alloc-assert: abort on an allocating steady frame
+
+#ifdef TETRIS_ALLOC_TRACKING
+thread_local AllocCounters allocCounters;
+thread_local AllocPhase allocPhase = ALLOC_OTHER;
+
+inline void allocSetPhase(AllocPhase phase) { allocPhase = phase; }
+
+// align = 0 for plain new; the aligned forms only get over-aligned requests
+static void* allocCounted(size_t size, size_t align) {
+    allocCounters.count[allocPhase]++;
+    allocCounters.bytes[allocPhase] += size;
+    if (size == 0) size = 1;
+    void* p;
+#ifdef _WIN32
+    p = align ? _aligned_malloc(size, align) : malloc(size);
+#else
+    if (align) {
+        if (posix_memalign(&p, align, size)) p = nullptr;
+    } else {
+        p = malloc(size);
+    }
+#endif
+    return p;
+}
+
+// Kept out of line: inlined into a delete, GCC pairs the free() with the
+// operator new it came from and warns about a mismatch
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+static void allocFree(void* p, size_t align) {
+#ifdef _WIN32
+    if (align) { _aligned_free(p); return; }
+#else
+    (void)align;
+#endif
+    free(p);
+}
+
+void* operator new(size_t size) {
+    if (void* p = allocCounted(size, 0)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocCounted(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocCounted(size, 0); }
+void* operator new(size_t size, std::align_val_t align) {
+    if (void* p = allocCounted(size, (size_t)align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t align) { return operator new(size, align); }
+void operator delete(void* p) noexcept { allocFree(p, 0); }
+void operator delete[](void* p) noexcept { allocFree(p, 0); }
+void operator delete(void* p, size_t) noexcept { allocFree(p, 0); }
+void operator delete[](void* p, size_t) noexcept { allocFree(p, 0); }
+void operator delete(void* p, std::align_val_t align) noexcept { allocFree(p, (size_t)align); }
+void operator delete[](void* p, std::align_val_t align) noexcept { allocFree(p, (size_t)align); }
+void operator delete(void* p, size_t, std::align_val_t align) noexcept { allocFree(p, (size_t)align); }
+void operator delete[](void* p, size_t, std::align_val_t align) noexcept { allocFree(p, (size_t)align); }
+#else
+inline void allocSetPhase(AllocPhase) {}
+#endif
+
+// Called once per frame after display. steady = the whole frame was ordinary
+// gameplay past the warm-up, which must not allocate outside event polling
+// (SFML queues window events in a std::deque).
+void allocEndFrame(float dt, bool steady) {
+#ifdef TETRIS_ALLOC_TRACKING
+    static AllocCounters last, total;
+    static uint64_t worstCount = 0;
+    static int frames = 0;
+    static float elapsed = 0.f;
+
+    AllocCounters frame;
+    uint64_t frameCount = 0, unexpected = 0;
+    for (int p = 0; p < ALLOC_PHASES; p++) {
+        frame.count[p] = allocCounters.count[p] - last.count[p];
+        frame.bytes[p] = allocCounters.bytes[p] - last.bytes[p];
+        frameCount += frame.count[p];
+        if (p != ALLOC_EVENTS) unexpected += frame.count[p];
+    }
+    last = allocCounters;
+
+    if (allocAssert && steady && unexpected) {
+        fprintf(stderr, "alloc: steady frame allocated:");
+        for (int p = 0; p < ALLOC_PHASES; p++) {
+            fprintf(stderr, " %s %llu (%llu B)", ALLOC_PHASE_NAMES[p], (unsigned long long)frame.count[p],
+                    (unsigned long long)frame.bytes[p]);
+        }
+        fprintf(stderr, "\n");
+        if (traceEnabled) traceDump();
+        abort();
+    }
+    if (!allocStats) return;
+
+    for (int p = 0; p < ALLOC_PHASES; p++) {
+        total.count[p] += frame.count[p];
+        total.bytes[p] += frame.bytes[p];
+    }
+    worstCount = max(worstCount, frameCount);
+    frames++;
+    elapsed += dt;
+    if (elapsed < 1.f) return;
+
+    printf("alloc: %d frames, per frame:", frames);
+    for (int p = 0; p < ALLOC_PHASES; p++) {
+        printf(" %s %.1f (%.0f B)", ALLOC_PHASE_NAMES[p], (double)total.count[p] / frames, (double)total.bytes[p] / frames);
+    }
+    printf(", worst %llu\n", (unsigned long long)worstCount);
+    total = AllocCounters{};
+    worstCount = 0;
+    frames = 0;
+    elapsed = 0.f;
+#else
+    (void)dt;
+    (void)steady;
+#endif
+}
+
+// ==================== FLIGHT RECORDER ====================
+// Always on, for hitches nobody can reproduce. The window thread keeps its
+// last FLIGHT_RECORDS input events, simulation ticks, spawns, locks and frame
+// timings (per phase, as in ALLOCATION TRACKING) in a fixed ring: about 30 s
+// of play in 128 KB. A frame longer than --hitch-ms (default 50) or F8 copies
+// the ring for a background thread, which writes flight/flight_<date>_<time>_<n>.fdr;
+// a crash signal writes flight/crash_<date>_<time>.fdr straight from the
+// handler. --flight <file> prints a dump.
+enum class FlightEvent : uint8_t {
+    FRAME,      // a = FLIGHT_* flags, v = microseconds per AllocPhase
+    KEY,        // a = 1 pressed, 0 released, v0 = Keyboard::Key
+    MOUSE,      // a = button, v0/v1 = window position
+    WINDOW,     // a = 0 focus lost, 1 focus gained, 2 resized (v0 x v1), 3 closed
+    TICK,       // a = input bits, v0 = gameTick
+    SPAWN,      // a = piece type, v0 = next type, v1 = gameTick
+    LOCK,       // a = piece type, v0 = x, v1 = y, v2 = rotation, v3 = keys used
+};
+const char* const FLIGHT_EVENT_NAMES[] = { "frame", "key", "mouse", "window", "tick", "spawn", "lock" };
+
+const uint32_t FLIGHT_RECORDS = 4096;                // Must be a power of two
+const uint32_t FLIGHT_MAGIC = 0x52444654;            // "TFDR"
+const uint32_t FLIGHT_VERSION = 1;
+const uint8_t FLIGHT_WAITED = 1;                     // Frame flag: slept in waitEvent (see IDLE SCREENS)
+const uint8_t FLIGHT_HITCH = 2;                      // Frame flag: longer than the hitch threshold
+const int FLIGHT_WARMUP_FRAMES = 60;                 // Loading frames aren't hitches
+const uint64_t FLIGHT_DUMP_GAP_NS = 10000000000ull;  // At most one hitch dump per 10 s
+enum FlightReason : uint32_t { FLIGHT_HOTKEY, FLIGHT_HITCH_DUMP, FLIGHT_CRASH };
+const char* const FLIGHT_REASON_NAMES[] = { "F8", "hitch", "crash" };
+
+struct FlightRecord {
+    uint64_t timeNs;                                 // traceNowNs()
+    FlightEvent type;
+    uint8_t a;
+    uint16_t pad;
+    int32_t v[5];
+};
+
+// File: FlightHeader, then FlightRecord[count], oldest first
+struct FlightHeader {
+    uint32_t magic, version;
+    uint32_t count;
+    uint32_t reason;                                 // FlightReason
+    int32_t signal;                                  // Crash dumps
+    uint32_t hitchMs;
+    uint64_t dumpNs;                                 // traceNowNs() when written
+};
+
+struct FlightRecorder {
+    FlightRecord ring[FLIGHT_RECORDS];
+    uint32_t head = 0;                               // Records ever written
+    uint32_t hitchMs = 50;                           // --hitch-ms, 0 = never dump on a hitch
+    // Frame timing
+    uint64_t phaseNs[ALLOC_PHASES] = {};
+    uint64_t phaseStart = 0;
+    int phase = ALLOC_OTHER;
+    int frames = 0;
+    uint64_t lastDumpNs = 0;
+    // Dumps for the writer thread
+    FlightRecord snapshot[FLIGHT_RECORDS];
+    FlightHeader snapshotHeader;
+    std::atomic<bool> pending{false};                // snapshot is waiting to be written
+    std::atomic<bool> running{false};
+    std::thread writer;
+    char crashPath[64] = "";
+};
+FlightRecorder flight;
+thread_local bool flightOwner = false;               // Only the window thread records
+
+void flightRecord(FlightEvent type, int a = 0, int v0 = 0, int v1 = 0, int v2 = 0, int v3 = 0, int v4 = 0) {
+    if (!flightOwner || simSilent) return;
+    flight.ring[flight.head & (FLIGHT_RECORDS - 1)] = { traceNowNs(), type, (uint8_t)a, 0, { v0, v1, v2, v3, v4 } };
+    flight.head++;
+}
+
+// Write a dump with plain file calls, which a signal handler may use.
+// The records are a, then b (the two halves of the ring).
+static bool flightWriteFile(const char* path, const FlightHeader& h, const FlightRecord* a, uint32_t na,
+                            const FlightRecord* b, uint32_t nb) {
+#ifdef _WIN32
+    CreateDirectoryA("flight", nullptr);
+    int fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (fd < 0) return false;
+    bool ok = _write(fd, &h, sizeof(h)) == (int)sizeof(h) &&
+              _write(fd, a, na * sizeof(FlightRecord)) == (int)(na * sizeof(FlightRecord)) &&
+              _write(fd, b, nb * sizeof(FlightRecord)) == (int)(nb * sizeof(FlightRecord));
+    _close(fd);
+#else
+    mkdir("flight", 0755);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+              write(fd, a, na * sizeof(FlightRecord)) == (ssize_t)(na * sizeof(FlightRecord)) &&
+              write(fd, b, nb * sizeof(FlightRecord)) == (ssize_t)(nb * sizeof(FlightRecord));
+    close(fd);
+#endif
+    return ok;
+}
+
+static FlightHeader flightHeader(FlightReason reason, uint32_t count, int sig) {
+    FlightHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = FLIGHT_MAGIC;
+    h.version = FLIGHT_VERSION;
+    h.count = count;
+    h.reason = reason;
+    h.signal = sig;
+    h.hitchMs = flight.hitchMs;
+    h.dumpNs = traceNowNs();
+    return h;
+}
+
+// Crash signals: write the ring as it is and let the signal kill the process
+static void flightCrashHandler(int sig) {
+    uint32_t head = flight.head;
+    uint32_t count = min(head, FLIGHT_RECORDS);
+    uint32_t first = (head - count) & (FLIGHT_RECORDS - 1);
+    uint32_t na = min(count, FLIGHT_RECORDS - first);
+    FlightHeader h = flightHeader(FLIGHT_CRASH, count, sig);
+    flightWriteFile(flight.crashPath, h, flight.ring + first, na, flight.ring, count - na);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Copy the ring for the writer thread; false if it is still writing the last dump
+bool flightDump(FlightReason reason) {
+    if (!flight.running || flight.pending.load(std::memory_order_acquire)) return false;
+    TRACE_SCOPE("flight.copy");
+    uint32_t count = min(flight.head, FLIGHT_RECORDS);
+    for (uint32_t i = 0; i < count; i++) {
+        flight.snapshot[i] = flight.ring[(flight.head - count + i) & (FLIGHT_RECORDS - 1)];
+    }
+    flight.snapshotHeader = flightHeader(reason, count, 0);
+    flight.pending.store(true, std::memory_order_release);
+    return true;
+}
+
+static void flightWriterLoop() {
+    traceSetThreadName("flight recorder");
+    int dumps = 0;
+    while (true) {
+        bool running = flight.running.load();  // Before pending, so the last dump is written
+        if (flight.pending.load(std::memory_order_acquire)) {
+            TRACE_SCOPE("flight.write");
+            char path[80], stamp[32];
+            time_t now = time(0);
+            strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+            snprintf(path, sizeof(path), "flight/flight_%s_%d.fdr", stamp, ++dumps);
+            const FlightHeader& h = flight.snapshotHeader;
+            if (flightWriteFile(path, h, flight.snapshot, h.count, nullptr, 0)) {
+                printf("flight: %s dump of %u records written to %s\n", FLIGHT_REASON_NAMES[h.reason], h.count, path);
+            } else {
+                fprintf(stderr, "flight: cannot write %s\n", path);
+            }
+            flight.pending.store(false, std::memory_order_release);
+        } else if (!running) {
+            break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+}
+
+// Start recording on the calling (window) thread
+void flightStart() {
+    time_t now = time(0);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+    snprintf(flight.crashPath, sizeof(flight.crashPath), "flight/crash_%s.fdr", stamp);
+    flightOwner = true;
+    flight.phaseStart = traceNowNs();
+    for (int sig : { SIGSEGV, SIGABRT, SIGFPE, SIGILL }) signal(sig, flightCrashHandler);
+    flight.running = true;
+    flight.writer = std::thread(flightWriterLoop);
+}
+
+// Write a dump still being copied and stop the writer thread
+void flightStop() {
+    if (!flight.running) return;
+    flight.running = false;
+    flight.writer.join();
+}
+
+// Close the phase running so far and time the next one
+void flightPhase(AllocPhase phase) {
+    uint64_t now = traceNowNs();
+    flight.phaseNs[flight.phase] += now - flight.phaseStart;
+    flight.phaseStart = now;
+    flight.phase = phase;
+}
+
+// Record the frame's phase timings and dump the ring if it was a hitch
+void flightEndFrame(bool waited) {
+    if (!flightOwner) return;
+    flightPhase(ALLOC_OTHER);
+    uint64_t total = 0;
+    int us[ALLOC_PHASES];
+    for (int p = 0; p < ALLOC_PHASES; p++) {
+        total += flight.phaseNs[p];
+        us[p] = (int)min<uint64_t>(flight.phaseNs[p] / 1000, INT32_MAX);
+        flight.phaseNs[p] = 0;
+    }
+    bool warm = flight.frames >= FLIGHT_WARMUP_FRAMES;
+    if (!warm) flight.frames++;
+    bool hitch = warm && !waited && flight.hitchMs && total > (uint64_t)flight.hitchMs * 1000000;
+    uint8_t flags = (waited ? FLIGHT_WAITED : 0) | (hitch ? FLIGHT_HITCH : 0);
+    flightRecord(FlightEvent::FRAME, flags | (int)gameState << 4, us[0], us[1], us[2], us[3], us[4]);
+
+    uint64_t now = flight.phaseStart;
+    if (hitch && (flight.lastDumpNs == 0 || now - flight.lastDumpNs >= FLIGHT_DUMP_GAP_NS)) {
+        if (flightDump(FLIGHT_HITCH_DUMP)) flight.lastDumpNs = now;
+    }
+}
+
+// The window events worth keeping: keys, clicks, focus and size changes
+void flightRecordEvent(const Event& event) {
+    if (const auto* key = event.getIf<Event::KeyPressed>()) flightRecord(FlightEvent::KEY, 1, (int)key->code);
+    else if (const auto* key = event.getIf<Event::KeyReleased>()) flightRecord(FlightEvent::KEY, 0, (int)key->code);
+    else if (const auto* mouse = event.getIf<Event::MouseButtonPressed>()) {
+        flightRecord(FlightEvent::MOUSE, (int)mouse->button, mouse->position.x, mouse->position.y);
+    }
+    else if (event.is<Event::FocusLost>()) flightRecord(FlightEvent::WINDOW, 0);
+    else if (event.is<Event::FocusGained>()) flightRecord(FlightEvent::WINDOW, 1);
+    else if (const auto* resized = event.getIf<Event::Resized>()) {
+        flightRecord(FlightEvent::WINDOW, 2, (int)resized->size.x, (int)resized->size.y);
+    }
+    else if (event.is<Event::Closed>()) flightRecord(FlightEvent::WINDOW, 3);
+}
+
+// --flight: print a dump, times in ms before it was written
+int runFlightPrint(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+    FlightHeader h;
+    vector<FlightRecord> records;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == FLIGHT_MAGIC && h.version == FLIGHT_VERSION &&
+              h.count <= FLIGHT_RECORDS && h.reason <= FLIGHT_CRASH;
+    if (ok) {
+        records.resize(h.count);
+        ok = fread(records.data(), sizeof(FlightRecord), h.count, f) == h.count;
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "%s is not a flight recorder dump\n", path);
+        return -1;
+    }
+
+    static const char* const STATE_NAMES[] = { "menu", "playing", "pause", "settings" };
+    printf("%s dump", FLIGHT_REASON_NAMES[h.reason]);
+    if (h.reason == FLIGHT_CRASH) printf(" (signal %d)", h.signal);
+    printf(", %u records, hitch threshold %u ms\n", h.count, h.hitchMs);
+    for (const FlightRecord& r : records) {
+        printf("%10.3f  %-6s  ", -(double)(int64_t)(h.dumpNs - r.timeNs) / 1e6, FLIGHT_EVENT_NAMES[min((int)r.type, 6)]);
+        switch (r.type) {
+            case FlightEvent::FRAME:
+                printf("%6.2f ms", (r.v[0] + r.v[1] + r.v[2] + r.v[3] + r.v[4]) / 1000.0);
+                for (int p = 0; p < ALLOC_PHASES; p++) printf("  %s %.2f", ALLOC_PHASE_NAMES[p], r.v[p] / 1000.0);
+                printf("  %s%s%s", STATE_NAMES[(r.a >> 4) & 3], (r.a & FLIGHT_WAITED) ? "  waited" : "",
+                       (r.a & FLIGHT_HITCH) ? "  HITCH" : "");
+                break;
+            case FlightEvent::KEY:
+                if (r.v[0] >= 0 && r.v[0] < 26) printf("%s %c", r.a ? "down" : "up", 'A' + r.v[0]);
+                else printf("%s %d", r.a ? "down" : "up", r.v[0]);
+                break;
+            case FlightEvent::MOUSE:
+                printf("button %d at %d,%d", r.a, r.v[0], r.v[1]);
+                break;
+            case FlightEvent::WINDOW:
+                if (r.a == 2) printf("resized %dx%d", r.v[0], r.v[1]);
+                else printf("%s", r.a == 0 ? "focus lost" : r.a == 1 ? "focus gained" : "closed");
+                break;
+            case FlightEvent::TICK:
+                printf("%d input %02x", r.v[0], r.a);
+                break;
+            case FlightEvent::SPAWN:
+                printf("%c next %c at tick %d", "IOTSZJL"[r.a % 7], "IOTSZJL"[r.v[0] % 7], r.v[1]);
+                break;
+            case FlightEvent::LOCK:
+                printf("%c at %d,%d rotation %d, %d keys", "IOTSZJL"[r.a % 7], r.v[0], r.v[1], r.v[2], r.v[3]);
+                break;
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
 // ==================== SIDEBAR UI STRUCTURE ====================
 // Manages layout of score, level, lines, and next piece preview
 struct SidebarUI {
@@ -328,7 +1141,8 @@ static SidebarUI makeSidebarUI() {
 static void drawPanel(sf::RenderWindow& window, const sf::FloatRect& r) {
     const float outline = 3.f;
     const float inset = outline;
-    sf::RectangleShape box({ r.size.x - 2.f*inset, r.size.y - 2.f*inset });
+    static sf::RectangleShape box;  // Shapes own their vertices: reuse one instead of allocating per draw
+    box.setSize({ r.size.x - 2.f*inset, r.size.y - 2.f*inset });
     box.setPosition({ r.position.x + inset, r.position.y + inset });
     box.setFillColor(sf::Color::Black);
     box.setOutlineThickness(outline);
@@ -336,12 +1150,48 @@ static void drawPanel(sf::RenderWindow& window, const sf::FloatRect& r) {
     window.draw(box);
 }
 
+// sf::Text keeps its string and glyph vertices on the heap. drawText() hands
+// out persistent slots in call order, so a frame that draws the same labels
+// as the last one only rebuilds the texts whose string changed, and that
+// reuses their buffers. beginTextFrame() starts the order over each frame.
+const int TEXT_SLOTS = 48;
+std::optional<sf::Text> textSlots[TEXT_SLOTS];
+int textSlotsUsed = 0;
+
+void beginTextFrame() { textSlotsUsed = 0; }
+
+// Load the glyphs gameplay text uses, so a new digit doesn't grow the font
+// texture mid-game
+void warmTextGlyphs(const sf::Font& font) {
+    const char* chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ#:/%. ";
+    for (unsigned size : {14u, 16u, 18u, 24u}) {
+        for (const char* c = chars; *c; c++) (void)font.getGlyph((char32_t)*c, size, false);
+    }
+}
+
 // Draw text at specific position
-static void drawText(sf::RenderWindow& window, const sf::Font& font, const std::string& s, float x, float y, unsigned size) {
-    sf::Text t(font, s, size);
-    t.setFillColor(sf::Color::White);
-    t.setPosition({x, y});
-    window.draw(t);
+static void drawText(sf::RenderWindow& window, const sf::Font& font, const char* s, float x, float y, unsigned size) {
+    // Built a character at a time: a one-character sf::String fits the small
+    // string buffer, and the scratch string keeps its capacity between calls
+    static sf::String scratch;
+    scratch.clear();
+    for (const char* c = s; *c; c++) scratch += sf::String((char32_t)(unsigned char)*c);
+
+    if (textSlotsUsed == TEXT_SLOTS) {  // Out of slots: draw a temporary
+        sf::Text t(font, scratch, size);
+        t.setFillColor(sf::Color::White);
+        t.setPosition({x, y});
+        window.draw(t);
+        return;
+    }
+    std::optional<sf::Text>& t = textSlots[textSlotsUsed++];
+    if (!t) t.emplace(font);
+    t->setFont(font);
+    t->setString(scratch);  // No-op when unchanged
+    t->setCharacterSize(size);
+    t->setFillColor(sf::Color::White);
+    t->setPosition({x, y});
+    window.draw(*t);
 }
 
 // Draw preview of next piece
@@ -374,7 +1224,8 @@ static void drawNextPreview(sf::RenderWindow& window, const SidebarUI& ui, const
     for (int r = minR; r <= maxR; r++) {
         for (int c = minC; c <= maxC; c++) {
             if (p->shape[r][c] != ' ') {
-                sf::RectangleShape rect({(float)mini - 1, (float)mini - 1});
+                static sf::RectangleShape rect;
+                rect.setSize({(float)mini - 1, (float)mini - 1});
                 rect.setPosition({ startX + (c - minC) * mini, startY + (r - minR) * mini });
                 rect.setFillColor(getColor(p->shape[r][c]));
                 window.draw(rect);
@@ -383,228 +1234,6676 @@ static void drawNextPreview(sf::RenderWindow& window, const SidebarUI& ui, const
     }
 }
 
-// Draw entire sidebar with score, level, lines, and next piece
-static void drawSidebar(sf::RenderWindow& window, const SidebarUI& ui,
-                        const sf::Font& font, int score, int level, int lines,
-                        const Piece* next) {
-    // Sidebar background
-    sf::RectangleShape bg({ui.w, ui.h});
-    bg.setPosition({ui.x, ui.y});
-    bg.setFillColor(sf::Color(30, 30, 30));
-    window.draw(bg);
-
-    // Draw all panels
-    drawPanel(window, ui.scoreBox);
-    drawPanel(window, ui.levelBox);
-    drawPanel(window, ui.linesBox);
-    drawPanel(window, ui.nextBox);
+// Draw entire sidebar with score, level, lines, and next piece
+static void drawSidebar(sf::RenderWindow& window, const SidebarUI& ui,
+                        const sf::Font& font, int score, int level, int lines,
+                        const Piece* next) {
+    TRACE_SCOPE("drawSidebar");
+    // Sidebar background
+    static sf::RectangleShape bg;
+    bg.setSize({ui.w, ui.h});
+    bg.setPosition({ui.x, ui.y});
+    bg.setFillColor(sf::Color(30, 30, 30));
+    window.draw(bg);
+
+    // Draw all panels
+    drawPanel(window, ui.scoreBox);
+    drawPanel(window, ui.levelBox);
+    drawPanel(window, ui.linesBox);
+    drawPanel(window, ui.nextBox);
+
+    // Draw text labels and values
+    float labelX = ui.scoreBox.position.x + 12.f;
+    char value[16];
+    drawText(window, font, "SCORE", labelX, ui.scoreBox.position.y + 10.f, 18);
+    snprintf(value, sizeof(value), "%d", score);
+    drawText(window, font, value, labelX, ui.scoreBox.position.y + 42.f, 24);
+    drawText(window, font, "LEVEL", labelX, ui.levelBox.position.y + 10.f, 18);
+    snprintf(value, sizeof(value), "%d", level);
+    drawText(window, font, value, labelX, ui.levelBox.position.y + 42.f, 24);
+    drawText(window, font, "LINES", labelX, ui.linesBox.position.y + 10.f, 18);
+    snprintf(value, sizeof(value), "%d", lines);
+    drawText(window, font, value, labelX, ui.linesBox.position.y + 42.f, 24);
+    drawText(window, font, "NEXT", labelX, ui.nextBox.position.y + 10.f, 18);
+    drawNextPreview(window, ui, next);
+}
+
+// ==================== GAME LOGIC ====================
+thread_local Piece* currentPiece = nullptr; // Currently falling piece
+thread_local Piece* nextPiece = nullptr;    // Next piece to spawn
+
+// ==================== 7-BAG SHUFFLE ALGORITHM ====================
+// Ensures fair piece distribution - all 7 pieces appear before repeating.
+// Uses its own seeded generator so a seed always produces the same pieces.
+thread_local int pieceQueue[7];             // Current bag of piece types
+thread_local int queueIndex = 7;            // Current position in bag (7 = empty)
+
+// xorshift32 - tiny, fast and identical on every platform
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Start the piece and garbage generators for a new game
+void seedRandom(uint32_t seed) {
+    gameSeed = seed;
+    rngState = seed ? seed : 0x9E3779B9u;  // xorshift must not start at 0
+    garbageRngState = rngState ^ 0x5BD1E995u;
+    queueIndex = 7;
+}
+
+// Pick a fresh seed for a local game
+uint32_t makeSeed() {
+    uint64_t t = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    return (uint32_t)(t ^ (t >> 32) ^ (uint64_t)time(0));
+}
+
+// Refill queue with randomized bag of 7 pieces
+void refillPieceQueue() {
+    for (int i = 0; i < 7; i++) pieceQueue[i] = i;  // All 7 piece types
+    
+    // Fisher-Yates shuffle algorithm
+    for (int i = 6; i > 0; i--) {
+        int r = nextRandom(rngState) % (i + 1);
+        swap(pieceQueue[i], pieceQueue[r]);
+    }
+    queueIndex = 0;
+}
+
+// Create piece from type ID
+Piece* createPieceFromType(int type) {
+    Piece* p;
+    switch (type) {
+        case 0: p = new IPiece(); break;
+        case 1: p = new OPiece(); break;
+        case 2: p = new TPiece(); break;
+        case 3: p = new SPiece(); break;
+        case 4: p = new ZPiece(); break;
+        case 5: p = new JPiece(); break;
+        case 6: p = new LPiece(); break;
+        default: p = new IPiece(); type = 0; break;
+    }
+    p->type = type;
+    return p;
+}
+
+// Get next random piece using 7-bag shuffle
+Piece* createRandomPiece() {
+    // Refill queue when empty
+    if (queueIndex >= 7) {
+        refillPieceQueue();
+    }
+    Piece* p = createPieceFromType(pieceQueue[queueIndex]);
+    queueIndex++;
+    return p;
+}
+
+// Get the letter of a piece (its first filled cell)
+char pieceLetter(const Piece* p) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (p->shape[i][j] != ' ') return p->shape[i][j];
+        }
+    }
+    return ' ';
+}
+
+// ==================== TELEMETRY ====================
+// Per-game event log. The game thread only copies small fixed-size records
+// into a preallocated ring buffer; a background thread formats them as CSV
+// into telemetry/game_<date>_<time>_<n>.csv, so file I/O never runs on a frame.
+enum class TelemetryEvent : uint8_t {
+    GAME_START,     // a = start time (unix), b = game number this session
+    LOCK,           // a = piece letter, b = x, c = y, d = keys used for this piece
+    CLEAR,          // a = lines cleared at once
+    LEVEL_UP,       // a = new level, b = ms spent on the previous level
+    GAME_END,       // a = score, b = lines, c = level, d = 1 if topped out, 0 if abandoned
+    CLEAR_COUNTS,   // a = singles, b = doubles, c = triples, d = tetrises
+    RATES,          // a = pieces, b = pieces/sec x1000, c = keys/piece x1000, d = game ms
+};
+const char* const TELEMETRY_EVENT_NAMES[] = {
+    "start", "lock", "clear", "level", "end", "clears", "rates"
+};
+
+struct TelemetryRecord {
+    uint32_t timeMs;        // Game time of the event (pauses excluded)
+    TelemetryEvent type;
+    int32_t a, b, c, d;     // Event fields, see TelemetryEvent
+};
+
+const uint32_t TELEMETRY_RING_SIZE = 4096;           // Must be a power of two
+TelemetryRecord telemetryRing[TELEMETRY_RING_SIZE];
+std::atomic<uint32_t> telemetryHead{0};              // Next slot written by the game thread
+std::atomic<uint32_t> telemetryTail{0};              // Next slot read by the writer thread
+std::atomic<uint32_t> telemetryDropped{0};           // Records lost because the ring was full
+std::atomic<bool> telemetryRunning{false};
+std::thread telemetryThread;
+
+// Counters for the game in progress, summarised when it ends
+struct GameStats {
+    bool active = false;
+    int gameNumber = 0;
+    float gameTime = 0.f;       // Seconds of actual play
+    float levelStart = 0.f;     // gameTime when the current level began
+    int pieces = 0;
+    int keys = 0;               // Move/rotate/drop inputs in the whole game
+    int pieceKeys = 0;          // Inputs since the current piece spawned
+    int clearsBySize[5] = {};   // Index = lines cleared at once
+};
+thread_local GameStats gStats;
+
+uint32_t telemetryNow() {
+    return static_cast<uint32_t>(gStats.gameTime * 1000.f);
+}
+
+// Queue one record; never blocks - if the writer falls behind the record is dropped
+void telemetryPush(TelemetryEvent type, int a = 0, int b = 0, int c = 0, int d = 0) {
+    if (!gStats.active || simSilent) return;
+    uint32_t head = telemetryHead.load(std::memory_order_relaxed);
+    if (head - telemetryTail.load(std::memory_order_acquire) >= TELEMETRY_RING_SIZE) {
+        telemetryDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    telemetryRing[head & (TELEMETRY_RING_SIZE - 1)] = { telemetryNow(), type, a, b, c, d };
+    telemetryHead.store(head + 1, std::memory_order_release);
+}
+
+// Count one player input against the current piece
+void telemetryCountKey() {
+    gStats.keys++;
+    gStats.pieceKeys++;
+}
+
+void telemetryBeginGame() {
+    int gameNumber = gStats.gameNumber + 1;
+    gStats = GameStats{};
+    gStats.active = true;
+    gStats.gameNumber = gameNumber;
+    telemetryPush(TelemetryEvent::GAME_START, (int)time(0), gameNumber);
+}
+
+// Close the current game with its final score and summary rows
+void telemetryEndGame(bool toppedOut) {
+    if (!gStats.active || simSilent) return;
+
+    uint32_t ms = telemetryNow();
+    int64_t pps = ms ? (int64_t)gStats.pieces * 1000000 / ms : 0;
+    int64_t kpp = gStats.pieces ? (int64_t)gStats.keys * 1000 / gStats.pieces : 0;
+    telemetryPush(TelemetryEvent::GAME_END, gScore, gLines, gLevel, toppedOut ? 1 : 0);
+    telemetryPush(TelemetryEvent::CLEAR_COUNTS, gStats.clearsBySize[1], gStats.clearsBySize[2],
+                  gStats.clearsBySize[3], gStats.clearsBySize[4]);
+    telemetryPush(TelemetryEvent::RATES, gStats.pieces, (int)pps, (int)kpp, (int)ms);
+    gStats.active = false;
+}
+
+static FILE* openTelemetryFile(time_t startTime, int gameNumber) {
+    std::error_code ec;
+    std::filesystem::create_directories("telemetry", ec);
+
+    char name[64];
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&startTime));
+    snprintf(name, sizeof(name), "telemetry/game_%s_%d.csv", stamp, gameNumber);
+
+    FILE* f = fopen(name, "w");
+    if (f) fprintf(f, "t_ms,event,a,b,c,d\n");
+    return f;
+}
+
+// Background thread: drain the ring and write CSV lines
+static void telemetryWriterLoop() {
+    traceSetThreadName("telemetry");
+    FILE* out = nullptr;
+    while (true) {
+        uint32_t tail = telemetryTail.load(std::memory_order_relaxed);
+        uint32_t head = telemetryHead.load(std::memory_order_acquire);
+        if (tail == head) {
+            if (!telemetryRunning.load()) break;
+            if (out) fflush(out);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+
+        TRACE_SCOPE("telemetry.write");
+        for (; tail != head; tail++) {
+            const TelemetryRecord& r = telemetryRing[tail & (TELEMETRY_RING_SIZE - 1)];
+            if (r.type == TelemetryEvent::GAME_START) {
+                if (out) fclose(out);
+                out = openTelemetryFile((time_t)r.a, r.b);
+            }
+            if (!out) continue;
+
+            if (r.type == TelemetryEvent::LOCK) {
+                fprintf(out, "%u,%s,%c,%d,%d,%d\n", r.timeMs, TELEMETRY_EVENT_NAMES[(int)r.type], (char)r.a, r.b, r.c, r.d);
+            } else {
+                fprintf(out, "%u,%s,%d,%d,%d,%d\n", r.timeMs, TELEMETRY_EVENT_NAMES[(int)r.type], r.a, r.b, r.c, r.d);
+            }
+
+            // RATES is the last record of a game
+            if (r.type == TelemetryEvent::RATES) {
+                fclose(out);
+                out = nullptr;
+            }
+        }
+        telemetryTail.store(tail, std::memory_order_release);
+    }
+    if (out) fclose(out);
+}
+
+void telemetryStart() {
+    telemetryRunning = true;
+    telemetryThread = std::thread(telemetryWriterLoop);
+}
+
+// Flush everything still queued and stop the writer thread
+void telemetryStop() {
+    telemetryEndGame(false);
+    telemetryRunning = false;
+    if (telemetryThread.joinable()) telemetryThread.join();
+    if (telemetryDropped > 0) {
+        fprintf(stderr, "telemetry: %u records dropped\n", telemetryDropped.load());
+    }
+}
+
+// ==================== SPECTATOR STREAM ====================
+// Live, compact description of the running game for external viewers
+// (--spectate <file | udp:port>). After each lock only the cells that changed
+// are sent, plus the piece pose whenever it moves; a full keyframe every
+// SPECTATOR_KEYFRAME_TICKS lets a viewer join late. Records are built in a
+// fixed buffer, so the game never allocates for it.
+//
+// Stream: "TSPC" u8 version u8 W u8 H, then records. Numbers are LEB128
+// varints, cells are 4-bit codes (see spectatorCellCode), two per byte.
+//   KEYFRAME  tick score lines level pieces x y shape flags, (H-1)*(W-2) cells
+//   CELLS     tick rowCount, per row: row u16 changedColumns cells
+//   POSE      tick pieces x y shape   (pieces = type<<4 | next, shape = u16 4x4 cell bits)
+//   STATS     tick score lines level
+//   GAME_OVER tick
+enum SpectatorTag : uint8_t {
+    SPEC_KEYFRAME = 1, SPEC_CELLS = 2, SPEC_POSE = 3, SPEC_STATS = 4, SPEC_GAME_OVER = 5
+};
+const uint8_t SPECTATOR_VERSION = 1;
+const int SPECTATOR_KEYFRAME_TICKS = 120;   // Two seconds of play between keyframes
+const int SPECTATOR_BUFFER_SIZE = 4096;
+
+struct SpectatorStream {
+    bool active = false;
+    FILE* file = nullptr;                   // Stream to a file...
+    sf::UdpSocket socket;                   // ...or to a local UDP port
+    unsigned short port = 0;
+
+    uint8_t buf[SPECTATOR_BUFFER_SIZE];     // Records of the current frame
+    int len = 0;
+    char shadow[H][W];                      // Board as the viewer knows it
+    uint32_t dirtyRows = 0;                 // Rows written by block2Board/removeLine since last send
+    bool keyframeDue = true;
+    int lastKeyframeTick = 0;
+    int pieces = -1, poseX = 0, poseY = 0;  // Last pose sent
+    uint16_t shape = 0;
+    int score = -1, lines = -1, level = -1; // Last stats sent
+    bool gameOverSent = false;
+};
+SpectatorStream spectator;
+
+const uint32_t SPECTATOR_ALL_ROWS = (1u << H) - 1;
+
+// Called by the board operations for every row they change
+void spectatorMarkRows(int first, int last) {
+    if (!spectator.active) return;  // Also keeps batch worker threads off the stream
+    for (int r = max(first, 0); r <= min(last, H - 1); r++) spectator.dirtyRows |= 1u << r;
+}
+
+int spectatorCellCode(char c) {
+    switch (c) {
+        case 'I': return 1; case 'J': return 2; case 'L': return 3; case 'O': return 4;
+        case 'S': return 5; case 'T': return 6; case 'Z': return 7; case 'X': return 8;
+        case '#': return 9;
+        default:  return 0;
+    }
+}
+
+char spectatorCellChar(int code) {
+    static const char chars[] = " IJLOSTZX#";
+    return (code >= 0 && code <= 9) ? chars[code] : '?';
+}
+
+static void spectatorPutByte(uint8_t v) {
+    if (spectator.len < SPECTATOR_BUFFER_SIZE) spectator.buf[spectator.len++] = v;
+}
+
+static void spectatorPutVarint(uint32_t v) {
+    while (v >= 0x80) {
+        spectatorPutByte((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    spectatorPutByte((uint8_t)v);
+}
+
+// Write a list of cells as packed 4-bit codes
+static void spectatorPutCells(const char* cells[], int count) {
+    for (int i = 0; i < count; i += 2) {
+        int lo = spectatorCellCode(*cells[i]);
+        int hi = (i + 1 < count) ? spectatorCellCode(*cells[i + 1]) : 0;
+        spectatorPutByte((uint8_t)(lo | (hi << 4)));
+    }
+}
+
+static int spectatorPieces() {
+    return (currentPiece->type << 4) | nextPiece->type;
+}
+
+// Cells of the 4x4 piece grid as bits (bit i*4+j = shape[i][j])
+static uint16_t spectatorShape() {
+    uint16_t bits = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (currentPiece->shape[i][j] != ' ') bits |= (uint16_t)(1u << (i * 4 + j));
+        }
+    }
+    return bits;
+}
+
+static void spectatorPutPose() {
+    spectator.pieces = spectatorPieces();
+    spectator.poseX = x;
+    spectator.poseY = y;
+    spectator.shape = spectatorShape();
+    spectatorPutByte((uint8_t)spectator.pieces);
+    spectatorPutByte((uint8_t)(int8_t)x);
+    spectatorPutByte((uint8_t)(int8_t)y);
+    spectatorPutByte((uint8_t)spectator.shape);
+    spectatorPutByte((uint8_t)(spectator.shape >> 8));
+}
+
+static void spectatorWriteKeyframe() {
+    spectatorPutByte(SPEC_KEYFRAME);
+    spectatorPutVarint(gameTick);
+    spectatorPutVarint(gScore);
+    spectatorPutVarint(gLines);
+    spectatorPutVarint(gLevel);
+    spectatorPutPose();
+    spectatorPutByte(isGameOver ? 1 : 0);
+
+    const char* cells[(H - 1) * (W - 2)];
+    int n = 0;
+    for (int i = 0; i < H - 1; i++) {
+        for (int j = 1; j < W - 1; j++) cells[n++] = &board[i][j];
+    }
+    spectatorPutCells(cells, n);
+
+    memcpy(spectator.shadow, board, sizeof(board));
+    spectator.dirtyRows = 0;
+    spectator.keyframeDue = false;
+    spectator.lastKeyframeTick = gameTick;
+    spectator.score = gScore;
+    spectator.lines = gLines;
+    spectator.level = gLevel;
+    spectator.gameOverSent = isGameOver;
+}
+
+// Send only the cells of dirty rows that differ from what the viewer has
+static void spectatorWriteCells() {
+    int rowCount = 0;
+    uint16_t masks[H] = {};
+    for (int i = 0; i < H - 1; i++) {
+        if (!(spectator.dirtyRows & (1u << i))) continue;
+        for (int j = 1; j < W - 1; j++) {
+            if (board[i][j] != spectator.shadow[i][j]) masks[i] |= (uint16_t)(1u << (j - 1));
+        }
+        if (masks[i]) rowCount++;
+    }
+    spectator.dirtyRows = 0;
+    if (rowCount == 0) return;
+
+    spectatorPutByte(SPEC_CELLS);
+    spectatorPutVarint(gameTick);
+    spectatorPutByte((uint8_t)rowCount);
+    for (int i = 0; i < H - 1; i++) {
+        if (!masks[i]) continue;
+        spectatorPutByte((uint8_t)i);
+        spectatorPutByte((uint8_t)masks[i]);
+        spectatorPutByte((uint8_t)(masks[i] >> 8));
+
+        const char* cells[W];
+        int n = 0;
+        for (int j = 1; j < W - 1; j++) {
+            if (masks[i] & (1u << (j - 1))) {
+                cells[n++] = &board[i][j];
+                spectator.shadow[i][j] = board[i][j];
+            }
+        }
+        spectatorPutCells(cells, n);
+    }
+}
+
+// Open the output: a file name, or "udp:<port>" for a viewer on this machine
+bool spectatorOpen(const string& target) {
+    if (target.rfind("udp:", 0) == 0) {
+        spectator.port = (unsigned short)atoi(target.c_str() + 4);
+        spectator.socket.setBlocking(false);
+        if (spectator.socket.bind(sf::Socket::AnyPort) != sf::Socket::Status::Done) return false;
+    } else {
+        spectator.file = fopen(target.c_str(), "wb");
+        if (!spectator.file) return false;
+        const uint8_t header[7] = { 'T', 'S', 'P', 'C', SPECTATOR_VERSION, (uint8_t)W, (uint8_t)H };
+        fwrite(header, 1, sizeof(header), spectator.file);
+    }
+    spectator.active = true;
+    return true;
+}
+
+// A new game (or a restored snapshot) replaces the whole board
+void spectatorRequestKeyframe() {
+    if (spectator.active) spectator.keyframeDue = true;
+}
+
+// Called once per frame after the simulation: emit what changed and send it
+void spectatorFrame() {
+    if (!spectator.active || !currentPiece) return;
+    spectator.len = 0;
+
+    if (spectator.keyframeDue || gameTick - spectator.lastKeyframeTick >= SPECTATOR_KEYFRAME_TICKS
+        || gameTick < spectator.lastKeyframeTick) {
+        spectatorWriteKeyframe();
+    } else {
+        if (spectator.dirtyRows) spectatorWriteCells();
+
+        if (gScore != spectator.score || gLines != spectator.lines || gLevel != spectator.level) {
+            spectatorPutByte(SPEC_STATS);
+            spectatorPutVarint(gameTick);
+            spectatorPutVarint(gScore);
+            spectatorPutVarint(gLines);
+            spectatorPutVarint(gLevel);
+            spectator.score = gScore;
+            spectator.lines = gLines;
+            spectator.level = gLevel;
+        }
+
+        if (spectatorPieces() != spectator.pieces || x != spectator.poseX || y != spectator.poseY
+            || spectatorShape() != spectator.shape) {
+            spectatorPutByte(SPEC_POSE);
+            spectatorPutVarint(gameTick);
+            spectatorPutPose();
+        }
+
+        if (isGameOver && !spectator.gameOverSent) {
+            spectatorPutByte(SPEC_GAME_OVER);
+            spectatorPutVarint(gameTick);
+            spectator.gameOverSent = true;
+        }
+    }
+
+    if (spectator.len == 0) return;
+    if (spectator.file) {
+        fwrite(spectator.buf, 1, spectator.len, spectator.file);
+        fflush(spectator.file);
+    } else {
+        (void)spectator.socket.send(spectator.buf, spectator.len, sf::IpAddress::LocalHost, spectator.port);
+    }
+}
+
+void spectatorClose() {
+    if (spectator.file) fclose(spectator.file);
+    spectator.file = nullptr;
+    spectator.active = false;
+}
+
+// ==================== SPECTATOR VIEWER (--watch) ====================
+// Headless consumer: rebuilds the board from a spectator stream and prints
+// it to the terminal. A viewer that joins late ignores changes until the
+// next keyframe.
+struct SpectatorView {
+    bool synced = false;            // Seen a keyframe yet
+    char board[H][W];
+    int tick = 0, score = 0, lines = 0, level = 0;
+    int pieces = 0, x = 0, y = 0;
+    uint16_t shape = 0;
+    bool gameOver = false;
+};
+
+// Bounds-checked reader; `ok` turns false if a record runs past the data
+struct SpectatorReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    uint8_t byte() {
+        if (p >= end) { ok = false; return 0; }
+        return *p++;
+    }
+    uint32_t varint() {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b = byte();
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return v;
+    }
+    void pose(SpectatorView& v) {
+        v.pieces = byte();
+        v.x = (int8_t)byte();
+        v.y = (int8_t)byte();
+        v.shape = byte();
+        v.shape |= (uint16_t)(byte() << 8);
+    }
+    void cells(char* out[], int count) {
+        for (int i = 0; i < count; i += 2) {
+            uint8_t b = byte();
+            *out[i] = spectatorCellChar(b & 0x0F);
+            if (i + 1 < count) *out[i + 1] = spectatorCellChar(b >> 4);
+        }
+    }
+};
+
+// Apply one record. Returns bytes used, 0 if the record is incomplete, -1 if invalid.
+int spectatorApplyRecord(SpectatorView& v, const uint8_t* data, int size) {
+    SpectatorReader r{ data, data + size };
+    uint8_t tag = r.byte();
+    int tick = (int)r.varint();
+
+    // Decode into a scratch copy so an incomplete record changes nothing
+    SpectatorView next = v;
+    next.tick = tick;
+    switch (tag) {
+        case SPEC_KEYFRAME: {
+            next.score = (int)r.varint();
+            next.lines = (int)r.varint();
+            next.level = (int)r.varint();
+            r.pose(next);
+            next.gameOver = r.byte() & 1;
+            char* cells[(H - 1) * (W - 2)];
+            int n = 0;
+            for (int i = 0; i < H; i++) {
+                for (int j = 0; j < W; j++) {
+                    bool wall = (i == H - 1) || (j == 0) || (j == W - 1);
+                    next.board[i][j] = wall ? '#' : ' ';
+                    if (!wall) cells[n++] = &next.board[i][j];
+                }
+            }
+            r.cells(cells, n);
+            next.synced = true;
+            break;
+        }
+        case SPEC_CELLS: {
+            int rows = r.byte();
+            for (int k = 0; k < rows && r.ok; k++) {
+                int row = r.byte();
+                uint16_t mask = (uint16_t)(r.byte() | (r.byte() << 8));
+                if (row >= H - 1) return -1;
+                char* cells[W];
+                int n = 0;
+                for (int j = 1; j < W - 1; j++) {
+                    if (mask & (1u << (j - 1))) cells[n++] = &next.board[row][j];
+                }
+                r.cells(cells, n);
+            }
+            break;
+        }
+        case SPEC_POSE:
+            r.pose(next);
+            break;
+        case SPEC_STATS:
+            next.score = (int)r.varint();
+            next.lines = (int)r.varint();
+            next.level = (int)r.varint();
+            break;
+        case SPEC_GAME_OVER:
+            next.gameOver = true;
+            break;
+        default:
+            return -1;
+    }
+    if (!r.ok) return 0;
+    if (next.synced) v = next;
+    return (int)(r.p - data);
+}
+
+static void spectatorPrint(const SpectatorView& v) {
+    char frame[H][W + 1];
+    for (int i = 0; i < H; i++) {
+        memcpy(frame[i], v.board[i], W);
+        frame[i][W] = '\0';
+    }
+
+    // Overlay the falling piece in lower case
+    const char letters[] = "iotszjl";
+    if (!v.gameOver) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                int bx = v.x + j, by = v.y + i;
+                if ((v.shape & (1u << (i * 4 + j))) && bx >= 0 && bx < W && by >= 0 && by < H) {
+                    frame[by][bx] = letters[(v.pieces >> 4) % 7];
+                }
+            }
+        }
+    }
+
+    printf("\x1b[H\x1b[2J");
+    printf("tick %d  score %d  lines %d  level %d%s\n", v.tick, v.score, v.lines, v.level, v.gameOver ? "  GAME OVER" : "");
+    for (int i = 0; i < H; i++) printf("%s\n", frame[i]);
+    fflush(stdout);
+}
+
+// Read a spectator stream from a file (following it as it grows) or a UDP
+// port and keep the terminal view up to date. Runs until interrupted.
+int runSpectatorViewer(const string& source) {
+    SpectatorView view;
+    static uint8_t data[1 << 16];
+    int size = 0;
+    bool changed = false;
+    sf::Clock printClock;
+
+    FILE* file = nullptr;
+    sf::UdpSocket socket;
+    if (source.rfind("udp:", 0) == 0) {
+        if (socket.bind((unsigned short)atoi(source.c_str() + 4)) != sf::Socket::Status::Done) {
+            fprintf(stderr, "watch: cannot listen on %s\n", source.c_str());
+            return -1;
+        }
+    } else {
+        file = fopen(source.c_str(), "rb");
+        uint8_t header[7];
+        if (!file || fread(header, 1, 7, file) != 7 || memcmp(header, "TSPC", 4) != 0
+            || header[4] != SPECTATOR_VERSION || header[5] != W || header[6] != H) {
+            fprintf(stderr, "watch: %s is not a spectator stream\n", source.c_str());
+            if (file) fclose(file);
+            return -1;
+        }
+    }
+
+    while (true) {
+        // Pull in whatever arrived: a datagram always holds whole records
+        int got = 0;
+        if (file) {
+            got = (int)fread(data + size, 1, sizeof(data) - size, file);
+            if (got == 0) clearerr(file);  // At the end for now, keep following
+        } else {
+            std::size_t received = 0;
+            std::optional<sf::IpAddress> sender;
+            unsigned short senderPort = 0;
+            if (socket.receive(data, sizeof(data), received, sender, senderPort) == sf::Socket::Status::Done) {
+                got = (int)received;
+                size = 0;
+            }
+        }
+        size += got;
+
+        int used = 0;
+        while (used < size) {
+            int n = spectatorApplyRecord(view, data + used, size - used);
+            if (n == 0) break;       // Wait for the rest of this record
+            if (n < 0) {             // Corrupt: drop the data and wait for a keyframe
+                view.synced = false;
+                used = size;
+                break;
+            }
+            used += n;
+            changed = true;
+        }
+        memmove(data, data + used, size - used);
+        size -= used;
+
+        if (changed && view.synced && printClock.getElapsedTime().asSeconds() >= 1.f / 30.f) {
+            spectatorPrint(view);
+            printClock.restart();
+            changed = false;
+        }
+        if (got == 0) sf::sleep(sf::milliseconds(10));
+    }
+}
+
+// ==================== ZOBRIST HASHING ====================
+// 64-bit position keys: the XOR of one random key per filled playfield cell,
+// plus keys for the active piece (type, rotation, x, y) and the next piece.
+// boardHash follows board[][] incrementally: block2Board XORs in only the
+// cells it fills. A key belongs to a cell's row, so a cleared line changes
+// the key of every cell that drops, and removeLine rehashes rows 1..i around
+// the shift - O(rows above the line), the same order as the shift itself.
+// Other wholesale changes recompute it. The keys come from a fixed seed, so
+// two processes hash the same position to the same value.
+const int ZOBRIST_XS = W + 3;                   // Piece x from -3 (empty box columns) to W - 1
+
+struct ZobristKeys {
+    uint64_t cell[H][W];
+    uint64_t piece[7][4][H][ZOBRIST_XS];
+    uint64_t next[7];
+};
+
+static uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static const ZobristKeys& zobrist() {
+    static const ZobristKeys* keys = [] {
+        ZobristKeys* k = new ZobristKeys;
+        uint64_t state = 0x5353303038ull;  // "SS008"
+        for (auto& row : k->cell) for (uint64_t& v : row) v = splitMix64(state);
+        for (auto& t : k->piece) for (auto& r : t) for (auto& row : r) for (uint64_t& v : row) v = splitMix64(state);
+        for (uint64_t& v : k->next) v = splitMix64(state);
+        return k;
+    }();
+    return *keys;
+}
+
+// Hash of the filled playfield cells in rows first..last
+uint64_t zobristRows(const char b[H][W], int first, int last) {
+    const ZobristKeys& z = zobrist();
+    uint64_t h = 0;
+    for (int r = first; r <= last; r++) {
+        for (int c = 1; c < W - 1; c++) {
+            if (b[r][c] != ' ') h ^= z.cell[r][c];
+        }
+    }
+    return h;
+}
+
+uint64_t zobristPiece(int type, int rotation, int px, int py) {
+    return zobrist().piece[type][rotation & 3][py][px + 3];
+}
+
+// Whole position: board, active piece and next piece
+uint64_t positionHash(uint64_t boardKey, int type, int rotation, int px, int py, int nextType) {
+    return boardKey ^ zobristPiece(type, rotation, px, py) ^ zobrist().next[nextType];
+}
+
+// Position hash of the running game
+uint64_t gameHash() {
+    return positionHash(boardHash, currentPiece->type, currentPiece->rotation, x, y, nextPiece->type);
+}
+
+// ==================== GAME SNAPSHOTS ====================
+// The whole game as plain data. Copying one saves or restores a game in a
+// few hundred bytes; versus keeps a short history of them for rollback.
+struct SimState {
+    char board[H][W];
+    char pieceShape[4][4];
+    int8_t pieceType, pieceRotation, nextType;
+    int8_t pieceQueue[7], queueIndex;
+    bool isGameOver;
+    int x, y;
+    int gravity, gravityAcc, lockTicks, lockResets, lowestY, inputTicks, gameTick;
+    int gScore, gLines, gLevel, currentLevel;
+    int garbageIn, garbageOut;
+    uint32_t gameSeed, rngState, garbageRngState;
+};
+
+// Reuse a piece object if it already has the wanted type
+Piece* restorePiece(Piece* p, int type) {
+    if (p && p->type == type) return p;
+    delete p;
+    return createPieceFromType(type);
+}
+
+// Copy the running game into a snapshot
+void saveSim(SimState& s) {
+    memcpy(s.board, board, sizeof(board));
+    memcpy(s.pieceShape, currentPiece->shape, sizeof(s.pieceShape));
+    s.pieceType = (int8_t)currentPiece->type;
+    s.pieceRotation = (int8_t)currentPiece->rotation;
+    s.nextType = (int8_t)nextPiece->type;
+    for (int i = 0; i < 7; i++) s.pieceQueue[i] = (int8_t)pieceQueue[i];
+    s.queueIndex = (int8_t)queueIndex;
+    s.isGameOver = isGameOver;
+    s.x = x; s.y = y;
+    s.gravity = gravity; s.gravityAcc = gravityAcc;
+    s.lockTicks = lockTicks; s.lockResets = lockResets; s.lowestY = lowestY;
+    s.inputTicks = inputTicks;
+    s.gameTick = gameTick;
+    s.gScore = gScore; s.gLines = gLines; s.gLevel = gLevel; s.currentLevel = currentLevel;
+    s.garbageIn = garbageIn; s.garbageOut = garbageOut;
+    s.gameSeed = gameSeed; s.rngState = rngState; s.garbageRngState = garbageRngState;
+}
+
+// Continue the game stored in a snapshot
+void loadSim(const SimState& s) {
+    memcpy(board, s.board, sizeof(board));
+    boardHash = zobristRows(board, 0, H - 2);
+    currentPiece = restorePiece(currentPiece, s.pieceType);
+    memcpy(currentPiece->shape, s.pieceShape, sizeof(s.pieceShape));
+    currentPiece->rotation = s.pieceRotation;
+    nextPiece = restorePiece(nextPiece, s.nextType);
+    for (int i = 0; i < 7; i++) pieceQueue[i] = s.pieceQueue[i];
+    queueIndex = s.queueIndex;
+    isGameOver = s.isGameOver;
+    x = s.x; y = s.y;
+    gravity = s.gravity; gravityAcc = s.gravityAcc;
+    lockTicks = s.lockTicks; lockResets = s.lockResets; lowestY = s.lowestY;
+    inputTicks = s.inputTicks;
+    gameTick = s.gameTick;
+    spectatorMarkRows(0, H - 1);  // Any row may differ from before
+    gScore = s.gScore; gLines = s.gLines; gLevel = s.gLevel; currentLevel = s.currentLevel;
+    garbageIn = s.garbageIn; garbageOut = s.garbageOut;
+    gameSeed = s.gameSeed; rngState = s.rngState; garbageRngState = s.garbageRngState;
+}
+
+// Position hash of a snapshot, plus its score and garbage, for comparing two engines
+uint64_t simHash(const SimState& s) {
+    uint64_t h = positionHash(zobristRows(s.board, 0, H - 2), s.pieceType, s.pieceRotation, s.x, s.y, s.nextType);
+    uint64_t extra = (uint64_t)(uint32_t)s.gScore << 32 ^ (uint64_t)(uint32_t)s.garbageIn << 16 ^ (uint64_t)s.isGameOver;
+    return h ^ splitMix64(extra);
+}
+
+// ==================== REPLAY ARCHIVE ====================
+// Many recorded games in one file (replays/replays.tra by default):
+//   ArchiveHeader
+//   per game: ReplayHeader, ReplayKeyframe[keyframeCount], uint32 runs[runCount]
+//   index: ArchiveEntry[count], then the entry numbers sorted by seed,
+//          player, score and date (one uint32 array per ArchiveOrder)
+// A game is stored as its seed plus the input of every tick, run-length coded
+// (run = ticks << 8 | input). Every keyframeTicks the whole SimState is stored
+// as well, so any tick is reached by loading keyframe tick / keyframeTicks and
+// simulating less than one interval. The archive is memory-mapped: opening it
+// only touches the header, and a game's pages are read when it is played.
+const uint32_t ARCHIVE_VERSION = 1;
+const uint32_t REPLAY_KEYFRAME_TICKS = 600;   // 10 s of play between stored states
+const size_t REPLAY_RESERVE_KEYFRAMES = 256;  // Recording capacity before it reallocates (40+ minutes)
+const size_t REPLAY_RESERVE_RUNS = 32768;
+const char* const REPLAY_ARCHIVE_PATH = "replays/replays.tra";
+const uint32_t REPLAY_TOPPED_OUT = 1;         // Flag: the game ended by topping out (else abandoned)
+
+enum ArchiveOrder { BY_SEED, BY_PLAYER, BY_SCORE, BY_DATE, ARCHIVE_ORDERS };  // BY_SCORE is highest first
+const char* const ARCHIVE_ORDER_NAMES[] = { "seed", "player", "score", "date" };
+
+struct ArchiveHeader {
+    char magic[4];                      // "TRAR"
+    uint32_t version;
+    uint32_t simStateSize;              // Keyframes are raw SimStates of the writer
+    uint32_t keyframeTicks;
+    uint64_t count;                     // Games in the archive
+    uint64_t indexOffset;               // ArchiveEntry[count]; game data ends here
+    uint64_t orderOffset[ARCHIVE_ORDERS]; // uint32[count] per ArchiveOrder
+};
+
+struct ArchiveEntry {
+    uint64_t offset;                    // ReplayHeader of this game
+    int64_t date;                       // Start time (unix)
+    char player[24];                    // Zero padded
+    uint32_t seed;
+    uint32_t ticks;
+    int32_t score, lines, level;
+    uint32_t flags;
+};
+
+struct ReplayHeader {
+    uint32_t ticks;
+    uint32_t runCount;
+    uint32_t keyframeCount;
+    uint32_t seed;
+    int32_t score, lines, level;
+    uint32_t flags;
+};
+
+struct ReplayKeyframe {
+    uint32_t tick;                      // index * keyframeTicks
+    uint32_t run, runOffset;            // Input position at that tick
+    uint32_t pad;
+    SimState state;
+};
+static_assert(sizeof(ArchiveEntry) == 64 && sizeof(ReplayKeyframe) % 8 == 0, "archive records must stay packed");
+
+// Read-only view of a whole file
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+void unmapFile(MappedFile& m) {
+#ifdef _WIN32
+    if (m.data) UnmapViewOfFile(m.data);
+    if (m.mapping) CloseHandle(m.mapping);
+    if (m.file != INVALID_HANDLE_VALUE) CloseHandle(m.file);
+#else
+    if (m.data) munmap((void*)m.data, m.size);
+    if (m.fd >= 0) close(m.fd);
+#endif
+    m = MappedFile{};
+}
+
+// Map a file; nothing is read until a page is first touched
+bool mapFile(const char* path, MappedFile& m) {
+#ifdef _WIN32
+    m.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m.file, &size) || size.QuadPart == 0) {
+        unmapFile(m);
+        return false;
+    }
+    m.size = (size_t)size.QuadPart;
+    m.mapping = CreateFileMappingA(m.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m.mapping) m.data = (const uint8_t*)MapViewOfFile(m.mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    m.fd = open(path, O_RDONLY);
+    if (m.fd < 0) return false;
+    struct stat st;
+    if (fstat(m.fd, &st) != 0 || st.st_size == 0) {
+        unmapFile(m);
+        return false;
+    }
+    m.size = (size_t)st.st_size;
+    void* p = mmap(nullptr, m.size, PROT_READ, MAP_SHARED, m.fd, 0);
+    if (p != MAP_FAILED) m.data = (const uint8_t*)p;
+#endif
+    if (!m.data) {
+        unmapFile(m);
+        return false;
+    }
+    return true;
+}
+
+struct ReplayArchive {
+    MappedFile file;
+    const ArchiveHeader* header = nullptr;
+    const ArchiveEntry* entries = nullptr;
+    const uint32_t* order[ARCHIVE_ORDERS] = {};
+};
+
+// One game of an archive, pointing into the mapping
+struct ReplayView {
+    const ReplayHeader* header = nullptr;
+    const ReplayKeyframe* keyframes = nullptr;
+    const uint32_t* runs = nullptr;
+};
+
+void closeArchive(ReplayArchive& a) {
+    unmapFile(a.file);
+    a = ReplayArchive{};
+}
+
+// Map an archive and check that its header and index fit in the file
+bool openArchive(const char* path, ReplayArchive& a) {
+    if (!mapFile(path, a.file)) return false;
+    const ArchiveHeader* h = (const ArchiveHeader*)a.file.data;
+    uint64_t size = a.file.size;
+    bool ok = size >= sizeof(ArchiveHeader) && memcmp(h->magic, "TRAR", 4) == 0 &&
+              h->version == ARCHIVE_VERSION && h->simStateSize == sizeof(SimState) &&
+              h->keyframeTicks > 0 && h->indexOffset % 8 == 0 && h->count < (1ull << 32) &&
+              h->indexOffset <= size && h->count * sizeof(ArchiveEntry) <= size - h->indexOffset;
+    for (int o = 0; ok && o < ARCHIVE_ORDERS; o++) {
+        ok = h->orderOffset[o] % 4 == 0 && h->orderOffset[o] <= size &&
+             h->count * sizeof(uint32_t) <= size - h->orderOffset[o];
+    }
+    if (!ok) {
+        closeArchive(a);
+        return false;
+    }
+    a.header = h;
+    a.entries = (const ArchiveEntry*)(a.file.data + h->indexOffset);
+    for (int o = 0; o < ARCHIVE_ORDERS; o++) {
+        a.order[o] = (const uint32_t*)(a.file.data + h->orderOffset[o]);
+    }
+    return true;
+}
+
+// Locate game i; false if its data doesn't fit before the index
+bool getReplay(const ReplayArchive& a, uint64_t i, ReplayView& v) {
+    if (i >= a.header->count) return false;
+    uint64_t offset = a.entries[i].offset;
+    uint64_t end = a.header->indexOffset;
+    if (offset % 8 != 0 || offset < sizeof(ArchiveHeader) || end - offset < sizeof(ReplayHeader)) return false;
+    const ReplayHeader* h = (const ReplayHeader*)(a.file.data + offset);
+    uint64_t need = sizeof(ReplayHeader) + (uint64_t)h->keyframeCount * sizeof(ReplayKeyframe) +
+                    (uint64_t)h->runCount * sizeof(uint32_t);
+    if (need > end - offset || h->keyframeCount == 0) return false;
+    v.header = h;
+    v.keyframes = (const ReplayKeyframe*)(h + 1);
+    v.runs = (const uint32_t*)(v.keyframes + h->keyframeCount);
+    return true;
+}
+
+// A finished game waiting to be written
+struct ReplayRecord {
+    ArchiveEntry entry;
+    vector<ReplayKeyframe> keyframes;
+    vector<uint32_t> runs;
+};
+
+static bool seekFile(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(f, (long long)offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// Flush a file and wait until it is on disk
+static bool syncFile(FILE* f) {
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Pad the file (positioned at dataEnd) to the next multiple of 8 bytes
+static void archivePad(FILE* f, uint64_t& dataEnd) {
+    static const uint64_t zero = 0;
+    if (dataEnd % 8) {
+        fwrite(&zero, 1, 8 - dataEnd % 8, f);
+        dataEnd += 8 - dataEnd % 8;
+    }
+}
+
+// Write a new game at dataEnd (the file position); returns its index entry
+static ArchiveEntry archiveWriteGame(FILE* f, const ReplayRecord& g, uint64_t& dataEnd) {
+    ArchiveEntry e = g.entry;
+    e.offset = dataEnd;
+    ReplayHeader h = { e.ticks, (uint32_t)g.runs.size(), (uint32_t)g.keyframes.size(), e.seed,
+                       e.score, e.lines, e.level, e.flags };
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(g.keyframes.data(), sizeof(ReplayKeyframe), g.keyframes.size(), f);
+    fwrite(g.runs.data(), sizeof(uint32_t), g.runs.size(), f);
+    dataEnd += sizeof(h) + g.keyframes.size() * sizeof(ReplayKeyframe) + g.runs.size() * sizeof(uint32_t);
+    archivePad(f, dataEnd);
+    return e;
+}
+
+// Write the index of `entries` at dataEnd (the file position); returns the header pointing at it
+static ArchiveHeader archiveWriteIndex(FILE* f, const vector<ArchiveEntry>& entries, uint64_t dataEnd) {
+    ArchiveHeader header = {};
+    memcpy(header.magic, "TRAR", 4);
+    header.version = ARCHIVE_VERSION;
+    header.simStateSize = sizeof(SimState);
+    header.keyframeTicks = REPLAY_KEYFRAME_TICKS;
+    header.count = entries.size();
+    header.indexOffset = dataEnd;
+    fwrite(entries.data(), sizeof(ArchiveEntry), entries.size(), f);
+
+    // Secondary orders; ties keep archive order
+    uint64_t offset = dataEnd + entries.size() * sizeof(ArchiveEntry);
+    vector<uint32_t> order(entries.size());
+    for (int o = 0; o < ARCHIVE_ORDERS; o++) {
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const ArchiveEntry& ea = entries[a];
+            const ArchiveEntry& eb = entries[b];
+            switch (o) {
+                case BY_SEED:   return ea.seed < eb.seed;
+                case BY_PLAYER: return strncmp(ea.player, eb.player, sizeof(ea.player)) < 0;
+                case BY_SCORE:  return ea.score > eb.score;
+                default:        return ea.date < eb.date;
+            }
+        });
+        header.orderOffset[o] = offset;
+        fwrite(order.data(), sizeof(uint32_t), order.size(), f);
+        offset += order.size() * sizeof(uint32_t);
+    }
+    return header;
+}
+
+// Bytes of a stored game, padding included
+static uint64_t replayBytes(const ReplayView& v) {
+    uint64_t bytes = sizeof(ReplayHeader) + (uint64_t)v.header->keyframeCount * sizeof(ReplayKeyframe) +
+                     (uint64_t)v.header->runCount * sizeof(uint32_t);
+    return (bytes + 7) & ~7ull;
+}
+
+// Write the games of `old` and then `games` to a compacted copy at `temp`
+static bool archiveRewrite(const char* temp, const ReplayArchive& old, const vector<ReplayRecord>& games) {
+    FILE* f = fopen(temp, "wb");
+    if (!f || !seekFile(f, sizeof(ArchiveHeader))) {
+        fprintf(stderr, "Cannot write replay archive %s\n", temp);
+        if (f) fclose(f);
+        return false;
+    }
+    uint64_t dataEnd = sizeof(ArchiveHeader);
+    vector<ArchiveEntry> entries;
+    entries.reserve(old.header->count + games.size());
+    for (uint64_t i = 0; i < old.header->count; i++) {
+        ReplayView v;
+        if (!getReplay(old, i, v)) continue;  // Unreadable already; nothing to keep
+        ArchiveEntry e = old.entries[i];
+        e.offset = dataEnd;
+        uint64_t bytes = replayBytes(v);
+        fwrite(v.header, 1, bytes, f);  // Padding included: games are 8-aligned, so it is in the mapping too
+        dataEnd += bytes;
+        entries.push_back(e);
+    }
+    for (const ReplayRecord& g : games) entries.push_back(archiveWriteGame(f, g, dataEnd));
+    ArchiveHeader header = archiveWriteIndex(f, entries, dataEnd);
+    bool ok = !ferror(f) && seekFile(f, 0) && fwrite(&header, sizeof(header), 1, f) == 1 && syncFile(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) fprintf(stderr, "Error writing replay archive %s\n", temp);
+    return ok;
+}
+
+// Add games to an archive (created if missing). The new games and a new index
+// are written after the end of the file and synced before the header is
+// rewritten to point at them, so until then the old header still describes
+// the old, untouched index: a crash or a full disk loses only the new games.
+// Each append leaves the previous index behind as dead space; once that
+// outweighs the games, the archive is rewritten compacted to a temporary file
+// that replaces it. Appending costs the new data plus one pass over the
+// index - batch writers should pass many games at once.
+bool archiveAppend(const char* path, const vector<ReplayRecord>& games) {
+    vector<ArchiveEntry> entries;
+    uint64_t dataEnd = sizeof(ArchiveHeader);
+    std::error_code ec;
+    bool exists = std::filesystem::file_size(path, ec) > 0 && !ec;
+    if (exists) {
+        ReplayArchive old;
+        if (!openArchive(path, old)) {
+            fprintf(stderr, "%s is not a replay archive\n", path);
+            return false;
+        }
+        uint64_t live = 0;
+        for (uint64_t i = 0; i < old.header->count; i++) {
+            ReplayView v;
+            if (getReplay(old, i, v)) live += replayBytes(v);
+        }
+        if (old.file.size - sizeof(ArchiveHeader) - live > live) {
+            string temp = string(path) + ".tmp";
+            bool ok = archiveRewrite(temp.c_str(), old, games);
+            closeArchive(old);  // Windows can't replace a mapped file
+#ifdef _WIN32
+            ok = ok && MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+            ok = ok && rename(temp.c_str(), path) == 0;
+#endif
+            if (!ok) {
+                fprintf(stderr, "Cannot replace replay archive %s\n", path);
+                remove(temp.c_str());
+            }
+            return ok;
+        }
+        entries.assign(old.entries, old.entries + old.header->count);
+        dataEnd = (old.file.size + 7) & ~7ull;
+        closeArchive(old);
+    } else {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+    }
+
+    FILE* f = fopen(path, exists ? "r+b" : "w+b");
+    if (!f || !seekFile(f, dataEnd)) {
+        fprintf(stderr, "Cannot write replay archive %s\n", path);
+        if (f) fclose(f);
+        return false;
+    }
+    for (const ReplayRecord& g : games) entries.push_back(archiveWriteGame(f, g, dataEnd));
+    ArchiveHeader header = archiveWriteIndex(f, entries, dataEnd);
+
+    // The header goes last, once everything it points at is on disk
+    bool ok = !ferror(f) && syncFile(f) && seekFile(f, 0) && fwrite(&header, sizeof(header), 1, f) == 1 &&
+              syncFile(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) fprintf(stderr, "Error writing replay archive %s\n", path);
+    return ok;
+}
+
+// ==================== REPLAY RECORDING ====================
+// Solo games are recorded while they are played (inputs and keyframes, kept in
+// memory) and appended to the archive on a background thread when they end.
+struct ReplayRecorder {
+    bool enabled = true;                // --no-record turns recording off
+    bool active = false;                // A game is being recorded
+    string archivePath = REPLAY_ARCHIVE_PATH;
+    string player = "player";
+    ReplayRecord game;
+};
+ReplayRecorder recorder;
+std::thread replaySaveThread;
+
+// Start recording the game that resetGame() just set up
+void replayBeginGame() {
+    if (!recorder.enabled) return;
+    recorder.game = ReplayRecord{};
+    recorder.game.keyframes.reserve(REPLAY_RESERVE_KEYFRAMES);  // Recording never reallocates during play
+    recorder.game.runs.reserve(REPLAY_RESERVE_RUNS);
+    ArchiveEntry& e = recorder.game.entry;
+    e.seed = gameSeed;
+    e.date = (int64_t)time(0);
+    strncpy(e.player, recorder.player.c_str(), sizeof(e.player) - 1);
+    recorder.active = true;
+}
+
+// Called by simTick with the input of every tick, before it is applied
+void replayRecordTick(uint8_t input) {
+    if (!recorder.active || simSilent) return;
+    ReplayRecord& g = recorder.game;
+    if (gameTick % REPLAY_KEYFRAME_TICKS == 0) {
+        ReplayKeyframe k;
+        memset(&k, 0, sizeof(k));  // No stray padding bytes in the file
+        k.tick = gameTick;
+        k.run = g.runs.empty() ? 0 : (uint32_t)g.runs.size() - 1;
+        k.runOffset = g.runs.empty() ? 0 : g.runs.back() >> 8;
+        saveSim(k.state);
+        g.keyframes.push_back(k);
+    }
+    if (!g.runs.empty() && (g.runs.back() & 0xFF) == input && (g.runs.back() >> 8) < 0xFFFFFF) {
+        g.runs.back() += 1 << 8;
+    } else {
+        g.runs.push_back(1u << 8 | input);
+    }
+}
+
+// Finish the recording and hand it to the save thread
+void replayEndGame(bool toppedOut) {
+    if (!recorder.active || simSilent) return;
+    recorder.active = false;
+    if (gameTick == 0) return;
+
+    ArchiveEntry& e = recorder.game.entry;
+    e.ticks = gameTick;
+    e.score = gScore;
+    e.lines = gLines;
+    e.level = gLevel;
+    e.flags = toppedOut ? REPLAY_TOPPED_OUT : 0;
+
+    if (replaySaveThread.joinable()) {
+        TRACE_SCOPE("replay.waitForSave");
+        replaySaveThread.join();
+    }
+    vector<ReplayRecord> games(1);
+    games[0] = std::move(recorder.game);
+    replaySaveThread = std::thread([games = std::move(games), path = recorder.archivePath]() {
+        traceSetThreadName("replay save");
+        TRACE_SCOPE("archiveAppend");
+        archiveAppend(path.c_str(), games);
+    });
+}
+
+// Store the game in progress and wait for pending writes
+void replayStop() {
+    replayEndGame(false);
+    if (replaySaveThread.joinable()) replaySaveThread.join();
+}
+
+// ==================== PARTICLES & EFFECTS ====================
+// Line clears and locks throw particles, flash the cleared rows and let the
+// rows above fall into place instead of jumping. Particles live in a fixed
+// pool with one array per field: the update is a branch-free loop over floats
+// that the compiler vectorizes, a burst only fills free slots (a full pool
+// drops the rest), and all of them are drawn as one vertex array in a single
+// draw call. Effects follow the visible game only, never silent simulation.
+const int MAX_PARTICLES = 4096;
+const float PARTICLE_GRAVITY = 900.f;        // px/s^2
+const float PARTICLE_SIZE = 4.f;             // px
+const float ROW_FLASH_SECONDS = 0.25f;
+const float ROW_FALL_SPEED = 600.f;          // px/s for rows dropping into a cleared row
+const int EFFECT_VERTICES = (MAX_PARTICLES + H) * 6;  // Two triangles per particle and per row flash
+
+struct ParticlePool {
+    alignas(32) float x[MAX_PARTICLES];
+    alignas(32) float y[MAX_PARTICLES];
+    alignas(32) float vx[MAX_PARTICLES];
+    alignas(32) float vy[MAX_PARTICLES];
+    alignas(32) float life[MAX_PARTICLES];   // Seconds left
+    alignas(32) float fade[MAX_PARTICLES];   // 1 / starting life
+    uint32_t color[MAX_PARTICLES];           // 0xRRGGBB
+    int count = 0;
+};
+
+struct BoardEffects {
+    ParticlePool particles;
+    float rowFlash[H] = {};                  // Seconds of flash left per row
+    float rowOffset[H] = {};                 // Pixels a row is still drawn above its place
+    uint32_t rng = 0x2545F491u;              // Own generator, the game's RNG stays untouched
+    sf::Vertex vertices[EFFECT_VERTICES];
+};
+BoardEffects effects;
+
+static float effectsRandom() {
+    effects.rng ^= effects.rng << 13;
+    effects.rng ^= effects.rng >> 17;
+    effects.rng ^= effects.rng << 5;
+    return (effects.rng >> 8) * (1.f / 16777216.f);
+}
+
+// `n` particles flying out of (px, py) at up to `speed` px/s, biased upwards by `lift`
+static void spawnParticles(float px, float py, int n, Color c, float speed, float lift) {
+    ParticlePool& p = effects.particles;
+    uint32_t rgb = (uint32_t)c.r << 16 | (uint32_t)c.g << 8 | c.b;
+    for (int i = 0; i < n && p.count < MAX_PARTICLES; i++) {
+        int k = p.count++;
+        float angle = effectsRandom() * 6.2831853f;
+        float s = speed * (0.3f + 0.7f * effectsRandom());
+        float life = 0.4f + 0.5f * effectsRandom();
+        p.x[k] = px;
+        p.y[k] = py;
+        p.vx[k] = cosf(angle) * s;
+        p.vy[k] = sinf(angle) * s - lift;
+        p.life[k] = life;
+        p.fade[k] = 1.f / life;
+        p.color[k] = rgb;
+    }
+}
+
+void effectsClear() {
+    effects.particles.count = 0;
+    for (int i = 0; i < H; i++) effects.rowFlash[i] = effects.rowOffset[i] = 0.f;
+}
+
+// removeLine is about to remove `row` and move the rows above it down one
+void effectsRowCleared(int row) {
+    if (simSilent) return;
+    for (int j = 1; j < W - 1; j++) {
+        spawnParticles((j + 0.5f) * TILE_SIZE, (row + 0.5f) * TILE_SIZE, 12, getColor(board[row][j]), 260.f, 120.f);
+    }
+    effects.rowFlash[row] = ROW_FLASH_SECONDS;
+    for (int i = 1; i <= row; i++) effects.rowOffset[i] += TILE_SIZE;  // Drawn from where they were
+}
+
+// block2Board has just written the current piece into the board
+void effectsPieceLocked() {
+    if (simSilent) return;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (currentPiece->shape[i][j] == ' ') continue;
+            spawnParticles((x + j + 0.5f) * TILE_SIZE, (y + i + 1.f) * TILE_SIZE, 3,
+                           getColor(currentPiece->shape[i][j]), 90.f, 40.f);
+        }
+    }
+}
+
+void effectsUpdate(float dt) {
+    ParticlePool& p = effects.particles;
+    int n = p.count;
+    float fall = PARTICLE_GRAVITY * dt;
+    int padded = (n + 7) & ~7;  // Whole vectors; slots past count are scratch
+    for (int k = 0; k < padded; k++) {
+        p.vy[k] += fall;
+        p.x[k] += p.vx[k] * dt;
+        p.y[k] += p.vy[k] * dt;
+        p.life[k] -= dt;
+    }
+
+    // Dead particles are replaced by the last live one
+    for (int k = 0; k < n;) {
+        if (p.life[k] > 0.f) {
+            k++;
+            continue;
+        }
+        n--;
+        p.x[k] = p.x[n]; p.y[k] = p.y[n];
+        p.vx[k] = p.vx[n]; p.vy[k] = p.vy[n];
+        p.life[k] = p.life[n]; p.fade[k] = p.fade[n];
+        p.color[k] = p.color[n];
+    }
+    p.count = n;
+
+    for (int i = 0; i < H; i++) {
+        effects.rowFlash[i] = max(0.f, effects.rowFlash[i] - dt);
+        effects.rowOffset[i] = max(0.f, effects.rowOffset[i] - ROW_FALL_SPEED * dt);
+    }
+}
+
+static void putQuad(sf::Vertex* v, float left, float top, float w, float h, Color c) {
+    const Vector2f corners[6] = { { left, top }, { left + w, top }, { left, top + h },
+                                  { left + w, top }, { left + w, top + h }, { left, top + h } };
+    for (int i = 0; i < 6; i++) {
+        v[i].position = corners[i];
+        v[i].color = c;
+    }
+}
+
+// Row flashes and particles, in one draw call
+void effectsDraw(sf::RenderWindow& window) {
+    sf::Vertex* v = effects.vertices;
+    int used = 0;
+    for (int i = 0; i < H; i++) {
+        if (effects.rowFlash[i] <= 0.f) continue;
+        uint8_t alpha = (uint8_t)(200.f * effects.rowFlash[i] / ROW_FLASH_SECONDS);
+        putQuad(v + used, TILE_SIZE, i * TILE_SIZE, (W - 2) * TILE_SIZE, TILE_SIZE, Color(255, 255, 255, alpha));
+        used += 6;
+    }
+    const ParticlePool& p = effects.particles;
+    for (int k = 0; k < p.count; k++) {
+        uint32_t rgb = p.color[k];
+        uint8_t alpha = (uint8_t)(255.f * min(1.f, p.life[k] * p.fade[k]));
+        putQuad(v + used, p.x[k] - PARTICLE_SIZE / 2, p.y[k] - PARTICLE_SIZE / 2, PARTICLE_SIZE, PARTICLE_SIZE,
+                Color((uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb, alpha));
+        used += 6;
+    }
+    if (used > 0) window.draw(v, used, PrimitiveType::Triangles);
+}
+
+// Anything still moving: particles, flashes or rows falling into place
+bool effectsActive() {
+    if (effects.particles.count > 0) return true;
+    for (int i = 0; i < H; i++) {
+        if (effects.rowFlash[i] > 0.f || effects.rowOffset[i] > 0.f) return true;
+    }
+    return false;
+}
+
+// ==================== BOARD OPERATIONS ====================
+// Commit current piece to board
+void block2Board() {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (currentPiece->shape[i][j] != ' ') {
+                if (board[y + i][x + j] == ' ') boardHash ^= zobrist().cell[y + i][x + j];
+                board[y + i][x + j] = currentPiece->shape[i][j];
+            }
+        }
+    }
+    spectatorMarkRows(y, y + 3);
+    effectsPieceLocked();
+
+    // Record where the piece locked and how many inputs it took
+    gStats.pieces++;
+    telemetryPush(TelemetryEvent::LOCK, pieceLetter(currentPiece), x, y, gStats.pieceKeys);
+    if (eventThinning != EventThinning::MUTED) {
+        flightRecord(FlightEvent::LOCK, currentPiece->type, x, y, currentPiece->rotation, gStats.pieceKeys);
+    }
+    gStats.pieceKeys = 0;
+}
+
+// Initialize empty board with walls
+void initBoard() {
+    for (int i = 0; i < H; i++) {
+        for (int j = 0; j < W; j++) {
+            // Add borders (walls marked with '#')
+            if ((i == H - 1) || (j == 0) || (j == W - 1)) {
+                board[i][j] = '#';
+            } else {
+                board[i][j] = ' ';
+            }
+        }
+    }
+    boardHash = 0;
+}
+
+// Check if current piece can move in direction (dx, dy)
+bool canMove(int dx, int dy) {
+    if (!currentPiece) return false;
+    
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (currentPiece->shape[i][j] != ' ') {
+                int tx = x + j + dx;
+                int ty = y + i + dy;
+                
+                // Check bounds and collision
+                if (tx < 1 || tx >= W - 1 || ty >= H - 1) return false;
+                if (board[ty][tx] != ' ') return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Calculate Y position for ghost piece (preview of landing position)
+int getGhostY() {
+    int ghostY = y;
+    while (true) {
+        bool canGo = true;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (currentPiece->shape[i][j] != ' ') {
+                    int tx = x + j;
+                    int ty = ghostY + i + 1;
+                    // Check if we hit bottom or collision
+                    if (ty >= H - 1 || board[ty][tx] != ' ') {
+                        canGo = false;
+                        break;
+                    }
+                }
+            }
+            if (!canGo) break;
+        }
+        if (!canGo) break;
+        ghostY++;
+    }
+    return ghostY;
+}
+
+// ==================== GAME PROGRESSION ====================
+// Gravity per level in sub-rows per tick (GRAVITY_UNIT = one row per tick).
+// Levels 0-9 keep the old 0.8s..0.08s per row curve, then it climbs to 20G.
+const int GRAVITY_TABLE[] = {
+    5, 6, 7, 8, 9, 11, 13, 18, 27, 53,                     // Levels 0-9
+    64, 85, 128, 256, 512, 768, 1280, 2560, 3840, 5120     // Levels 10-19 (19+ = 20G)
+};
+const int GRAVITY_LEVELS = sizeof(GRAVITY_TABLE) / sizeof(GRAVITY_TABLE[0]);
+
+// Versus: garbage rows sent to the opponent per lines cleared at once
+const int GARBAGE_TABLE[5] = {0, 0, 1, 2, 4};
+
+// Increase game speed (gravity) when leveling up
+void SpeedIncrement() {
+    gravity = GRAVITY_TABLE[min(gLevel, GRAVITY_LEVELS - 1)];
+}
+
+// Update score and level based on lines cleared
+void applyLineClearScore(int cleared) {
+    if (cleared <= 0) return;
+    
+    gLines += cleared;
+    gScore += 100 * cleared;           // 100 points per line
+    gLevel = gLines / 10;              // Level up every 10 lines
+    
+    // Increase game speed when leveling up
+    if (gLevel > currentLevel) {
+        SpeedIncrement();
+        currentLevel = gLevel;
+        telemetryPush(TelemetryEvent::LEVEL_UP, gLevel, (int)((gStats.gameTime - gStats.levelStart) * 1000.f));
+        emitEvent(EngineEvent::LEVEL_UP, gLevel);
+        gStats.levelStart = gStats.gameTime;
+    }
+}
+
+// Detect and remove completed lines
+int removeLine() {
+    TRACE_SCOPE("removeLine");
+    int cleared = 0;
+    
+    // Check each row from bottom up
+    for (int i = H - 2; i > 0; i--) {
+        bool isFull = true;
+        
+        // Check if row is completely filled
+        for (int j = 1; j < W - 1; j++) {
+            if (board[i][j] == ' ') { 
+                isFull = false; 
+                break; 
+            }
+        }
+        
+        // If full, remove and drop lines above
+        if (isFull) {
+            cleared++;
+            
+            // Move all rows above down by one
+            effectsRowCleared(i);
+            boardHash ^= zobristRows(board, 1, i);  // Every row that moves gets new keys, see ZOBRIST HASHING
+            for (int k = i; k > 0; k--) {
+                for (int j = 1; j < W - 1; j++) {
+                    board[k][j] = (k != 1) ? board[k - 1][j] : ' ';
+                }
+            }
+            boardHash ^= zobristRows(board, 1, i);
+            spectatorMarkRows(0, i);
+            i++;  // Check same row again (shifted down)
+        }
+    }
+
+    if (cleared > 0) {
+        gStats.clearsBySize[min(cleared, 4)]++;
+        telemetryPush(TelemetryEvent::CLEAR, cleared);
+        emitEvent(EngineEvent::CLEAR, cleared);
+    }
+    return cleared;
+}
+
+// ==================== GRAVITY & LOCK DELAY ====================
+// A successful move or rotation restarts the lock delay a limited number of
+// times; reaching a new lowest row gives the full allowance back
+void resetLockDelay() {
+    if (y > lowestY) {
+        lowestY = y;
+        lockResets = 0;
+        lockTicks = 0;
+    } else if (lockResets < MAX_LOCK_RESETS) {
+        lockResets++;
+        lockTicks = 0;
+    }
+}
+
+// End the game: the stack reached the top
+void topOut() {
+    isGameOver = true;
+    telemetryEndGame(true);
+    replayEndGame(true);
+    emitEvent(EngineEvent::GAME_OVER);  // Also stops the music
+}
+
+// Versus: push the stack up by n rows of garbage with one shared hole.
+// Returns true if blocks were pushed out of the top of the board.
+bool addGarbageRows(int n) {
+    n = min(n, H - 1);
+    bool overflow = false;
+    for (int i = 0; i < n; i++) {
+        for (int j = 1; j < W - 1; j++) {
+            if (board[i][j] != ' ') overflow = true;
+        }
+    }
+
+    for (int i = 0; i < H - 1 - n; i++) {
+        for (int j = 1; j < W - 1; j++) {
+            board[i][j] = board[i + n][j];
+        }
+    }
+    int hole = 1 + nextRandom(garbageRngState) % (W - 2);
+    for (int i = H - 1 - n; i < H - 1; i++) {
+        for (int j = 1; j < W - 1; j++) {
+            board[i][j] = (j == hole) ? ' ' : 'X';
+        }
+    }
+    spectatorMarkRows(0, H - 2);
+    boardHash = zobristRows(board, 0, H - 2);
+    return overflow;
+}
+
+// Promote the next piece to the spawn position and check for top-out
+void spawnNextPiece() {
+    delete currentPiece;
+    currentPiece = nextPiece;
+    nextPiece = createRandomPiece();
+    x = 4;  // Spawn at center top
+    y = 0;
+    gravityAcc = 0;
+    lockTicks = 0;
+    lockResets = 0;
+    lowestY = 0;
+    if (eventThinning != EventThinning::MUTED) {
+        flightRecord(FlightEvent::SPAWN, currentPiece->type, nextPiece->type, gameTick);
+    }
+
+    // Check if new piece can spawn (game over condition)
+    if (!canMove(0, 0)) {
+        topOut();
+    }
+}
+
+// Commit the current piece, clear lines and spawn the next one
+void lockPiece() {
+    emitEvent(EngineEvent::LOCK, pieceLetter(currentPiece));
+    block2Board();  // Commit piece to board
+    int cleared = removeLine();  // Check for completed lines
+    applyLineClearScore(cleared);  // Update score and level
+
+    // Versus: a clear cancels incoming garbage first and sends the rest to
+    // the opponent; a lock without a clear lets the waiting garbage in
+    int attack = GARBAGE_TABLE[min(cleared, 4)];
+    int cancelled = min(attack, garbageIn);
+    garbageIn -= cancelled;
+    garbageOut += attack - cancelled;
+    if (cleared == 0 && garbageIn > 0) {
+        bool overflow = addGarbageRows(garbageIn);
+        garbageIn = 0;
+        if (overflow) {
+            topOut();
+            return;
+        }
+    }
+
+    spawnNextPiece();
+}
+
+// Advance gravity by one fixed tick. Gravity may cover several rows per
+// tick, so the drop is resolved in one step against the landing row
+// (20G lands instantly); a grounded piece locks after LOCK_DELAY_TICKS.
+void gravityTick() {
+    gravityAcc += gravity;
+    int rows = gravityAcc / GRAVITY_UNIT;
+    gravityAcc %= GRAVITY_UNIT;
+
+    if (rows > 0) {
+        int newY = min(y + rows, getGhostY());
+        if (newY != y) {
+            y = newY;
+            resetLockDelay();
+        }
+    }
+
+    if (canMove(0, 1)) {
+        lockTicks = 0;
+    } else if (++lockTicks >= LOCK_DELAY_TICKS) {
+        lockPiece();
+    }
+}
+
+// ==================== SIMULATION TICK ====================
+// Advance the game by one fixed tick with the given input. All gameplay goes
+// through here, so the same seed and inputs always play out the same game.
+void simTick(uint8_t input) {
+    if (isGameOver) return;
+    replayRecordTick(input);
+    gameTick++;
+    if (eventThinning != EventThinning::MUTED) flightRecord(FlightEvent::TICK, input, gameTick);
+
+    if (input & IN_ROTATE) {
+        telemetryCountKey();
+        if (currentPiece->rotate(x, y)) resetLockDelay();
+    }
+    if (input & IN_DROP) {
+        telemetryCountKey();
+        y = getGhostY();
+        lockPiece();  // Hard drop skips the lock delay
+        return;
+    }
+
+    // Held keys move once, then repeat every INPUT_REPEAT_TICKS
+    if (inputTicks < INPUT_REPEAT_TICKS) inputTicks++;
+    if (inputTicks >= INPUT_REPEAT_TICKS && (input & IN_HELD_MASK)) {
+        if (input & IN_LEFT) {
+            if (canMove(-1, 0)) { x--; resetLockDelay(); }
+        }
+        else if (input & IN_RIGHT) {
+            if (canMove(1, 0)) { x++; resetLockDelay(); }
+        }
+        else if (input & IN_DOWN) {
+            if (canMove(0, 1)) { y++; resetLockDelay(); }
+        }
+        inputTicks = 0;
+        telemetryCountKey();
+    }
+
+    gravityTick();
+}
+
+// Reset game to initial state
+void resetGame(uint32_t seed = makeSeed()) {
+    telemetryEndGame(false);  // Abandoning a running game still records it
+    replayEndGame(false);
+    seedRandom(seed);
+    initBoard();
+    delete currentPiece;
+    delete nextPiece;
+    currentPiece = createRandomPiece();
+    nextPiece = createRandomPiece();
+    x = 4;
+    y = 0;
+    gravity = GRAVITY_TABLE[0];
+    gravityAcc = 0;
+    lockTicks = 0;
+    lockResets = 0;
+    lowestY = 0;
+    inputTicks = INPUT_REPEAT_TICKS;  // First press moves immediately
+    gameTick = 0;
+    garbageIn = 0;
+    garbageOut = 0;
+    isGameOver = false;
+    gScore = 0;
+    gLines = 0;
+    gLevel = 0;
+    currentLevel = 0;
+    spectatorRequestKeyframe();
+    if (!simSilent) effectsClear();
+}
+
+// ==================== REPLAY PLAYBACK & VERIFICATION ====================
+// Position in a replay's input runs
+struct ReplayCursor {
+    ReplayView replay;
+    uint32_t run = 0, runOffset = 0;
+};
+
+// Next recorded input; false once the recording has ended
+bool replayNextInput(ReplayCursor& c, uint8_t& input) {
+    uint32_t runCount = c.replay.header->runCount;
+    while (c.run < runCount && c.runOffset >= (c.replay.runs[c.run] >> 8)) {
+        c.run++;
+        c.runOffset = 0;
+    }
+    if (c.run >= runCount) return false;
+    input = (uint8_t)(c.replay.runs[c.run] & 0xFF);
+    c.runOffset++;
+    return true;
+}
+
+// Make the running game the replay at the given tick: load the keyframe at or
+// before it and silently simulate the remaining (< keyframeTicks) ticks
+void replaySeek(ReplayCursor& c, uint32_t keyframeTicks, uint32_t tick) {
+    const ReplayHeader* h = c.replay.header;
+    tick = min(tick, h->ticks);
+    const ReplayKeyframe& k = c.replay.keyframes[min(tick / keyframeTicks, h->keyframeCount - 1)];
+    loadSim(k.state);
+    c.run = k.run;
+    c.runOffset = k.runOffset;
+
+    bool silent = simSilent;
+    simSilent = true;
+    uint8_t input;
+    while ((uint32_t)gameTick < tick && !isGameOver && replayNextInput(c, input)) {
+        simTick(input);
+    }
+    simSilent = silent;
+}
+
+static bool sameSim(const SimState& a) {
+    SimState now;
+    memset(&now, 0, sizeof(now));
+    saveSim(now);
+    return memcmp(&a, &now, sizeof(now)) == 0;
+}
+
+// Replay a game from its seed and check every keyframe on the way and the
+// final result against the index. On a mismatch, why says what differed.
+bool verifyReplay(const ReplayArchive& a, uint64_t i, string& why) {
+    ReplayView v;
+    if (!getReplay(a, i, v)) {
+        why = "damaged replay data";
+        return false;
+    }
+    const ArchiveEntry& e = a.entries[i];
+    const ReplayHeader* h = v.header;
+    uint32_t keyframeTicks = a.header->keyframeTicks;
+    if (h->seed != e.seed || h->ticks != e.ticks || h->keyframeCount != (h->ticks - 1) / keyframeTicks + 1) {
+        why = "header does not match the index";
+        return false;
+    }
+
+    bool silent = simSilent;
+    simSilent = true;
+    resetGame(h->seed);
+    ReplayCursor c;
+    c.replay = v;
+    uint8_t input;
+    bool ok = true;
+    char buf[96];
+    while (ok && !isGameOver && replayNextInput(c, input)) {
+        uint32_t k = gameTick / keyframeTicks;
+        if (gameTick % keyframeTicks == 0 && k < h->keyframeCount) {
+            const ReplayKeyframe& kf = v.keyframes[k];
+            if (kf.tick != (uint32_t)gameTick || !sameSim(kf.state)) {
+                snprintf(buf, sizeof(buf), "keyframe at tick %d differs", gameTick);
+                why = buf;
+                ok = false;
+            }
+        }
+        simTick(input);
+    }
+    if (ok && ((uint32_t)gameTick != h->ticks || replayNextInput(c, input) ||
+               isGameOver != ((e.flags & REPLAY_TOPPED_OUT) != 0))) {
+        snprintf(buf, sizeof(buf), "game ended at tick %d, recorded %u", gameTick, h->ticks);
+        why = buf;
+        ok = false;
+    }
+    if (ok && (gScore != e.score || gLines != e.lines || gLevel != e.level)) {
+        snprintf(buf, sizeof(buf), "result %d/%d/%d, recorded %d/%d/%d",
+                 gScore, gLines, gLevel, e.score, e.lines, e.level);
+        why = buf;
+        ok = false;
+    }
+    simSilent = silent;
+    return ok;
+}
+
+// Headless batch check of a whole archive (--verify)
+int runArchiveVerify(const char* path) {
+    ReplayArchive a;
+    if (!openArchive(path, a)) {
+        fprintf(stderr, "%s is not a replay archive\n", path);
+        return -1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t failed = 0, ticks = 0;
+    for (uint64_t i = 0; i < a.header->count; i++) {
+        string why;
+        if (!verifyReplay(a, i, why)) {
+            fprintf(stderr, "replay %llu (seed %u): %s\n", (unsigned long long)i, a.entries[i].seed, why.c_str());
+            failed++;
+        }
+        ticks += a.entries[i].ticks;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%llu replays, %llu failed, %llu ticks in %.2f s\n", (unsigned long long)a.header->count,
+           (unsigned long long)failed, (unsigned long long)ticks, seconds);
+    closeArchive(a);
+    return failed ? 1 : 0;
+}
+
+// List an archive in one of its index orders; with a value, only the games
+// whose seed or player equals it (binary search in the sorted order)
+int runArchiveList(const char* path, const char* orderName, const char* value) {
+    ReplayArchive a;
+    if (!openArchive(path, a)) {
+        fprintf(stderr, "%s is not a replay archive\n", path);
+        return -1;
+    }
+    int o = BY_DATE;
+    if (orderName) {
+        o = 0;
+        while (o < ARCHIVE_ORDERS && strcmp(ARCHIVE_ORDER_NAMES[o], orderName) != 0) o++;
+        if (o == ARCHIVE_ORDERS || (value && o != BY_SEED && o != BY_PLAYER)) {
+            fprintf(stderr, "Order must be seed, player, score or date (a value only works with seed or player)\n");
+            closeArchive(a);
+            return -1;
+        }
+    }
+
+    const uint32_t* first = a.order[o];
+    const uint32_t* last = first + a.header->count;
+    if (value) {
+        ArchiveEntry key = {};
+        key.seed = (uint32_t)strtoul(value, nullptr, 10);
+        strncpy(key.player, value, sizeof(key.player) - 1);
+        auto less = [&](const ArchiveEntry& l, const ArchiveEntry& r) {
+            return o == BY_SEED ? l.seed < r.seed : strncmp(l.player, r.player, sizeof(l.player)) < 0;
+        };
+        first = lower_bound(first, last, key, [&](uint32_t i, const ArchiveEntry& k) { return less(a.entries[i], k); });
+        last = upper_bound(first, last, key, [&](const ArchiveEntry& k, uint32_t i) { return less(k, a.entries[i]); });
+    }
+
+    printf("%8s  %-16s  %-24s  %10s  %8s  %6s  %5s  %6s\n", "game", "date", "player", "seed", "score", "lines", "level", "time");
+    for (const uint32_t* it = first; it != last; it++) {
+        const ArchiveEntry& e = a.entries[*it];
+        char date[32];
+        time_t t = (time_t)e.date;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&t));
+        uint32_t s = e.ticks / 60;
+        printf("%8u  %-16s  %-24.24s  %10u  %8d  %6d  %5d  %3u:%02u%s\n", *it, date, e.player, e.seed,
+               e.score, e.lines, e.level, s / 60, s % 60, (e.flags & REPLAY_TOPPED_OUT) ? "" : "  (abandoned)");
+    }
+    closeArchive(a);
+    return 0;
+}
+
+// GUI playback of one archived game (--replay)
+struct ReplayPlayback {
+    bool active = false;
+    ReplayArchive archive;
+    uint64_t number = 0;
+    ReplayCursor cursor;
+};
+ReplayPlayback playback;
+
+bool playbackOpen(const char* path, uint64_t number) {
+    if (!openArchive(path, playback.archive)) {
+        fprintf(stderr, "%s is not a replay archive\n", path);
+        return false;
+    }
+    if (!getReplay(playback.archive, number, playback.cursor.replay)) {
+        fprintf(stderr, "%s has no replay %llu\n", path, (unsigned long long)number);
+        closeArchive(playback.archive);
+        return false;
+    }
+    playback.number = number;
+    playback.active = true;
+    return true;
+}
+
+void playbackSeek(int64_t tick) {
+    replaySeek(playback.cursor, playback.archive.header->keyframeTicks, (uint32_t)max<int64_t>(tick, 0));
+}
+
+// Feed recorded inputs to the fixed ticks instead of the keyboard. Past
+// `deadline` the rest of the frame's ticks are dropped (fast forward).
+void playbackUpdate(float& tickTimer, std::chrono::steady_clock::time_point deadline) {
+    uint8_t input;
+    while (tickTimer >= TICK_SECONDS && !isGameOver) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            tickTimer = 0.f;
+            break;
+        }
+        if (!replayNextInput(playback.cursor, input)) {
+            tickTimer = 0.f;  // Abandoned game: stay on its last tick
+            break;
+        }
+        simTick(input);
+        tickTimer -= TICK_SECONDS;
+    }
+}
+
+void playbackClose() {
+    closeArchive(playback.archive);
+    playback = ReplayPlayback{};
+}
+
+// ==================== REPLAY ANALYZER (--analyze) ====================
+// Re-simulates every game in a directory of archives on all cores and prints
+// aggregate statistics. Each worker starts with an equal slice of the games;
+// a worker that runs out steals the back half of the largest remaining slice,
+// so a few long games don't leave the other cores idle.
+
+// A slice of the task list, packed as begin << 32 | end so it can be claimed
+// or split with one compare-and-swap
+struct alignas(64) TaskRange {
+    std::atomic<uint64_t> range{0};
+};
+
+static uint64_t packRange(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+
+// Owner: take the next task from the front of its own slice
+static bool takeTask(TaskRange& r, uint32_t& task) {
+    uint64_t v = r.range.load();
+    while ((uint32_t)(v >> 32) < (uint32_t)v) {
+        if (r.range.compare_exchange_weak(v, v + (1ull << 32))) {
+            task = (uint32_t)(v >> 32);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Thief: move the back half of the fullest other slice into its own (empty) slice
+static bool stealTasks(vector<TaskRange>& ranges, int self) {
+    while (true) {
+        int victim = -1;
+        uint32_t most = 0;
+        for (int i = 0; i < (int)ranges.size(); i++) {
+            uint64_t v = ranges[i].range.load();
+            uint32_t left = (uint32_t)v - min((uint32_t)v, (uint32_t)(v >> 32));
+            if (i != self && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim < 0) return false;
+
+        uint64_t v = ranges[victim].range.load();
+        uint32_t begin = (uint32_t)(v >> 32), end = (uint32_t)v;
+        if (begin >= end) continue;
+        uint32_t mid = begin + (end - begin) / 2;  // A single task is taken whole
+        if (ranges[victim].range.compare_exchange_strong(v, packRange(begin, mid))) {
+            ranges[self].range.store(packRange(mid, end));
+            return true;
+        }
+    }
+}
+
+struct AnalyzeTask {
+    uint32_t archive;
+    uint32_t game;
+};
+
+// Totals of one worker; merged at the end
+struct AnalyzeStats {
+    uint64_t games = 0, damaged = 0, mismatched = 0;
+    uint64_t toppedOut = 0, abandoned = 0;
+    uint64_t ticks = 0, pieces = 0;
+    uint64_t clears[5] = {};                // Index = lines cleared at once
+    uint64_t topOutPiece[7] = {};           // Piece that could not spawn
+    uint64_t topOutColumn[W] = {};          // Columns blocking the spawn
+    uint64_t occupancy[H][W] = {};          // Filled cells, sampled after every lock
+    uint64_t samples = 0;
+    vector<int> scores;
+    vector<float> piecesPerSecond;
+};
+
+// Play one game from its seed and add it to the totals
+static void analyzeGame(const ReplayArchive& a, uint32_t i, AnalyzeStats& s) {
+    ReplayView v;
+    if (!getReplay(a, i, v)) {
+        s.damaged++;
+        return;
+    }
+    resetGame(v.header->seed);
+    gStats = GameStats{};
+    ReplayCursor c;
+    c.replay = v;
+    uint8_t input;
+    int locked = 0;
+    while (!isGameOver && replayNextInput(c, input)) {
+        simTick(input);
+        if (gStats.pieces == locked) continue;
+        locked = gStats.pieces;
+        for (int r = 0; r < H; r++) {
+            for (int col = 0; col < W; col++) {
+                s.occupancy[r][col] += board[r][col] != ' ';
+            }
+        }
+        s.samples++;
+    }
+
+    const ArchiveEntry& e = a.entries[i];
+    if ((uint32_t)gameTick != e.ticks || gScore != e.score || gLines != e.lines) s.mismatched++;
+    s.games++;
+    s.ticks += gameTick;
+    s.pieces += gStats.pieces;
+    for (int k = 1; k <= 4; k++) s.clears[k] += gStats.clearsBySize[k];
+    s.scores.push_back(gScore);
+    if (gameTick > 0) s.piecesPerSecond.push_back(gStats.pieces * 60.f / gameTick);
+
+    if (isGameOver) {
+        s.toppedOut++;
+        s.topOutPiece[currentPiece->type]++;
+        for (int r = 0; r < 4; r++) {
+            for (int col = 0; col < 4; col++) {
+                if (currentPiece->shape[r][col] != ' ' && board[y + r][x + col] != ' ') s.topOutColumn[x + col]++;
+            }
+        }
+    } else {
+        s.abandoned++;
+    }
+}
+
+static void analyzeWorker(const vector<ReplayArchive>& archives, const vector<AnalyzeTask>& tasks,
+                          vector<TaskRange>& ranges, int self, AnalyzeStats& s) {
+    simSilent = true;
+    uint32_t t;
+    while (takeTask(ranges[self], t) || (stealTasks(ranges, self) && takeTask(ranges[self], t))) {
+        analyzeGame(archives[tasks[t].archive], tasks[t].game, s);
+    }
+    delete currentPiece;
+    delete nextPiece;
+    currentPiece = nextPiece = nullptr;
+}
+
+template <typename T>
+static T percentile(const vector<T>& sorted, int p) {
+    return sorted[min(sorted.size() - 1, sorted.size() * p / 100)];
+}
+
+static void printBar(const char* label, uint64_t n, uint64_t total) {
+    int len = total ? (int)(n * 40 / total) : 0;
+    printf("  %-14s %9llu  %s\n", label, (unsigned long long)n, string(len, '#').c_str());
+}
+
+static void printAnalysis(AnalyzeStats& s) {
+    printf("%llu games (%llu topped out, %llu abandoned), %.1f hours of play, %llu pieces\n",
+           (unsigned long long)s.games, (unsigned long long)s.toppedOut, (unsigned long long)s.abandoned,
+           s.ticks / 60.0 / 3600.0, (unsigned long long)s.pieces);
+    if (s.damaged || s.mismatched) {
+        printf("%llu damaged, %llu did not replay to the recorded result (see --verify)\n",
+               (unsigned long long)s.damaged, (unsigned long long)s.mismatched);
+    }
+    if (s.games == 0) return;
+
+    sort(s.scores.begin(), s.scores.end());
+    printf("\nScore: min %d  p25 %d  median %d  p75 %d  p90 %d  p99 %d  max %d\n",
+           s.scores.front(), percentile(s.scores, 25), percentile(s.scores, 50), percentile(s.scores, 75),
+           percentile(s.scores, 90), percentile(s.scores, 99), s.scores.back());
+    const int bounds[] = { 1, 1000, 5000, 20000, 100000 };
+    const char* const labels[] = { "0", "1-999", "1000-4999", "5000-19999", "20000-99999", "100000+" };
+    uint64_t buckets[6] = {};
+    for (int score : s.scores) {
+        int b = 0;
+        while (b < 5 && score >= bounds[b]) b++;
+        buckets[b]++;
+    }
+    for (int b = 0; b < 6; b++) printBar(labels[b], buckets[b], s.games);
+
+    uint64_t clearTotal = s.clears[1] + s.clears[2] + s.clears[3] + s.clears[4];
+    printf("\nLine clears (%llu):\n", (unsigned long long)clearTotal);
+    const char* const clearNames[] = { "", "single", "double", "triple", "tetris" };
+    for (int k = 1; k <= 4; k++) printBar(clearNames[k], s.clears[k], clearTotal);
+
+    if (!s.piecesPerSecond.empty()) {
+        sort(s.piecesPerSecond.begin(), s.piecesPerSecond.end());
+        printf("\nPieces per second: p10 %.2f  p25 %.2f  median %.2f  p75 %.2f  p90 %.2f  p99 %.2f\n",
+               percentile(s.piecesPerSecond, 10), percentile(s.piecesPerSecond, 25),
+               percentile(s.piecesPerSecond, 50), percentile(s.piecesPerSecond, 75),
+               percentile(s.piecesPerSecond, 90), percentile(s.piecesPerSecond, 99));
+    }
+
+    if (s.toppedOut) {
+        printf("\nTop-outs by the piece that could not spawn:\n");
+        for (int t = 0; t < 7; t++) {
+            const char label[2] = { "IOTSZJL"[t], 0 };  // createPieceFromType order
+            printBar(label, s.topOutPiece[t], s.toppedOut);
+        }
+        printf("Columns blocking the spawn:\n  ");
+        for (int col = 1; col < W - 1; col++) printf("%4d", col);
+        printf("\n  ");
+        for (int col = 1; col < W - 1; col++) printf("%4llu", (unsigned long long)s.topOutColumn[col]);
+        printf("\n");
+    }
+
+    // Shades from empty to always filled
+    if (s.samples) {
+        const char shades[] = " .:-=+*#%@";
+        printf("\nOccupancy after each lock (%llu samples, ' ' = never, '@' = always):\n",
+               (unsigned long long)s.samples);
+        for (int r = 0; r < H - 1; r++) {  // The last row is the floor
+            printf("  |");
+            for (int col = 1; col < W - 1; col++) {
+                putchar(shades[min<uint64_t>(9, s.occupancy[r][col] * 10 / s.samples)]);
+            }
+            printf("|\n");
+        }
+        printf("  column fill:");
+        for (int col = 1; col < W - 1; col++) {
+            uint64_t filled = 0;
+            for (int r = 0; r < H - 1; r++) filled += s.occupancy[r][col];
+            printf(" %.0f%%", 100.0 * filled / (s.samples * (H - 1)));
+        }
+        printf("\n");
+    }
+}
+
+// Analyze one archive or every *.tra file in a directory
+int runReplayAnalyzer(const char* path, int threads) {
+    vector<string> files;
+    std::error_code ec;
+    if (std::filesystem::is_directory(path, ec)) {
+        for (const auto& f : std::filesystem::directory_iterator(path, ec)) {
+            if (f.is_regular_file() && f.path().extension() == ".tra") files.push_back(f.path().string());
+        }
+        sort(files.begin(), files.end());
+    } else {
+        files.push_back(path);
+    }
+
+    vector<ReplayArchive> archives;
+    vector<AnalyzeTask> tasks;
+    for (const string& f : files) {
+        ReplayArchive a;
+        if (!openArchive(f.c_str(), a)) {
+            fprintf(stderr, "%s is not a replay archive, skipped\n", f.c_str());
+            continue;
+        }
+        for (uint32_t i = 0; i < a.header->count; i++) tasks.push_back({ (uint32_t)archives.size(), i });
+        archives.push_back(a);
+    }
+    if (archives.empty()) {
+        fprintf(stderr, "No replay archives in %s\n", path);
+        return -1;
+    }
+
+    if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+    threads = max(1, min<int>(threads, (int)max<size_t>(tasks.size(), 1)));
+    vector<TaskRange> ranges(threads);
+    for (int w = 0; w < threads; w++) {
+        ranges[w].range.store(packRange((uint32_t)(tasks.size() * w / threads), (uint32_t)(tasks.size() * (w + 1) / threads)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    vector<AnalyzeStats> stats(threads);
+    vector<std::thread> workers;
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back(analyzeWorker, std::cref(archives), std::cref(tasks), std::ref(ranges), w, std::ref(stats[w]));
+    }
+    for (std::thread& t : workers) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    AnalyzeStats& total = stats[0];
+    for (int w = 1; w < threads; w++) {
+        AnalyzeStats& s = stats[w];
+        total.games += s.games; total.damaged += s.damaged; total.mismatched += s.mismatched;
+        total.toppedOut += s.toppedOut; total.abandoned += s.abandoned;
+        total.ticks += s.ticks; total.pieces += s.pieces; total.samples += s.samples;
+        for (int k = 0; k < 5; k++) total.clears[k] += s.clears[k];
+        for (int t = 0; t < 7; t++) total.topOutPiece[t] += s.topOutPiece[t];
+        for (int col = 0; col < W; col++) total.topOutColumn[col] += s.topOutColumn[col];
+        for (int r = 0; r < H; r++) {
+            for (int col = 0; col < W; col++) total.occupancy[r][col] += s.occupancy[r][col];
+        }
+        total.scores.insert(total.scores.end(), s.scores.begin(), s.scores.end());
+        total.piecesPerSecond.insert(total.piecesPerSecond.end(), s.piecesPerSecond.begin(), s.piecesPerSecond.end());
+    }
+
+    printf("%zu archives, %d threads, %.2f s (%.0f ticks/s)\n\n", archives.size(), threads, seconds,
+           seconds > 0 ? total.ticks / seconds : 0.0);
+    printAnalysis(total);
+    for (ReplayArchive& a : archives) closeArchive(a);
+    return 0;
+}
+
+// ==================== BOARD EVALUATION (BOTS) ====================
+// Scores candidate boards for placement search. Boards are bit masks, one
+// uint16_t per playfield row (bit c = column c + 1 of board[][]; walls and
+// floor implied), and are evaluated EVAL_LANES at a time from a batch laid out
+// row-major across boards, so one vector register holds the same row of 16
+// (AVX2) or 8 (SSE) boards. The scalar kernel defines the result; the vector
+// kernels must match it exactly (--bench-eval checks this).
+//
+// Every feature is a sum over rows of a popcount, with seen = OR of the rows
+// from the top down to the current one (the columns that have a block at or above it):
+//   height          popcount(seen)                      = sum of column heights
+//   holes           popcount(seen above & ~row)         empty cells under a block
+//   bumpiness       popcount((seen ^ seen >> 1) & pairs) = sum |h(c) - h(c+1)|
+//   row transitions filled/empty changes along the row, walls count as filled
+//   col transitions popcount(row ^ row above), floor counts as filled
+//   wells           empty, uncovered cells with both neighbours filled
+const int PLAY_COLS = W - 2;                 // Columns between the walls
+const int PLAY_ROWS = H - 1;                 // Rows above the floor
+const int EVAL_LANES = 16;                   // Boards per batch
+typedef uint16_t RowMask;
+const RowMask FULL_ROW = (1 << PLAY_COLS) - 1;
+const RowMask COLUMN_PAIRS = FULL_ROW >> 1;  // Bit c: columns c and c+1 both exist
+const RowMask WALLED_PAIRS = (1 << (PLAY_COLS + 1)) - 1; // Adjacent pairs with walls added
+
+// Candidate boards: rows[r][lane] is row r (top = 0) of board `lane`
+struct BoardBatch {
+    alignas(32) RowMask rows[PLAY_ROWS][EVAL_LANES];
+    int count = 0;
+};
+
+enum EvalFeature { EVAL_HEIGHT, EVAL_HOLES, EVAL_BUMPINESS, EVAL_ROW_TRANSITIONS,
+                   EVAL_COL_TRANSITIONS, EVAL_WELLS, EVAL_FEATURES };
+
+// Weight per feature; the score is their sum, higher is better
+struct EvalWeights {
+    int32_t w[EVAL_FEATURES];
+};
+const EvalWeights DEFAULT_EVAL_WEIGHTS = { { -51, -79, -18, -32, -93, -34 } };
+
+// Features of a whole batch: f[feature][lane]
+struct BatchFeatures {
+    alignas(32) uint16_t f[EVAL_FEATURES][EVAL_LANES];
+};
+
+// Board of board[][] as row masks
+void boardRows(const char b[H][W], RowMask rows[PLAY_ROWS]) {
+    for (int r = 0; r < PLAY_ROWS; r++) {
+        RowMask m = 0;
+        for (int c = 0; c < PLAY_COLS; c++) {
+            if (b[r][c + 1] != ' ') m |= 1 << c;
+        }
+        rows[r] = m;
+    }
+}
+
+// Copy the settled cells of board[][] into lane `lane` of a batch
+void boardToBatch(const char b[H][W], BoardBatch& batch, int lane) {
+    RowMask rows[PLAY_ROWS];
+    boardRows(b, rows);
+    for (int r = 0; r < PLAY_ROWS; r++) batch.rows[r][lane] = rows[r];
+}
+
+static inline int popcount16(unsigned v) { return __builtin_popcount(v); }
+
+static void evalFeaturesScalar(const BoardBatch& b, BatchFeatures& out) {
+    for (int lane = 0; lane < EVAL_LANES; lane++) {
+        unsigned seen = 0, above = 0;
+        int f[EVAL_FEATURES] = {};
+        for (int r = 0; r < PLAY_ROWS; r++) {
+            unsigned row = b.rows[r][lane];
+            f[EVAL_HOLES] += popcount16(seen & ~row);
+            seen |= row;
+            f[EVAL_HEIGHT] += popcount16(seen);
+            f[EVAL_BUMPINESS] += popcount16((seen ^ (seen >> 1)) & COLUMN_PAIRS);
+            unsigned walled = row << 1 | 1 | 1 << (PLAY_COLS + 1);
+            f[EVAL_ROW_TRANSITIONS] += popcount16((walled ^ (walled >> 1)) & WALLED_PAIRS);
+            f[EVAL_COL_TRANSITIONS] += popcount16(row ^ above);
+            unsigned wells = (walled << 1) & (walled >> 1) & ~walled;
+            f[EVAL_WELLS] += popcount16((wells >> 1) & ~seen & FULL_ROW);
+            above = row;
+        }
+        f[EVAL_COL_TRANSITIONS] += popcount16(above ^ FULL_ROW);
+        for (int k = 0; k < EVAL_FEATURES; k++) out.f[k][lane] = (uint16_t)f[k];
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EVAL_HAVE_X86 1
+
+// Per-16-bit-lane popcount: nibble lookup with pshufb, then add the two bytes
+__attribute__((target("avx2")))
+static inline __m256i popcount16x16(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+                                    _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+    return _mm256_add_epi16(_mm256_and_si256(bytes, _mm256_set1_epi16(0xFF)), _mm256_srli_epi16(bytes, 8));
+}
+
+__attribute__((target("avx2")))
+static void evalFeaturesAvx2(const BoardBatch& b, BatchFeatures& out) {
+    const __m256i full = _mm256_set1_epi16(FULL_ROW);
+    const __m256i pairs = _mm256_set1_epi16(COLUMN_PAIRS);
+    const __m256i walledPairs = _mm256_set1_epi16(WALLED_PAIRS);
+    const __m256i walls = _mm256_set1_epi16(1 | 1 << (PLAY_COLS + 1));
+    __m256i seen = _mm256_setzero_si256(), above = _mm256_setzero_si256();
+    __m256i f[EVAL_FEATURES];
+    for (int k = 0; k < EVAL_FEATURES; k++) f[k] = _mm256_setzero_si256();
+
+    for (int r = 0; r < PLAY_ROWS; r++) {
+        __m256i row = _mm256_load_si256((const __m256i*)b.rows[r]);
+        f[EVAL_HOLES] = _mm256_add_epi16(f[EVAL_HOLES], popcount16x16(_mm256_andnot_si256(row, seen)));
+        seen = _mm256_or_si256(seen, row);
+        f[EVAL_HEIGHT] = _mm256_add_epi16(f[EVAL_HEIGHT], popcount16x16(seen));
+        __m256i steps = _mm256_and_si256(_mm256_xor_si256(seen, _mm256_srli_epi16(seen, 1)), pairs);
+        f[EVAL_BUMPINESS] = _mm256_add_epi16(f[EVAL_BUMPINESS], popcount16x16(steps));
+        __m256i walled = _mm256_or_si256(_mm256_slli_epi16(row, 1), walls);
+        __m256i changes = _mm256_and_si256(_mm256_xor_si256(walled, _mm256_srli_epi16(walled, 1)), walledPairs);
+        f[EVAL_ROW_TRANSITIONS] = _mm256_add_epi16(f[EVAL_ROW_TRANSITIONS], popcount16x16(changes));
+        f[EVAL_COL_TRANSITIONS] = _mm256_add_epi16(f[EVAL_COL_TRANSITIONS], popcount16x16(_mm256_xor_si256(row, above)));
+        __m256i wells = _mm256_andnot_si256(walled, _mm256_and_si256(_mm256_slli_epi16(walled, 1), _mm256_srli_epi16(walled, 1)));
+        wells = _mm256_andnot_si256(seen, _mm256_and_si256(_mm256_srli_epi16(wells, 1), full));
+        f[EVAL_WELLS] = _mm256_add_epi16(f[EVAL_WELLS], popcount16x16(wells));
+        above = row;
+    }
+    f[EVAL_COL_TRANSITIONS] = _mm256_add_epi16(f[EVAL_COL_TRANSITIONS], popcount16x16(_mm256_xor_si256(above, full)));
+    for (int k = 0; k < EVAL_FEATURES; k++) _mm256_store_si256((__m256i*)out.f[k], f[k]);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i popcount16x8(__m128i v) {
+    const __m128i lut = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i bytes = _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(v, low)),
+                                 _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low)));
+    return _mm_add_epi16(_mm_and_si128(bytes, _mm_set1_epi16(0xFF)), _mm_srli_epi16(bytes, 8));
+}
+
+// Same as the AVX2 kernel, two halves of 8 boards
+__attribute__((target("ssse3")))
+static void evalFeaturesSsse3(const BoardBatch& b, BatchFeatures& out) {
+    const __m128i full = _mm_set1_epi16(FULL_ROW);
+    const __m128i pairs = _mm_set1_epi16(COLUMN_PAIRS);
+    const __m128i walledPairs = _mm_set1_epi16(WALLED_PAIRS);
+    const __m128i walls = _mm_set1_epi16(1 | 1 << (PLAY_COLS + 1));
+    for (int half = 0; half < EVAL_LANES; half += 8) {
+        __m128i seen = _mm_setzero_si128(), above = _mm_setzero_si128();
+        __m128i f[EVAL_FEATURES];
+        for (int k = 0; k < EVAL_FEATURES; k++) f[k] = _mm_setzero_si128();
+
+        for (int r = 0; r < PLAY_ROWS; r++) {
+            __m128i row = _mm_load_si128((const __m128i*)(b.rows[r] + half));
+            f[EVAL_HOLES] = _mm_add_epi16(f[EVAL_HOLES], popcount16x8(_mm_andnot_si128(row, seen)));
+            seen = _mm_or_si128(seen, row);
+            f[EVAL_HEIGHT] = _mm_add_epi16(f[EVAL_HEIGHT], popcount16x8(seen));
+            __m128i steps = _mm_and_si128(_mm_xor_si128(seen, _mm_srli_epi16(seen, 1)), pairs);
+            f[EVAL_BUMPINESS] = _mm_add_epi16(f[EVAL_BUMPINESS], popcount16x8(steps));
+            __m128i walled = _mm_or_si128(_mm_slli_epi16(row, 1), walls);
+            __m128i changes = _mm_and_si128(_mm_xor_si128(walled, _mm_srli_epi16(walled, 1)), walledPairs);
+            f[EVAL_ROW_TRANSITIONS] = _mm_add_epi16(f[EVAL_ROW_TRANSITIONS], popcount16x8(changes));
+            f[EVAL_COL_TRANSITIONS] = _mm_add_epi16(f[EVAL_COL_TRANSITIONS], popcount16x8(_mm_xor_si128(row, above)));
+            __m128i wells = _mm_andnot_si128(walled, _mm_and_si128(_mm_slli_epi16(walled, 1), _mm_srli_epi16(walled, 1)));
+            wells = _mm_andnot_si128(seen, _mm_and_si128(_mm_srli_epi16(wells, 1), full));
+            f[EVAL_WELLS] = _mm_add_epi16(f[EVAL_WELLS], popcount16x8(wells));
+            above = row;
+        }
+        f[EVAL_COL_TRANSITIONS] = _mm_add_epi16(f[EVAL_COL_TRANSITIONS], popcount16x8(_mm_xor_si128(above, full)));
+        for (int k = 0; k < EVAL_FEATURES; k++) _mm_store_si128((__m128i*)(out.f[k] + half), f[k]);
+    }
+}
+#endif
+
+typedef void (*EvalKernel)(const BoardBatch&, BatchFeatures&);
+
+struct EvalKernelInfo {
+    const char* name;
+    EvalKernel kernel;
+};
+
+// Kernels this CPU can run, best first; the scalar kernel is always last
+vector<EvalKernelInfo> evalKernels() {
+    vector<EvalKernelInfo> k;
+#ifdef EVAL_HAVE_X86
+    if (__builtin_cpu_supports("avx2")) k.push_back({ "avx2", evalFeaturesAvx2 });
+    if (__builtin_cpu_supports("ssse3")) k.push_back({ "ssse3", evalFeaturesSsse3 });
+#endif
+    k.push_back({ "scalar", evalFeaturesScalar });
+    return k;
+}
+
+EvalKernel bestEvalKernel = evalKernels().front().kernel;
+
+// Score every board of a batch: scores[lane] = sum of weight * feature
+void evaluateBatch(const BoardBatch& b, const EvalWeights& w, int32_t scores[EVAL_LANES],
+                   EvalKernel kernel = bestEvalKernel) {
+    BatchFeatures f;
+    kernel(b, f);
+    for (int lane = 0; lane < EVAL_LANES; lane++) {
+        int32_t s = 0;
+        for (int k = 0; k < EVAL_FEATURES; k++) s += w.w[k] * f.f[k][lane];
+        scores[lane] = s;
+    }
+}
+
+// --bench-eval: random boards through every kernel; all must agree with the
+// scalar kernel. Prints boards per second for each.
+int runEvalBenchmark(int batches) {
+    vector<BoardBatch> input(max(batches, 1));
+    uint32_t rng = 12345;
+    for (BoardBatch& b : input) {
+        for (int lane = 0; lane < EVAL_LANES; lane++) {
+            // A random surface with random holes; some lanes empty or with full rows
+            int top = nextRandom(rng) % (PLAY_ROWS + 1);
+            for (int r = 0; r < PLAY_ROWS; r++) {
+                RowMask m = r < top ? 0 : (RowMask)(nextRandom(rng) & FULL_ROW);
+                if (r >= top && nextRandom(rng) % 4 == 0) m |= (RowMask)(nextRandom(rng) & FULL_ROW);
+                if (r >= top && nextRandom(rng) % 16 == 0) m = FULL_ROW;
+                b.rows[r][lane] = lane == 0 ? 0 : m;
+            }
+        }
+        b.count = EVAL_LANES;
+    }
+
+    vector<EvalKernelInfo> kernels = evalKernels();
+    vector<int32_t> expected(input.size() * EVAL_LANES);
+    for (size_t i = 0; i < input.size(); i++) {
+        evaluateBatch(input[i], DEFAULT_EVAL_WEIGHTS, &expected[i * EVAL_LANES], evalFeaturesScalar);
+    }
+
+    int failures = 0;
+    for (const EvalKernelInfo& k : kernels) {
+        vector<int32_t> scores(expected.size());
+        BatchFeatures ref, got;
+        int mismatched = 0;
+        for (size_t i = 0; i < input.size(); i++) {
+            evalFeaturesScalar(input[i], ref);
+            k.kernel(input[i], got);
+            if (memcmp(&ref, &got, sizeof(ref)) != 0) mismatched++;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < input.size(); i++) {
+            evaluateBatch(input[i], DEFAULT_EVAL_WEIGHTS, &scores[i * EVAL_LANES], k.kernel);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (scores != expected) mismatched = max(mismatched, 1);
+        printf("%-7s %10.1f M boards/s  %s\n", k.name, seconds > 0 ? expected.size() / seconds / 1e6 : 0.0,
+               mismatched ? "MISMATCH" : "ok");
+        if (mismatched) failures++;
+    }
+    return failures ? 1 : 0;
+}
+
+// ==================== PLACEMENT GENERATOR ====================
+// Every place the current piece can lock, with the shortest way to get there.
+// Breadth-first search over (x, y, rotation) with the moves of simTick: left,
+// right, soft drop, rotate (Piece::rotate's wall kicks), and hard drop to end.
+// Collision uses the row masks of the board evaluator; which states fit is
+// worked out once per search, so the search itself only tests bits.
+enum PlacementMove : uint8_t { MOVE_LEFT, MOVE_RIGHT, MOVE_DOWN, MOVE_ROTATE, MOVE_DROP };
+const char PLACEMENT_MOVE_NAMES[] = "LRDUH";   // Printable move codes (U = rotate, H = hard drop)
+
+const int PLACE_X_MIN = -3;                    // Shape cells may start left of the 4x4 box origin
+const int PLACE_XS = W + 3;
+const int PLACE_STATES = 4 * H * PLACE_XS;     // (rotation, y, x) - y never goes above the spawn row
+const int PLACEMENT_MAX_PATH = 80;
+const int MAX_PLACEMENTS = 128;
+
+// One way to lock the piece
+struct Placement {
+    int8_t x, y, rotation;                    // Final position, as Piece x/y/rotation
+    int8_t lines;                             // Rows this lock would clear
+    uint8_t pathLength;
+    uint8_t path[PLACEMENT_MAX_PATH];         // PlacementMove codes, ending with MOVE_DROP
+    RowMask cells[4];                         // Piece cells by row, starting at row y
+};
+
+struct PlacementList {
+    int count = 0;
+    Placement moves[MAX_PLACEMENTS];
+};
+
+// Shapes of one piece type in each rotation state, as 4 row masks of
+// columns j = 0..3 of the 4x4 box
+struct RotationShapes {
+    int rotations;                            // 1 for O, else 4
+    uint8_t rows[4][4];
+    int8_t minJ[4], maxJ[4];                  // Occupied columns of the box
+};
+
+// Built once from the piece classes, so the turns are exactly Piece::turnedShape's
+const RotationShapes& rotationShapes(int type) {
+    static RotationShapes table[7];
+    static bool built = [] {
+        for (int t = 0; t < 7; t++) {
+            Piece* p = createPieceFromType(t);
+            RotationShapes& r = table[t];
+            r.rotations = p->canRotate() ? 4 : 1;
+            for (int rot = 0; rot < 4; rot++) {
+                r.minJ[rot] = 4;
+                r.maxJ[rot] = -1;
+                for (int i = 0; i < 4; i++) {
+                    r.rows[rot][i] = 0;
+                    for (int j = 0; j < 4; j++) {
+                        if (p->shape[i][j] == ' ') continue;
+                        r.rows[rot][i] |= 1 << j;
+                        r.minJ[rot] = min<int>(r.minJ[rot], j);
+                        r.maxJ[rot] = max<int>(r.maxJ[rot], j);
+                    }
+                }
+                char next[4][4];
+                p->turnedShape(next);
+                memcpy(p->shape, next, sizeof(next));
+                p->rotation = (p->rotation + 1) % 4;
+            }
+            delete p;
+        }
+        return true;
+    }();
+    (void)built;
+    return table[type];
+}
+
+// Same test as canMove, on row masks
+static bool placementFits(const RowMask rows[PLAY_ROWS], const RotationShapes& s, int rot, int px, int py) {
+    if (px + s.minJ[rot] < 1 || px + s.maxJ[rot] > W - 2) return false;
+    for (int i = 0; i < 4; i++) {
+        if (!s.rows[rot][i]) continue;
+        if (py + i >= PLAY_ROWS) return false;
+        RowMask m = px >= 1 ? s.rows[rot][i] << (px - 1) : s.rows[rot][i] >> (1 - px);
+        if (rows[py + i] & m) return false;
+    }
+    return true;
+}
+
+// The filled cells of a placement as one number: its top row and the
+// non-empty row masks from there down
+uint64_t placementFootprint(const Placement& p) {
+    uint64_t footprint = 0;
+    int top = -1;
+    for (int i = 0; i < 4; i++) {
+        if (!p.cells[i]) continue;
+        if (top < 0) top = p.y + i;
+        footprint = footprint << PLAY_COLS | p.cells[i];
+    }
+    return footprint | (uint64_t)top << 58;
+}
+
+static int placementState(int rot, int py, int px) { return (rot * H + py) * PLACE_XS + (px - PLACE_X_MIN); }
+
+// All distinct lock positions for piece `type` starting at (startX, startY,
+// startRot) on the given board. Placements that leave the same cells
+// filled are reported once, with the shortest path. Returns the count.
+int generatePlacements(const RowMask rows[PLAY_ROWS], int type, int startX, int startY, int startRot,
+                       PlacementList& out) {
+    const RotationShapes& s = rotationShapes(type);
+    out.count = 0;
+    startRot %= s.rotations;
+    if (!placementFits(rows, s, startRot, startX, startY)) return 0;
+
+    // Fit of every state, computed once (x is limited by the walls anyway)
+    static thread_local std::bitset<PLACE_STATES> fits, visited, landed;
+    static thread_local int16_t parent[PLACE_STATES];
+    static thread_local uint8_t parentMove[PLACE_STATES];
+    static thread_local int16_t queue[PLACE_STATES];
+    fits.reset();
+    visited.reset();
+    landed.reset();
+    uint64_t footprints[MAX_PLACEMENTS];  // Top row and cell masks of each placement found
+    int fullRows = 0;                      // Already full rows (rows 1 and down) clear with any lock
+    for (int r = 1; r < PLAY_ROWS; r++) fullRows += rows[r] == FULL_ROW;
+    for (int rot = 0; rot < s.rotations; rot++) {
+        for (int py = startY; py < H; py++) {
+            for (int px = PLACE_X_MIN; px < PLACE_X_MIN + PLACE_XS; px++) {
+                if (placementFits(rows, s, rot, px, py)) fits.set(placementState(rot, py, px));
+            }
+        }
+    }
+
+    int head = 0, tail = 0;
+    int start = placementState(startRot, startY, startX);
+    visited.set(start);
+    parent[start] = -1;
+    queue[tail++] = (int16_t)start;
+    while (head < tail) {
+        int st = queue[head++];
+        int px = st % PLACE_XS + PLACE_X_MIN;
+        int py = st / PLACE_XS % H;
+        int rot = st / PLACE_XS / H;
+
+        // Hard drop from here locks at the landing row. Different rotation
+        // states can cover the same cells (I, S, Z), so placements are told
+        // apart by their footprint.
+        int land = py;
+        while (land + 1 < H && fits.test(placementState(rot, land + 1, px))) land++;
+        Placement p;
+        bool seen = landed.test(placementState(rot, land, px));
+        if (!seen) {
+            landed.set(placementState(rot, land, px));
+            p.x = (int8_t)px;
+            p.y = (int8_t)land;
+            p.rotation = (int8_t)rot;
+            for (int i = 0; i < 4; i++) {
+                p.cells[i] = px >= 1 ? s.rows[rot][i] << (px - 1) : s.rows[rot][i] >> (1 - px);
+            }
+            uint64_t footprint = placementFootprint(p);
+            for (int k = 0; k < out.count && !seen; k++) seen = footprints[k] == footprint;
+            if (!seen && out.count < MAX_PLACEMENTS) footprints[out.count] = footprint;
+        }
+        if (!seen && out.count < MAX_PLACEMENTS) {
+            int length = 0;
+            for (int v = st; parent[v] >= 0; v = parent[v]) length++;
+            if (length < PLACEMENT_MAX_PATH) {
+                p.pathLength = (uint8_t)(length + 1);
+                p.path[length] = MOVE_DROP;
+                for (int v = st, k = length - 1; parent[v] >= 0; v = parent[v], k--) p.path[k] = parentMove[v];
+                p.lines = (int8_t)fullRows;
+                for (int i = 0; i < 4; i++) {
+                    if (p.cells[i] && p.y + i >= 1 && ((rows[p.y + i] | p.cells[i]) == FULL_ROW)) p.lines++;  // Row 0 never clears
+                }
+                out.moves[out.count++] = p;
+            }
+        }
+
+        // Neighbours in move order; a turn tries the kicks like Piece::rotate
+        int next[4] = { -1, -1, -1, -1 };
+        if (fits.test(placementState(rot, py, px - 1))) next[MOVE_LEFT] = placementState(rot, py, px - 1);
+        if (fits.test(placementState(rot, py, px + 1))) next[MOVE_RIGHT] = placementState(rot, py, px + 1);
+        if (py + 1 < H && fits.test(placementState(rot, py + 1, px))) next[MOVE_DOWN] = placementState(rot, py + 1, px);
+        if (s.rotations > 1) {
+            int nr = (rot + 1) % 4;
+            for (int kick : { 0, -1, 1, -2, 2 }) {
+                int kx = px + kick;
+                if (kx >= PLACE_X_MIN && kx < PLACE_X_MIN + PLACE_XS && fits.test(placementState(nr, py, kx))) {
+                    next[MOVE_ROTATE] = placementState(nr, py, kx);
+                    break;
+                }
+            }
+        }
+        for (int m = 0; m < 4; m++) {
+            if (next[m] < 0 || visited.test(next[m])) continue;
+            visited.set(next[m]);
+            parent[next[m]] = (int16_t)st;
+            parentMove[next[m]] = (uint8_t)m;
+            queue[tail++] = (int16_t)next[m];
+        }
+    }
+    return out.count;
+}
+
+// Placements of the running game's current piece. The last answer is kept,
+// so asking again every frame for an unchanged position costs a compare.
+const PlacementList& currentPlacements() {
+    struct Memo {
+        RowMask rows[PLAY_ROWS];
+        int type = -1, x = 0, y = 0, rotation = 0;
+        PlacementList list;
+    };
+    static thread_local Memo memo;
+    RowMask rows[PLAY_ROWS];
+    boardRows(board, rows);
+    if (memo.type != currentPiece->type || memo.x != x || memo.y != y || memo.rotation != currentPiece->rotation ||
+        memcmp(memo.rows, rows, sizeof(rows)) != 0) {
+        memcpy(memo.rows, rows, sizeof(rows));
+        memo.type = currentPiece->type;
+        memo.x = x;
+        memo.y = y;
+        memo.rotation = currentPiece->rotation;
+        generatePlacements(rows, memo.type, x, y, memo.rotation, memo.list);
+    }
+    return memo.list;
+}
+
+// ==================== TRANSPOSITION TABLE ====================
+// Search results by position key, shared by every search thread without
+// locks. An entry stores key ^ data next to data; a reader only accepts it
+// when the two XOR back to the key it asked for, so an entry half written by
+// two threads at once reads as a miss instead of someone else's answer.
+const int TT_BITS = 20;                       // 1M entries, 16 MB
+const uint64_t TT_USED = 1ull << 63;          // Set in the data of every stored entry
+
+struct TTEntry {
+    std::atomic<uint64_t> check{0};           // key ^ data
+    std::atomic<uint64_t> data{0};            // u32 score, u8 best move, u8 depth, TT_USED
+};
+
+struct TranspositionTable {
+    std::unique_ptr<TTEntry[]> entries;
+    uint64_t mask = 0;
+};
+TranspositionTable searchTable;
+
+void ttInit(TranspositionTable& t, int bits) {
+    t.entries.reset(new TTEntry[(size_t)1 << bits]);
+    t.mask = ((uint64_t)1 << bits) - 1;
+}
+
+bool ttProbe(const TranspositionTable& t, uint64_t key, int32_t& score, int& best) {
+    const TTEntry& e = t.entries[key & t.mask];
+    uint64_t data = e.data.load(std::memory_order_relaxed);
+    uint64_t check = e.check.load(std::memory_order_relaxed);
+    if (!(data & TT_USED) || (check ^ data) != key) return false;
+    score = (int32_t)(uint32_t)data;
+    best = (int)(data >> 32 & 0xFF);
+    return true;
+}
+
+// Deeper results of other positions are kept; anything else is replaced
+void ttStore(TranspositionTable& t, uint64_t key, int depth, int32_t score, int best) {
+    TTEntry& e = t.entries[key & t.mask];
+    uint64_t old = e.data.load(std::memory_order_relaxed);
+    if ((old & TT_USED) && (e.check.load(std::memory_order_relaxed) ^ old) != key &&
+        (int)(old >> 40 & 0xFF) > depth) return;
+    uint64_t data = (uint64_t)(uint32_t)score | (uint64_t)(best & 0xFF) << 32 | (uint64_t)depth << 40 | TT_USED;
+    e.check.store(key ^ data, std::memory_order_relaxed);
+    e.data.store(data, std::memory_order_relaxed);
+}
+
+// ==================== BOT ====================
+// Built-in player (--bot). For every new piece it tries each placement of the
+// current piece, then each placement of the next one, and scores the boards
+// left behind with the batched evaluator. Depth 3 also averages over the 7
+// pieces that could come after, spread over worker threads. The chosen
+// placement is then played through simTick's normal input, one move of its
+// path per tick, so bot games record and replay like any other.
+const int32_t BOT_LINE_WEIGHT = 76;           // Score per cleared row, on top of the evaluation
+const int32_t BOT_TOPPED_OUT = INT32_MIN / 4;
+const int BOT_MAX_DEPTH = 3;
+const int BOT_BENCH_PIECES = 1000;            // --bot-bench ends a game after this many pieces
+
+struct BotConfig {
+    bool enabled = false;
+    int depth = 2;                            // Pieces looked at: 1, 2 (current + next) or 3
+    int threads = 0;                          // Search threads for depth 3, 0 = all cores
+};
+BotConfig bot;
+
+// Placement the bot is steering the current piece to
+struct BotPlan {
+    int piece = -1;                           // gStats.pieces when it was chosen
+    uint64_t target = 0;                      // placementFootprint of the choice
+};
+thread_local BotPlan botPlan;
+
+struct BotCounters {
+    uint64_t nodes = 0, probes = 0, hits = 0;
+};
+thread_local BotCounters botCounters;
+
+// Hash of row masks, equal to zobristRows of the same board
+uint64_t rowsHash(const RowMask rows[PLAY_ROWS]) {
+    const ZobristKeys& z = zobrist();
+    uint64_t h = 0;
+    for (int r = 0; r < PLAY_ROWS; r++) {
+        for (RowMask m = rows[r]; m; m &= m - 1) h ^= z.cell[r][__builtin_ctz(m) + 1];
+    }
+    return h;
+}
+
+// Lock a placement into the rows and clear full rows the way removeLine does
+// (rows 1 and below; row 0 never clears). Returns the rows cleared.
+int applyPlacement(RowMask rows[PLAY_ROWS], const Placement& p) {
+    for (int i = 0; i < 4; i++) {
+        if (p.cells[i]) rows[p.y + i] |= p.cells[i];
+    }
+    int cleared = 0;
+    for (int r = PLAY_ROWS - 1; r > 0; r--) {
+        if (rows[r] != FULL_ROW) continue;
+        memmove(rows + 2, rows + 1, (r - 1) * sizeof(RowMask));
+        rows[1] = 0;
+        cleared++;
+        r++;  // Check the same row again
+    }
+    return cleared;
+}
+
+// Table keys: a node is (board, piece to place, plies left); an average over
+// the unknown piece is (board, plies left)
+static uint64_t botNodeKey(uint64_t hash, int type, int plies) {
+    uint64_t salt = 0xB07 + plies;
+    return hash ^ zobrist().next[type] ^ splitMix64(salt);
+}
+
+static uint64_t botAverageKey(uint64_t hash, int plies) {
+    uint64_t salt = 0xA7E + plies;
+    return hash ^ splitMix64(salt);
+}
+
+static int32_t botAverage(const RowMask rows[PLAY_ROWS], uint64_t hash, int plies);
+
+// Best value of placing `type` (from the spawn position) on the rows with
+// `plies` pieces to go, counting this one
+static int32_t botBest(const RowMask rows[PLAY_ROWS], uint64_t hash, int type, int plies) {
+    uint64_t key = botNodeKey(hash, type, plies);
+    int32_t value;
+    int best;
+    botCounters.probes++;
+    if (ttProbe(searchTable, key, value, best)) {
+        botCounters.hits++;
+        return value;
+    }
+    botCounters.nodes++;
+
+    static thread_local PlacementList lists[BOT_MAX_DEPTH + 1];
+    PlacementList& list = lists[plies];
+    generatePlacements(rows, type, 4, 0, 0, list);
+    value = BOT_TOPPED_OUT;
+    best = 0;
+    if (plies == 1) {
+        // Leaves go through the evaluator 16 at a time
+        BoardBatch batch;
+        int32_t scores[EVAL_LANES];
+        int lines[EVAL_LANES];
+        for (int first = 0; first < list.count; first += EVAL_LANES) {
+            batch.count = min(EVAL_LANES, list.count - first);
+            for (int lane = 0; lane < batch.count; lane++) {
+                RowMask child[PLAY_ROWS];
+                memcpy(child, rows, sizeof(child));
+                lines[lane] = applyPlacement(child, list.moves[first + lane]);
+                for (int r = 0; r < PLAY_ROWS; r++) batch.rows[r][lane] = child[r];
+            }
+            evaluateBatch(batch, DEFAULT_EVAL_WEIGHTS, scores);
+            for (int lane = 0; lane < batch.count; lane++) {
+                int32_t v = scores[lane] + lines[lane] * BOT_LINE_WEIGHT;
+                if (v > value) { value = v; best = first + lane; }
+            }
+        }
+    } else {
+        for (int k = 0; k < list.count; k++) {
+            RowMask child[PLAY_ROWS];
+            memcpy(child, rows, sizeof(child));
+            int lines = applyPlacement(child, list.moves[k]);
+            int32_t v = botAverage(child, rowsHash(child), plies - 1);
+            if (v != BOT_TOPPED_OUT) v += lines * BOT_LINE_WEIGHT;
+            if (v > value) { value = v; best = k; }
+        }
+    }
+    ttStore(searchTable, key, plies, value, best);
+    return value;
+}
+
+// Expected value over the 7 pieces that could come next
+static int32_t botAverage(const RowMask rows[PLAY_ROWS], uint64_t hash, int plies) {
+    uint64_t key = botAverageKey(hash, plies);
+    int32_t value;
+    int best;
+    botCounters.probes++;
+    if (ttProbe(searchTable, key, value, best)) {
+        botCounters.hits++;
+        return value;
+    }
+    int64_t sum = 0;
+    for (int t = 0; t < 7; t++) sum += botBest(rows, hash, t, plies);
+    value = (int32_t)(sum / 7);
+    ttStore(searchTable, key, plies, value, 0);
+    return value;
+}
+
+// Value of taking placement k of the running game's current piece
+static int32_t botRootValue(const RowMask rows[PLAY_ROWS], const Placement& p, int nextType, int depth) {
+    RowMask child[PLAY_ROWS];
+    memcpy(child, rows, sizeof(child));
+    int lines = applyPlacement(child, p);
+    int32_t v;
+    if (depth <= 1) {
+        BoardBatch batch;
+        batch.count = 1;
+        for (int r = 0; r < PLAY_ROWS; r++) batch.rows[r][0] = child[r];
+        int32_t scores[EVAL_LANES];
+        evaluateBatch(batch, DEFAULT_EVAL_WEIGHTS, scores);
+        v = scores[0];
+    } else {
+        v = botBest(child, rowsHash(child), nextType, depth - 1);
+    }
+    return v == BOT_TOPPED_OUT ? v : v + lines * BOT_LINE_WEIGHT;
+}
+
+// Index into `list` (placements of the current piece) of the bot's choice
+int botChoose(const PlacementList& list, int depth, int threads) {
+    TRACE_SCOPE("bot.search");
+    if (!searchTable.entries) ttInit(searchTable, TT_BITS);
+    RowMask rows[PLAY_ROWS];
+    boardRows(board, rows);
+    int nextType = nextPiece->type;
+    int32_t values[MAX_PLACEMENTS];
+
+    if (depth < 3 || threads <= 1 || list.count < 2) {
+        for (int k = 0; k < list.count; k++) values[k] = botRootValue(rows, list.moves[k], nextType, depth);
+    } else {
+        // Root moves are handed out one at a time; the table is shared
+        std::atomic<int> nextMove{0};
+        std::atomic<uint64_t> nodes{0}, probes{0}, hits{0};
+        auto work = [&] {
+            botCounters = BotCounters{};
+            for (int k; (k = nextMove.fetch_add(1)) < list.count;) {
+                values[k] = botRootValue(rows, list.moves[k], nextType, depth);
+            }
+            nodes += botCounters.nodes;
+            probes += botCounters.probes;
+            hits += botCounters.hits;
+        };
+        BotCounters mine = botCounters;
+        vector<std::thread> pool;
+        for (int t = 1; t < min(threads, list.count); t++) pool.emplace_back(work);
+        work();
+        for (std::thread& t : pool) t.join();
+        mine.nodes += nodes;
+        mine.probes += probes;
+        mine.hits += hits;
+        botCounters = mine;
+    }
+
+    int best = 0;
+    for (int k = 1; k < list.count; k++) {
+        if (values[k] > values[best]) best = k;
+    }
+    return best;
+}
+
+// Input for the next tick: the first move of the path to the planned
+// placement, re-planned from wherever the piece actually is now
+uint8_t botInput() {
+    if (isGameOver) return 0;
+    const PlacementList& list = currentPlacements();
+    if (list.count == 0) return 0;
+    int k = -1;
+    if (botPlan.piece == gStats.pieces) {
+        for (int i = 0; i < list.count && k < 0; i++) {
+            if (placementFootprint(list.moves[i]) == botPlan.target) k = i;
+        }
+    }
+    if (k < 0) {
+        // New piece, or the plan got out of reach (gravity, lock delay)
+        int threads = bot.threads > 0 ? bot.threads : max(1u, std::thread::hardware_concurrency());
+        k = botChoose(list, bot.depth, threads);
+        botPlan.piece = gStats.pieces;
+        botPlan.target = placementFootprint(list.moves[k]);
+    }
+
+    switch (list.moves[k].path[0]) {
+    case MOVE_ROTATE: return IN_ROTATE;
+    case MOVE_DROP: return IN_DROP;
+    default:
+        // Held moves only happen when simTick's repeat delay allows one
+        if (inputTicks + 1 < INPUT_REPEAT_TICKS) return 0;
+        return list.moves[k].path[0] == MOVE_LEFT ? IN_LEFT : list.moves[k].path[0] == MOVE_RIGHT ? IN_RIGHT : IN_DOWN;
+    }
+}
+
+struct BotBenchGame {
+    int score = 0, lines = 0, pieces = 0;
+    bool toppedOut = false;
+};
+
+// Headless bot games (--bot-bench): `games` seeded games of at most
+// BOT_BENCH_PIECES pieces, spread over `threads` threads sharing the table
+int runBotBench(int games, int threads) {
+    if (games <= 0) games = 20;
+    if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+    ttInit(searchTable, TT_BITS);
+    vector<BotBenchGame> results(games);
+    std::atomic<int> nextGame{0};
+    std::atomic<uint64_t> nodes{0}, probes{0}, hits{0};
+    auto worker = [&] {
+        simSilent = true;
+        botCounters = BotCounters{};
+        for (int g; (g = nextGame.fetch_add(1)) < games;) {
+            resetGame((uint32_t)g + 1);
+            gStats = GameStats{};
+            botPlan = BotPlan{};
+            while (!isGameOver && gStats.pieces < BOT_BENCH_PIECES && gameTick < BOT_BENCH_PIECES * 600) {
+                simTick(botInput());
+            }
+            results[g] = BotBenchGame{ gScore, gLines, gStats.pieces, isGameOver };
+        }
+        nodes += botCounters.nodes;
+        probes += botCounters.probes;
+        hits += botCounters.hits;
+        delete currentPiece;
+        delete nextPiece;
+        currentPiece = nextPiece = nullptr;
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<std::thread> pool;
+    for (int t = 0; t < min(threads, games); t++) pool.emplace_back(worker);
+    for (std::thread& t : pool) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int64_t score = 0, lines = 0, pieces = 0;
+    int toppedOut = 0;
+    for (const BotBenchGame& r : results) {
+        score += r.score;
+        lines += r.lines;
+        pieces += r.pieces;
+        toppedOut += r.toppedOut;
+    }
+    printf("%d games (depth %d, %d threads) in %.2f s, %d topped out\n", games, bot.depth, threads, seconds,
+           toppedOut);
+    printf("  average score %.0f, lines %.1f, pieces %.1f\n", (double)score / games, (double)lines / games,
+           (double)pieces / games);
+    printf("  %.0f pieces/s, %llu nodes searched, table hits %llu / %llu (%.1f%%)\n", pieces / seconds,
+           (unsigned long long)nodes, (unsigned long long)hits, (unsigned long long)probes,
+           probes ? 100.0 * hits / probes : 0.0);
+    return 0;
+}
+
+// ==================== PUZZLE SOLVER (--solve, F5 hint) ====================
+// Searches a known piece sequence for a perfect clear, or for a number of
+// cleared lines, within its first `count` pieces. Depth-first over the
+// placements generatePlacements can reach, with three cuts:
+//   fill count  a perfect clear in the bottom h rows needs exactly the empty
+//               cells of those rows, so their number must be a multiple of 4
+//               and at most 4 per piece left; for lines, the emptiest rows
+//               needed must still be fillable by the pieces left
+//   walls       a column filled in every row of the box is never crossed, so
+//               the empty cells left of it must also split into tetrominoes
+//               (unlike enclosed holes, a clear can't reconnect the two sides)
+//   memo        positions already searched without success, by row hash,
+//               piece index and goal, in a table shared by the threads
+// Boxes are tried from the lowest, and line goals with more and more pieces,
+// so the first answer uses the fewest pieces. The first two plies are split
+// into tasks handed out in order; the answer is the lowest task that
+// succeeds, so it doesn't depend on the thread count.
+const int SOLVER_MAX_PIECES = 16;
+const int SOLVER_MEMO_BITS = 20;             // 16 MB
+const int SOLVER_HINT_PIECES = 10;           // Pieces the F5 hint looks ahead
+
+struct SolverRequest {
+    RowMask rows[PLAY_ROWS];
+    int8_t pieces[SOLVER_MAX_PIECES];
+    int count = 0;
+    int targetLines = 0;                     // 0 = perfect clear
+    int startX = 4, startY = 0, startRotation = 0;  // Where the first piece is now
+    int threads = 0;                         // 0 = all cores
+};
+
+struct SolverResult {
+    bool found = false;
+    int length = 0;                          // Pieces placed by the solution
+    Placement moves[SOLVER_MAX_PIECES];
+    uint64_t nodes = 0, pruned = 0, memoHits = 0;
+    double ms = 0;
+};
+
+enum SolverOutcome { SOLVE_FOUND, SOLVE_DEAD, SOLVE_ABORTED };
+
+struct SolverWorker {
+    PlacementList lists[SOLVER_MAX_PIECES];
+    Placement path[SOLVER_MAX_PIECES];
+    int pathLength = 0;                      // Set when the goal is reached
+    int bestTask = INT32_MAX;                // Lowest task this worker solved
+    Placement best[SOLVER_MAX_PIECES];
+    int bestLength = 0;
+    uint64_t nodes = 0, pruned = 0, memoHits = 0;
+};
+
+struct SolverTask {
+    int root;                                // Index into the root placements
+    Placement second;                        // Second piece, if any
+    bool hasSecond;
+};
+
+struct SolverSearch {
+    const SolverRequest* request;
+    const std::atomic<bool>* cancel;
+    TranspositionTable memo;
+    int boxHeight;                           // Perfect clear: rows that must clear
+    int limit;                               // Pieces the search may use
+    std::atomic<int> bestTask{INT32_MAX};
+};
+
+// Perfect clear: every cell of the placement inside the bottom boxHeight rows
+static bool placementInBox(const Placement& p, int boxHeight) {
+    for (int i = 0; i < 4; i++) {
+        if (p.cells[i] && p.y + i < PLAY_ROWS - boxHeight) return false;
+    }
+    return true;
+}
+
+// Fill count and wall cuts. True if the goal is still reachable.
+static bool solverFeasible(const SolverSearch& s, const RowMask rows[PLAY_ROWS], int piecesLeft, int boxHeight,
+                           int linesNeeded) {
+    if (s.request->targetLines == 0) {
+        int empty = 0;
+        RowMask wall = FULL_ROW;
+        for (int r = PLAY_ROWS - boxHeight; r < PLAY_ROWS; r++) {
+            empty += PLAY_COLS - __builtin_popcount(rows[r]);
+            wall &= rows[r];
+        }
+        if (empty > 4 * piecesLeft) return false;
+        for (; wall; wall &= wall - 1) {
+            RowMask left = (RowMask)((wall & -wall) - 1);
+            int leftEmpty = 0;
+            for (int r = PLAY_ROWS - boxHeight; r < PLAY_ROWS; r++) leftEmpty += __builtin_popcount(~rows[r] & left);
+            if (leftEmpty % 4) return false;
+        }
+        return true;
+    }
+    // Lines: the emptiest rows that must fill (row 0 never clears)
+    int holes[PLAY_ROWS];
+    for (int r = 1; r < PLAY_ROWS; r++) holes[r - 1] = PLAY_COLS - __builtin_popcount(rows[r]);
+    if (linesNeeded > PLAY_ROWS - 1) return false;
+    std::partial_sort(holes, holes + linesNeeded, holes + PLAY_ROWS - 1);
+    int needed = 0;
+    for (int k = 0; k < linesNeeded; k++) needed += holes[k];
+    return needed <= 4 * piecesLeft;
+}
+
+// Search from piece `depth` on. On success the moves from `depth` on are in w.path.
+static SolverOutcome solverDfs(SolverSearch& s, SolverWorker& w, int task, const RowMask rows[PLAY_ROWS],
+                               int depth, int boxHeight, int linesNeeded) {
+    const SolverRequest& req = *s.request;
+    if (req.targetLines == 0 ? boxHeight == 0 : linesNeeded <= 0) {
+        w.pathLength = depth;
+        return SOLVE_FOUND;
+    }
+    if (depth == s.limit) return SOLVE_DEAD;
+    if (s.cancel->load(std::memory_order_relaxed) || s.bestTask.load(std::memory_order_relaxed) < task) {
+        return SOLVE_ABORTED;
+    }
+    w.nodes++;
+    int piecesLeft = s.limit - depth;
+    if (!solverFeasible(s, rows, piecesLeft, boxHeight, linesNeeded)) {
+        w.pruned++;
+        return SOLVE_DEAD;
+    }
+
+    uint64_t goal = (uint64_t)depth | (uint64_t)boxHeight << 8 | (uint64_t)max(0, linesNeeded) << 16 |
+                    (uint64_t)s.limit << 24;
+    uint64_t key = rowsHash(rows) ^ splitMix64(goal);
+    int32_t ignored;
+    int ignoredBest;
+    if (ttProbe(s.memo, key, ignored, ignoredBest)) {
+        w.memoHits++;
+        return SOLVE_DEAD;
+    }
+
+    PlacementList& list = w.lists[depth];
+    if (depth == 0) generatePlacements(rows, req.pieces[0], req.startX, req.startY, req.startRotation, list);
+    else generatePlacements(rows, req.pieces[depth], 4, 0, 0, list);
+
+    // Clears first, then the lowest placements: they finish boxes soonest
+    int order[MAX_PLACEMENTS];
+    for (int k = 0; k < list.count; k++) {
+        int j = k;
+        for (; j > 0; j--) {
+            const Placement& a = list.moves[order[j - 1]];
+            const Placement& b = list.moves[k];
+            if (a.lines > b.lines || (a.lines == b.lines && a.y >= b.y)) break;
+            order[j] = order[j - 1];
+        }
+        order[j] = k;
+    }
+
+    for (int k = 0; k < list.count; k++) {
+        const Placement& p = list.moves[order[k]];
+        if (req.targetLines == 0 && !placementInBox(p, boxHeight)) continue;
+        RowMask next[PLAY_ROWS];
+        memcpy(next, rows, sizeof(next));
+        int cleared = applyPlacement(next, p);
+        SolverOutcome o = solverDfs(s, w, task, next, depth + 1, boxHeight - cleared, linesNeeded - cleared);
+        if (o == SOLVE_FOUND) {
+            w.path[depth] = p;
+            return SOLVE_FOUND;
+        }
+        if (o == SOLVE_ABORTED) return SOLVE_ABORTED;  // Not fully searched: don't remember it
+    }
+    ttStore(s.memo, key, piecesLeft, 0, 0);
+    return SOLVE_DEAD;
+}
+
+// Search one goal (box height for a perfect clear) on all threads
+static bool solverRun(SolverSearch& s, int threads, SolverResult& result) {
+    const SolverRequest& req = *s.request;
+    bool perfect = req.targetLines == 0;
+    vector<std::unique_ptr<SolverWorker>> workers;
+    for (int t = 0; t < threads; t++) workers.emplace_back(new SolverWorker);
+
+    // Tasks: every first move, each paired with every second move
+    PlacementList& roots = workers[0]->lists[0];
+    PlacementList& seconds = workers[0]->lists[1];
+    generatePlacements(req.rows, req.pieces[0], req.startX, req.startY, req.startRotation, roots);
+    vector<SolverTask> tasks;
+    for (int i = 0; i < roots.count; i++) {
+        const Placement& p = roots.moves[i];
+        if (perfect && !placementInBox(p, s.boxHeight)) continue;
+        RowMask rows[PLAY_ROWS];
+        memcpy(rows, req.rows, sizeof(rows));
+        int cleared = applyPlacement(rows, p);
+        bool done = perfect ? s.boxHeight == cleared : req.targetLines <= cleared;
+        if (done || s.limit == 1) {
+            tasks.push_back({ i, p, false });
+            continue;
+        }
+        generatePlacements(rows, req.pieces[1], 4, 0, 0, seconds);
+        for (int j = 0; j < seconds.count; j++) {
+            if (!perfect || placementInBox(seconds.moves[j], s.boxHeight - cleared)) {
+                tasks.push_back({ i, seconds.moves[j], true });
+            }
+        }
+    }
+    vector<Placement> firsts(roots.moves, roots.moves + roots.count);  // The workers reuse lists[0]
+
+    std::atomic<int> nextTask{0};
+    auto work = [&](SolverWorker& w) {
+        for (int t; (t = nextTask.fetch_add(1)) < (int)tasks.size();) {
+            if (t > s.bestTask.load(std::memory_order_relaxed)) break;
+            const SolverTask& task = tasks[t];
+            RowMask rows[PLAY_ROWS];
+            memcpy(rows, req.rows, sizeof(rows));
+            int cleared = applyPlacement(rows, firsts[task.root]);
+            int box = s.boxHeight - cleared, lines = req.targetLines - cleared, depth = 1;
+            if (task.hasSecond) {
+                cleared = applyPlacement(rows, task.second);
+                box -= cleared;
+                lines -= cleared;
+                depth = 2;
+            }
+            if (solverDfs(s, w, t, rows, depth, box, lines) != SOLVE_FOUND) continue;
+
+            // Tasks finish out of order: keep the lowest one that succeeded
+            int best = s.bestTask.load();
+            while (t < best && !s.bestTask.compare_exchange_weak(best, t)) {}
+            if (t < w.bestTask) {
+                w.bestTask = t;
+                w.path[0] = firsts[task.root];
+                if (task.hasSecond) w.path[1] = task.second;
+                memcpy(w.best, w.path, sizeof(w.best));
+                w.bestLength = w.pathLength;
+            }
+        }
+    };
+    vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(work, std::ref(*workers[t]));
+    work(*workers[0]);
+    for (std::thread& t : pool) t.join();
+
+    const SolverWorker* winner = nullptr;
+    for (const auto& w : workers) {
+        result.nodes += w->nodes;
+        result.pruned += w->pruned;
+        result.memoHits += w->memoHits;
+        if (w->bestTask != INT32_MAX && (!winner || w->bestTask < winner->bestTask)) winner = w.get();
+    }
+    if (!winner) return false;
+    result.found = true;
+    result.length = winner->bestLength;
+    memcpy(result.moves, winner->best, sizeof(result.moves));
+    return true;
+}
+
+// Solve a request; `cancel` stops the search early (result.found stays false)
+void solve(const SolverRequest& req, SolverResult& result, const std::atomic<bool>* cancel = nullptr) {
+    TRACE_SCOPE("solver.solve");
+    static const std::atomic<bool> never{false};
+    auto start = chrono::steady_clock::now();
+    result = SolverResult{};
+    int threads = req.threads > 0 ? req.threads : (int)max(1u, std::thread::hardware_concurrency());
+    SolverSearch s;
+    s.request = &req;
+    s.cancel = cancel ? cancel : &never;
+    if (req.count > 0 && req.count <= SOLVER_MAX_PIECES) {
+        ttInit(s.memo, SOLVER_MEMO_BITS);
+        if (req.targetLines > 0) {
+            // Fewest pieces first
+            s.boxHeight = 0;
+            for (s.limit = 1; s.limit <= req.count && !result.found && !s.cancel->load(); s.limit++) {
+                s.bestTask = INT32_MAX;
+                solverRun(s, threads, result);
+            }
+        } else {
+            // Smallest box first: the stack height, up to what the pieces can fill
+            int filled = 0, height = 0;
+            for (int r = 0; r < PLAY_ROWS; r++) {
+                filled += __builtin_popcount(req.rows[r]);
+                if (req.rows[r] && height == 0) height = PLAY_ROWS - r;
+            }
+            for (int h = max(1, height); h < PLAY_ROWS && !result.found && !s.cancel->load(); h++) {
+                int empty = h * PLAY_COLS - filled;
+                if (empty > 4 * req.count) break;
+                if (empty % 4) continue;
+                s.boxHeight = h;
+                s.limit = req.count;
+                s.bestTask = INT32_MAX;
+                solverRun(s, threads, result);
+            }
+        }
+    }
+    result.ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+}
+
+// The current piece, the next one and what the bag deals after them. The
+// bag's generator is copied; the game's own draws are untouched.
+int upcomingPieces(int8_t* out, int n) {
+    int k = 0;
+    if (k < n) out[k++] = (int8_t)currentPiece->type;
+    if (k < n) out[k++] = (int8_t)nextPiece->type;
+    int queue[7];
+    memcpy(queue, pieceQueue, sizeof(queue));
+    int index = queueIndex;
+    uint32_t rng = rngState;
+    while (k < n) {
+        if (index >= 7) {  // refillPieceQueue on the copy
+            for (int i = 0; i < 7; i++) queue[i] = i;
+            for (int i = 6; i > 0; i--) swap(queue[i], queue[nextRandom(rng) % (i + 1)]);
+            index = 0;
+        }
+        out[k++] = (int8_t)queue[index++];
+    }
+    return k;
+}
+
+// --solve <board file> <pieces> [lines] [threads]: the board file has up to
+// PLAY_ROWS lines of PLAY_COLS characters, the last line being the bottom
+// row ('#' or 'X' = filled, anything else empty); pieces are letters like
+// TSZLJIO. lines 0 (the default) asks for a perfect clear.
+int runSolve(const char* boardPath, const char* pieces, int lines, int threads) {
+    SolverRequest req;
+    memset(req.rows, 0, sizeof(req.rows));
+    FILE* f = fopen(boardPath, "r");
+    if (!f) {
+        fprintf(stderr, "solve: cannot open %s\n", boardPath);
+        return -1;
+    }
+    vector<RowMask> fileRows;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        RowMask m = 0;
+        for (int c = 0; c < PLAY_COLS && line[c] && line[c] != '\n' && line[c] != '\r'; c++) {
+            if (line[c] == '#' || line[c] == 'X' || line[c] == 'x') m |= 1 << c;
+        }
+        fileRows.push_back(m);
+    }
+    fclose(f);
+    if (fileRows.size() > (size_t)PLAY_ROWS - 1) {
+        fprintf(stderr, "solve: at most %d rows\n", PLAY_ROWS - 1);
+        return -1;
+    }
+    for (size_t k = 0; k < fileRows.size(); k++) req.rows[PLAY_ROWS - fileRows.size() + k] = fileRows[k];
+
+    for (const char* p = pieces; *p && req.count < SOLVER_MAX_PIECES; p++) {
+        const char* at = strchr("IOTSZJL", toupper((unsigned char)*p));
+        if (!at || !*p) {
+            fprintf(stderr, "solve: unknown piece '%c' (use IOTSZJL)\n", *p);
+            return -1;
+        }
+        req.pieces[req.count++] = (int8_t)(at - "IOTSZJL");
+    }
+    if (req.count == 0) {
+        fprintf(stderr, "solve: no pieces given\n");
+        return -1;
+    }
+    req.targetLines = max(0, lines);
+    req.threads = threads;
+
+    SolverResult result;
+    solve(req, result);
+    if (result.found) {
+        if (req.targetLines == 0) printf("perfect clear with %d pieces:\n", result.length);
+        else printf("%d lines with %d pieces:\n", req.targetLines, result.length);
+        for (int k = 0; k < result.length; k++) {
+            const Placement& m = result.moves[k];
+            char keys[PLACEMENT_MAX_PATH + 1];
+            for (int i = 0; i < m.pathLength; i++) keys[i] = PLACEMENT_MOVE_NAMES[m.path[i]];
+            keys[m.pathLength] = 0;
+            printf("  %2d. %c  rotation %d, x %2d, y %2d, clears %d, keys %s\n", k + 1, "IOTSZJL"[req.pieces[k]],
+                   m.rotation, m.x, m.y, m.lines, keys);
+        }
+    } else if (req.targetLines == 0) {
+        printf("no perfect clear within %d pieces\n", req.count);
+    } else {
+        printf("no %d lines within %d pieces\n", req.targetLines, req.count);
+    }
+    printf("  %llu nodes, %llu cut by fill counts and walls, %llu memo hits, %.1f ms (%.0f nodes/s)\n",
+           (unsigned long long)result.nodes, (unsigned long long)result.pruned, (unsigned long long)result.memoHits,
+           result.ms, result.ms > 0 ? result.nodes * 1000.0 / result.ms : 0.0);
+    return 0;
+}
+
+// F5 while playing: look for a perfect clear within the next
+// SOLVER_HINT_PIECES pieces on a background thread and outline where the
+// current piece should go. The hint follows along while the player places
+// pieces the way it says, and disappears once the board goes another way.
+struct SolverHint {
+    std::thread worker;
+    std::atomic<bool> cancel{false}, ready{false};
+    SolverRequest request;
+    SolverResult result;
+    RowMask boards[SOLVER_MAX_PIECES + 1][PLAY_ROWS];  // Board before each move of the solution
+    int step = 0;                            // Moves of the solution played so far
+    bool active = false;
+};
+SolverHint hint;
+
+void solverHintStop() {
+    if (!hint.active) return;
+    hint.cancel = true;
+    if (hint.worker.joinable()) hint.worker.join();
+    hint.active = false;
+}
+
+void solverHintStart() {
+    solverHintStop();
+    boardRows(board, hint.request.rows);
+    hint.request.count = upcomingPieces(hint.request.pieces, SOLVER_HINT_PIECES);
+    hint.request.targetLines = 0;
+    hint.request.startX = x;
+    hint.request.startY = y;
+    hint.request.startRotation = currentPiece->rotation;
+    hint.request.threads = 0;
+    hint.cancel = false;
+    hint.ready = false;
+    hint.step = 0;
+    hint.active = true;
+    hint.worker = std::thread([] {
+        traceSetThreadName("solver");
+        solve(hint.request, hint.result, &hint.cancel);
+        memcpy(hint.boards[0], hint.request.rows, sizeof(hint.boards[0]));
+        for (int k = 0; k < hint.result.length; k++) {
+            memcpy(hint.boards[k + 1], hint.boards[k], sizeof(hint.boards[k]));
+            applyPlacement(hint.boards[k + 1], hint.result.moves[k]);
+        }
+        hint.ready.store(true, std::memory_order_release);
+    });
+}
+
+// Once per frame: follow the player through the solution, or drop the hint
+void solverHintUpdate() {
+    if (!hint.active) return;
+    RowMask now[PLAY_ROWS];
+    boardRows(board, now);
+    if (!hint.ready.load(std::memory_order_acquire)) {
+        if (isGameOver || memcmp(now, hint.request.rows, sizeof(now)) != 0) solverHintStop();  // Too late
+        return;
+    }
+    if (hint.step < hint.result.length && memcmp(now, hint.boards[hint.step + 1], sizeof(now)) == 0) hint.step++;
+    if (isGameOver || memcmp(now, hint.boards[hint.step], sizeof(now)) != 0 ||
+        (hint.result.found && hint.step == hint.result.length)) {
+        solverHintStop();
+    }
+}
+
+void solverHintDraw(sf::RenderWindow& window, const sf::Font& font) {
+    if (!hint.active) return;
+    char status[64];
+    if (!hint.ready.load(std::memory_order_acquire)) {
+        drawText(window, font, "SOLVING...", 6.f, 4.f, 14);
+        return;
+    }
+    if (!hint.result.found) {
+        snprintf(status, sizeof(status), "NO PERFECT CLEAR IN %d PIECES", hint.request.count);
+        drawText(window, font, status, 6.f, 4.f, 14);
+        return;
+    }
+    snprintf(status, sizeof(status), "PERFECT CLEAR: %d PIECES", hint.result.length - hint.step);
+    drawText(window, font, status, 6.f, 4.f, 14);
+    static RectangleShape cell(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));
+    cell.setFillColor(Color(255, 215, 0, 60));
+    cell.setOutlineThickness(2.f);
+    cell.setOutlineColor(Color(255, 215, 0, 220));
+    const Placement& m = hint.result.moves[hint.step];
+    for (int i = 0; i < 4; i++) {
+        for (RowMask bits = m.cells[i]; bits; bits &= bits - 1) {
+            cell.setPosition(Vector2f((__builtin_ctz(bits) + 1) * TILE_SIZE, (m.y + i) * TILE_SIZE));
+            window.draw(cell);
+        }
+    }
+}
+
+// ==================== AGENT INTERFACE (--agent) ====================
+// Out-of-process bots play through a named shared-memory region with two
+// single-producer rings. The game publishes an AgentState on every spawn,
+// move, lock and game over; the agent answers with AgentCommands, which
+// become simTick input exactly like keys. Neither side ever waits for the
+// other:
+//   states    The game writes slot seq % AGENT_STATE_SLOTS under a per-slot
+//             version (odd while writing, seq * 2 when done) and then bumps
+//             stateHead. A slow agent just finds old states overwritten, and
+//             a torn read shows up as a changed version - read it again.
+//   commands  The agent writes slot commandHead % AGENT_COMMAND_SLOTS, then
+//             bumps commandHead; the game drains up to commandHead each tick
+//             and bumps commandTail. The agent must not run more than
+//             AGENT_COMMAND_SLOTS ahead of commandTail.
+// Held bits (IN_LEFT/RIGHT/DOWN) stay held until a later command; IN_ROTATE
+// and IN_DROP fire once. Region names: /tetris-agent-<name> (POSIX shared
+// memory) or Local\tetris-agent-<name> (Windows). --agent-demo <name> is a
+// reference agent built on the bot's search.
+const uint32_t AGENT_MAGIC = 0x31474154;     // "TAG1"
+const uint32_t AGENT_VERSION = 1;
+const uint32_t AGENT_STATE_SLOTS = 64;       // Powers of two
+const uint32_t AGENT_COMMAND_SLOTS = 64;
+const int AGENT_DEMO_REPORT = 1000;          // States between --agent-demo latency reports
+
+struct AgentState {
+    uint64_t seq;                            // 1, 2, 3... in publish order
+    uint64_t publishNs;                      // Steady clock when published (machine-wide)
+    uint32_t tick;                           // gameTick
+    uint32_t pieces;                         // Pieces spawned this game; a new value = a new piece
+    RowMask rows[PLAY_ROWS];                 // Board rows, top first, bit c = column c + 1
+    int8_t type, next;                       // Piece types (see createPieceFromType)
+    int8_t x, y, rotation;                   // Current piece: 4x4 box position, quarter turns
+    int8_t inputTicks;                       // Held moves repeat once this reaches INPUT_REPEAT_TICKS
+    uint8_t gameOver;
+    uint8_t pad;
+    int32_t score, lines, level;
+};
+
+struct AgentStateSlot {
+    std::atomic<uint64_t> version;           // seq * 2 when complete, odd while being written
+    AgentState state;
+};
+
+struct AgentCommand {
+    uint64_t stateSeq;                       // State the agent was answering (for its own bookkeeping)
+    uint8_t input;                           // InputBits
+    uint8_t pad[7];
+};
+
+struct AgentShared {
+    uint32_t magic, version, stateSlots, commandSlots;
+    alignas(64) std::atomic<uint64_t> stateHead;      // States published
+    alignas(64) std::atomic<uint32_t> commandHead;    // Commands written by the agent
+    alignas(64) std::atomic<uint32_t> commandTail;    // Commands applied by the game
+    std::atomic<uint32_t> closed;                     // Set when the game exits
+    alignas(64) AgentStateSlot states[AGENT_STATE_SLOTS];
+    AgentCommand commands[AGENT_COMMAND_SLOTS];
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "the rings need address-free atomics");
+
+struct AgentLink {
+    AgentShared* shared = nullptr;
+    bool owner = false;                      // The game created the region
+    char name[96] = "";
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+    // Game side
+    uint64_t published = 0;
+    AgentState last = {};                    // Last published state (seq and time aside)
+    uint8_t held = 0;                        // Held bits from the latest command
+    uint8_t pressed = 0;                     // One-shot bits not yet applied
+};
+AgentLink agent;
+
+// Create (game) or open (agent) the shared region; false with a message on failure
+bool agentOpen(AgentLink& a, const char* name, bool create) {
+#ifdef _WIN32
+    snprintf(a.name, sizeof(a.name), "Local\\tetris-agent-%s", name);
+    if (create) {
+        a.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(AgentShared), a.name);
+    } else {
+        a.mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, a.name);
+    }
+    if (a.mapping) a.shared = (AgentShared*)MapViewOfFile(a.mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(AgentShared));
+#else
+    snprintf(a.name, sizeof(a.name), "/tetris-agent-%s", name);
+    int fd = shm_open(a.name, create ? O_CREAT | O_RDWR : O_RDWR, 0600);
+    if (fd >= 0 && (!create || ftruncate(fd, sizeof(AgentShared)) == 0)) {
+        void* p = mmap(nullptr, sizeof(AgentShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) a.shared = (AgentShared*)p;
+    }
+    if (fd >= 0) close(fd);
+#endif
+    if (!a.shared) {
+        fprintf(stderr, "agent: cannot %s shared memory %s\n", create ? "create" : "open", a.name);
+        return false;
+    }
+    a.owner = create;
+    if (create) {
+        // Fresh zeroed pages: the atomics start at 0 before anything is published
+        a.shared->stateSlots = AGENT_STATE_SLOTS;
+        a.shared->commandSlots = AGENT_COMMAND_SLOTS;
+        a.shared->version = AGENT_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        a.shared->magic = AGENT_MAGIC;
+    } else if (a.shared->magic != AGENT_MAGIC || a.shared->version != AGENT_VERSION) {
+        fprintf(stderr, "agent: %s is not a version %u game region\n", a.name, AGENT_VERSION);
+        return false;
+    }
+    return true;
+}
+
+void agentClose(AgentLink& a) {
+    if (!a.shared) return;
+    if (a.owner) a.shared->closed.store(1, std::memory_order_release);
+#ifdef _WIN32
+    UnmapViewOfFile(a.shared);
+    CloseHandle(a.mapping);
+#else
+    munmap(a.shared, sizeof(AgentShared));
+    if (a.owner) shm_unlink(a.name);
+#endif
+    a = AgentLink{};
+}
+
+static uint64_t agentNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Publish the engine state if anything an agent acts on changed since the
+// last one (a spawn, move, rotation, lock or game over). Called after every
+// tick and once per frame.
+void agentPublish() {
+    if (!agent.shared || !currentPiece) return;
+    AgentState s = {};
+    s.tick = (uint32_t)gameTick;
+    s.pieces = (uint32_t)gStats.pieces;
+    boardRows(board, s.rows);
+    s.type = (int8_t)currentPiece->type;
+    s.next = (int8_t)nextPiece->type;
+    s.x = (int8_t)x;
+    s.y = (int8_t)y;
+    s.rotation = (int8_t)currentPiece->rotation;
+    s.inputTicks = (int8_t)inputTicks;
+    s.gameOver = isGameOver;
+    s.score = gScore;
+    s.lines = gLines;
+    s.level = gLevel;
+    // Ticks and the repeat counter pass without anything moving
+    if (memcmp(s.rows, agent.last.rows, sizeof(s.rows)) == 0 && s.pieces == agent.last.pieces
+        && s.x == agent.last.x && s.y == agent.last.y && s.rotation == agent.last.rotation
+        && s.gameOver == agent.last.gameOver && s.score == agent.last.score && agent.published) return;
+    agent.last = s;
+
+    uint64_t seq = ++agent.published;
+    s.seq = seq;
+    s.publishNs = agentNowNs();
+    AgentStateSlot& slot = agent.shared->states[seq & (AGENT_STATE_SLOTS - 1)];
+    slot.version.store(seq * 2 - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.state, &s, sizeof(s));
+    slot.version.store(seq * 2, std::memory_order_release);
+    agent.shared->stateHead.store(seq, std::memory_order_release);
+}
+
+// Input for the next tick from the commands that arrived since the last one
+uint8_t agentInput() {
+    AgentShared* sh = agent.shared;
+    uint32_t tail = sh->commandTail.load(std::memory_order_relaxed);
+    uint32_t head = sh->commandHead.load(std::memory_order_acquire);
+    if (head - tail > AGENT_COMMAND_SLOTS) tail = head - AGENT_COMMAND_SLOTS;  // Agent overran the ring
+    for (; tail != head; tail++) {
+        uint8_t in = sh->commands[tail & (AGENT_COMMAND_SLOTS - 1)].input;
+        agent.held = in & IN_HELD_MASK;
+        agent.pressed |= in & ~IN_HELD_MASK;
+    }
+    sh->commandTail.store(tail, std::memory_order_release);
+    uint8_t input = agent.held | agent.pressed;
+    agent.pressed = 0;
+    return input;
+}
+
+// Copy the newest state; false if none is published yet. Retries while the
+// game overwrites the slot under us.
+bool agentReadLatest(const AgentShared* sh, AgentState& out) {
+    while (true) {
+        uint64_t seq = sh->stateHead.load(std::memory_order_acquire);
+        if (seq == 0) return false;
+        const AgentStateSlot& slot = sh->states[seq & (AGENT_STATE_SLOTS - 1)];
+        uint64_t before = slot.version.load(std::memory_order_acquire);
+        memcpy(&out, &slot.state, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (before == seq * 2 && slot.version.load(std::memory_order_relaxed) == before) return true;
+    }
+}
+
+// Queue one command; false if the game hasn't drained the ring yet
+bool agentSend(AgentShared* sh, uint64_t stateSeq, uint8_t input) {
+    uint32_t head = sh->commandHead.load(std::memory_order_relaxed);
+    if (head - sh->commandTail.load(std::memory_order_acquire) >= AGENT_COMMAND_SLOTS) return false;
+    AgentCommand& c = sh->commands[head & (AGENT_COMMAND_SLOTS - 1)];
+    c.stateSeq = stateSeq;
+    c.input = input;
+    sh->commandHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// --agent-demo <name> [depth]: attach to a game started with --agent <name>
+// and play it with the bot's search. Spins on stateHead, so a new state is
+// seen within microseconds; prints how long states took to arrive.
+int runAgentDemo(const char* name, int depth) {
+    AgentLink link;
+    if (!agentOpen(link, name, false)) return -1;
+    AgentShared* sh = link.shared;
+    ttInit(searchTable, TT_BITS);
+    printf("agent: attached to %s, playing at depth %d\n", link.name, depth);
+
+    uint64_t seen = 0;
+    int64_t plannedPiece = -1;
+    uint64_t target = 0;
+    uint8_t lastHeld = 0;
+    double handoffNs = 0, reactNs = 0, worstNs = 0;
+    int samples = 0;
+    AgentState s;
+    while (!sh->closed.load(std::memory_order_acquire)) {
+        if (sh->stateHead.load(std::memory_order_acquire) == seen) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!agentReadLatest(sh, s) || s.seq == seen) continue;
+        uint64_t readNs = agentNowNs();
+        seen = s.seq;
+        if (s.gameOver) continue;
+
+        PlacementList list;
+        generatePlacements(s.rows, s.type, s.x, s.y, s.rotation, list);
+        if (list.count == 0) continue;
+        int k = -1;
+        if (plannedPiece == s.pieces) {
+            for (int i = 0; i < list.count && k < 0; i++) {
+                if (placementFootprint(list.moves[i]) == target) k = i;
+            }
+        }
+        if (k < 0) {
+            k = 0;
+            int32_t best = INT32_MIN;
+            for (int i = 0; i < list.count; i++) {
+                int32_t v = botRootValue(s.rows, list.moves[i], s.next, depth);
+                if (v > best) { best = v; k = i; }
+            }
+            plannedPiece = s.pieces;
+            target = placementFootprint(list.moves[k]);
+        }
+
+        // Held moves repeat on the game side, so a direction is sent once
+        uint8_t in = 0;
+        switch (list.moves[k].path[0]) {
+        case MOVE_ROTATE: in = IN_ROTATE; break;
+        case MOVE_DROP: in = IN_DROP; break;
+        case MOVE_LEFT: in = IN_LEFT; break;
+        case MOVE_RIGHT: in = IN_RIGHT; break;
+        default: in = IN_DOWN; break;
+        }
+        if ((in & IN_HELD_MASK) == 0 || in != lastHeld) {
+            while (!agentSend(sh, s.seq, in)) std::this_thread::yield();
+            lastHeld = in & IN_HELD_MASK;
+        }
+
+        double handoff = (double)(readNs - s.publishNs);
+        handoffNs += handoff;
+        reactNs += (double)(agentNowNs() - readNs);
+        worstNs = max(worstNs, handoff);
+        if (++samples == AGENT_DEMO_REPORT) {
+            printf("agent: %d states, handoff %.1f us avg / %.1f us worst, decision %.1f us avg, score %d\n", samples,
+                   handoffNs / samples / 1000.0, worstNs / 1000.0, reactNs / samples / 1000.0, s.score);
+            handoffNs = reactNs = worstNs = 0;
+            samples = 0;
+        }
+    }
+    printf("agent: game closed\n");
+    agentClose(link);
+    return 0;
+}
+
+// ==================== DIFFERENTIAL VALIDATION (--validate) ====================
+// The row-mask fast paths (placementFits, the placement generator,
+// applyPlacement, rowsHash) and the incremental boardHash must behave exactly
+// like the board code the game runs: canMove, getGhostY, Piece::rotate,
+// block2Board + removeLine. --validate runs both sides on random and
+// adversarial positions on every core, and stops at the first difference with
+// the position shrunk to the fewest filled cells that still show it.
+enum ValidateCheck { CHECK_MOVE, CHECK_GHOST, CHECK_ROTATE, CHECK_CLEAR, CHECK_PATHS, VALIDATE_CHECKS };
+const char* const VALIDATE_CHECK_NAMES[] = { "canMove", "getGhostY", "Piece::rotate", "removeLine", "placement paths" };
+const int VALIDATE_PIECES_PER_BOARD = 64;     // Piece positions tried on each board
+const int VALIDATE_PATHS_EVERY = 1024;        // Cases per whole-generator check (about 200 us each)
+
+struct ValidateCase {
+    char board[H][W];
+    RowMask rows[PLAY_ROWS];                  // The board as row masks, see validatePrepare
+    uint64_t hash;                            // zobristRows of the board
+    uint32_t version;                         // Changes whenever the board does
+    int type, rotation, x, y;                 // Active piece; rotation < rotationShapes(type).rotations
+    int dx, dy;                               // Offset for CHECK_MOVE
+};
+
+std::atomic<uint32_t> validateVersions{0};
+thread_local uint32_t validateLoaded = 0;    // Version of the board in board[][], 0 = none
+
+// Refresh the derived fields after changing a case's board
+static void validatePrepare(ValidateCase& c) {
+    boardRows(c.board, c.rows);
+    c.hash = zobristRows(c.board, 0, H - 2);
+    c.version = ++validateVersions;
+}
+
+// Piece cells per type and rotation, as the Piece classes hold them
+static const char (*validateShapes())[4][4][4] {
+    static char shapes[7][4][4][4];
+    static bool built = [] {
+        for (int t = 0; t < 7; t++) {
+            Piece* p = createPieceFromType(t);
+            for (int r = 0; r < 4; r++) {
+                memcpy(shapes[t][r], p->shape, sizeof(p->shape));
+                char next[4][4];
+                p->turnedShape(next);
+                memcpy(p->shape, next, sizeof(next));
+                p->rotation = (p->rotation + 1) % 4;
+            }
+            delete p;
+        }
+        return true;
+    }();
+    (void)built;
+    return shapes;
+}
+
+static void validateSetPiece(int type, int rotation, int px, int py) {
+    currentPiece = restorePiece(currentPiece, type);
+    memcpy(currentPiece->shape, validateShapes()[type][rotation], sizeof(currentPiece->shape));
+    currentPiece->rotation = rotation;
+    x = px;
+    y = py;
+}
+
+// Make the running game the case's position. The board is only copied when
+// it changed; checks that lock a piece put back the rows they touched, or
+// reset validateLoaded when the board moved.
+static void validateLoad(const ValidateCase& c) {
+    if (validateLoaded != c.version) {
+        memcpy(board, c.board, sizeof(board));
+        boardHash = c.hash;
+        validateLoaded = c.version;
+    }
+    validateSetPiece(c.type, c.rotation, c.x, c.y);
+}
+
+// The engine's active piece as a placement at its current position
+static Placement enginePlacement() {
+    Placement p;
+    p.x = (int8_t)x;
+    p.y = (int8_t)y;
+    p.rotation = (int8_t)currentPiece->rotation;
+    for (int i = 0; i < 4; i++) {
+        p.cells[i] = 0;
+        for (int j = 0; j < 4; j++) {
+            if (currentPiece->shape[i][j] != ' ') p.cells[i] |= 1 << (x + j - 1);
+        }
+    }
+    return p;
+}
+
+// Do board[][] rows first..last match the row masks?
+static bool engineRowsEqual(const RowMask rows[PLAY_ROWS], int first = 0, int last = PLAY_ROWS - 1) {
+    for (int r = first; r <= last; r++) {
+        RowMask m = 0;
+        for (int c = 0; c < PLAY_COLS; c++) {
+            if (board[r][c + 1] != ' ') m |= 1 << c;
+        }
+        if (m != rows[r]) return false;
+    }
+    return true;
+}
+
+// Every hard-drop footprint the engine can reach from the case's position,
+// found by searching with canMove / Piece::rotate / getGhostY themselves
+static void engineReachable(const ValidateCase& c, vector<uint64_t>& out) {
+    static thread_local std::bitset<PLACE_STATES> seen;
+    static thread_local int16_t queue[PLACE_STATES];
+    seen.reset();
+    out.clear();
+    int head = 0, tail = 0;
+    auto visit = [&](int rot, int px, int py) {
+        int st = placementState(rot, py, px);
+        if (!seen.test(st)) {
+            seen.set(st);
+            queue[tail++] = (int16_t)st;
+        }
+    };
+    visit(c.rotation, c.x, c.y);
+    while (head < tail) {
+        int st = queue[head++];
+        int px = st % PLACE_XS + PLACE_X_MIN, py = st / PLACE_XS % H, rot = st / PLACE_XS / H;
+        validateSetPiece(c.type, rot, px, py);
+        y = getGhostY();
+        uint64_t footprint = placementFootprint(enginePlacement());
+        if (std::find(out.begin(), out.end(), footprint) == out.end()) out.push_back(footprint);
+        y = py;
+        if (canMove(-1, 0)) visit(rot, px - 1, py);
+        if (canMove(1, 0)) visit(rot, px + 1, py);
+        if (canMove(0, 1)) visit(rot, px, py + 1);
+        if (currentPiece->rotate(px, py)) visit(currentPiece->rotation, x, py);
+    }
+}
+
+// Run one check on a case. False (and a description in `why`) if the two
+// sides disagree; checks that need the piece to fit pass when it doesn't.
+static bool validateCheck(const ValidateCase& c, int check, string& why) {
+    char text[160];
+    RowMask rows[PLAY_ROWS];
+    const RotationShapes& s = rotationShapes(c.type);
+    validateLoad(c);
+    memcpy(rows, c.rows, sizeof(rows));
+    bool fits = placementFits(rows, s, c.rotation, c.x, c.y);
+
+    if (check == CHECK_MOVE) {
+        bool reference = canMove(c.dx, c.dy);
+        bool fast = placementFits(rows, s, c.rotation, c.x + c.dx, c.y + c.dy);
+        if (reference == fast) return true;
+        snprintf(text, sizeof(text), "canMove(%d, %d) = %d, placementFits = %d", c.dx, c.dy, reference, fast);
+    }
+    else if (!fits) {
+        return true;
+    }
+    else if (check == CHECK_GHOST) {
+        int reference = getGhostY();
+        int fast = c.y;
+        while (placementFits(rows, s, c.rotation, c.x, fast + 1)) fast++;
+        if (reference == fast) return true;
+        snprintf(text, sizeof(text), "getGhostY = %d, row-mask drop = %d", reference, fast);
+    }
+    else if (check == CHECK_ROTATE) {
+        bool reference = currentPiece->rotate(c.x, c.y);
+        bool fast = false;
+        int fastX = c.x, turned = (c.rotation + 1) % 4;
+        for (int kick : { 0, -1, 1, -2, 2 }) {
+            if (s.rotations > 1 && placementFits(rows, s, turned, c.x + kick, c.y)) {
+                fast = true;
+                fastX = c.x + kick;
+                break;
+            }
+        }
+        bool sameShape = !reference || memcmp(currentPiece->shape, validateShapes()[c.type][turned], 16) == 0;
+        if (reference == fast && (!reference || x == fastX) && sameShape) return true;
+        snprintf(text, sizeof(text), "rotate = %d to x %d%s, row-mask kick = %d to x %d", reference, x,
+                 sameShape ? "" : " (unexpected shape)", fast, fastX);
+    }
+    else if (check == CHECK_CLEAR) {
+        y = getGhostY();
+        Placement p = enginePlacement();
+        block2Board();
+        int reference = removeLine();
+        int fast = applyPlacement(rows, p);
+        bool sameRows, sameHash;
+        if (reference == 0 && fast == 0) {
+            // Nothing moved: only the piece's rows changed, so only they are compared and put back
+            int first = y, last = min(y + 3, H - 2);
+            sameRows = engineRowsEqual(rows, first, last);
+            sameHash = boardHash == (c.hash ^ zobristRows(c.board, first, last) ^ zobristRows(board, first, last));
+            memcpy(board[first], c.board[first], (last - first + 1) * sizeof(board[0]));
+            boardHash = c.hash;
+        } else {
+            sameRows = engineRowsEqual(rows);
+            sameHash = boardHash == rowsHash(rows) && boardHash == zobristRows(board, 0, H - 2);
+            validateLoaded = 0;
+        }
+        if (reference == fast && sameRows && sameHash) return true;
+        snprintf(text, sizeof(text), "removeLine cleared %d, applyPlacement %d%s%s", reference, fast,
+                 sameRows ? "" : ", boards differ", sameHash ? "" : ", hashes differ");
+    }
+    else {
+        static thread_local PlacementList list;
+        static thread_local vector<uint64_t> reachable;
+        generatePlacements(rows, c.type, c.x, c.y, c.rotation, list);
+        engineReachable(c, reachable);
+        if ((int)reachable.size() != list.count && (int)reachable.size() <= MAX_PLACEMENTS) {
+            snprintf(text, sizeof(text), "engine reaches %d placements, generator found %d", (int)reachable.size(),
+                     list.count);
+            why = text;
+            return false;
+        }
+        for (int k = 0; k < list.count; k++) {
+            const Placement& p = list.moves[k];
+            validateLoad(c);
+            bool moved = true;
+            for (int m = 0; m < p.pathLength && moved; m++) {
+                switch (p.path[m]) {
+                case MOVE_LEFT: moved = canMove(-1, 0); x -= moved; break;
+                case MOVE_RIGHT: moved = canMove(1, 0); x += moved; break;
+                case MOVE_DOWN: moved = canMove(0, 1); y += moved; break;
+                case MOVE_ROTATE: moved = currentPiece->rotate(x, y); break;
+                case MOVE_DROP: y = getGhostY(); break;
+                }
+            }
+            uint64_t footprint = placementFootprint(enginePlacement());
+            bool found = std::find(reachable.begin(), reachable.end(), footprint) != reachable.end();
+            if (moved && footprint == placementFootprint(p) && found) {
+                block2Board();
+                validateLoaded = 0;
+                int lines = removeLine();
+                RowMask after[PLAY_ROWS];
+                memcpy(after, rows, sizeof(after));
+                applyPlacement(after, p);
+                if (lines == p.lines && engineRowsEqual(after)) continue;
+            }
+            snprintf(text, sizeof(text), "placement %d (x %d, y %d, rotation %d, %d moves) %s", k, p.x, p.y,
+                     p.rotation, p.pathLength,
+                     !moved ? "has a move the engine refuses" : !found ? "is not reachable by the engine" :
+                     footprint != placementFootprint(p) ? "locks somewhere else in the engine" :
+                     "clears differently in the engine");
+            why = text;
+            return false;
+        }
+        return true;
+    }
+    why = text;
+    return false;
+}
+
+static uint32_t validateRandom(uint64_t& rng, uint32_t n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 32) % n;
+}
+
+// Random boards, biased towards the awkward ones: near-full and full rows,
+// a filled top row (which removeLine never clears), towers, wells and noise
+static void validateRandomBoard(uint64_t& rng, ValidateCase& c) {
+    auto next = [&rng](uint32_t n) { return validateRandom(rng, n); };
+    for (int i = 0; i < H; i++) {
+        for (int j = 0; j < W; j++) {
+            c.board[i][j] = (j == 0 || j == W - 1 || i == H - 1) ? '#' : ' ';
+        }
+    }
+    int style = next(6);
+    int height = 1 + next(H - 1);
+    for (int i = H - 1 - height; i < H - 1; i++) {
+        int hole = 1 + next(W - 2);
+        for (int j = 1; j < W - 1; j++) {
+            bool filled = false;
+            switch (style) {
+            case 0: filled = false; break;                                   // Empty
+            case 1: filled = (int)next(100) < 25 + height * 3; break;            // Noise
+            case 2: filled = j != hole || next(4) == 0; break;               // Near-full and full rows
+            case 3: filled = (i + j) % 2 == 0; break;                        // Checkerboard
+            case 4: filled = j <= 2 || j >= W - 3 || next(8) == 0; break;    // Towers at the walls
+            default: filled = j != hole && next(3) != 0; break;              // Rows with wells
+            }
+            if (filled) c.board[i][j] = "IOTSZJLX"[next(8)];
+        }
+    }
+    if (next(8) == 0) {
+        for (int j = 1; j < W - 1; j++) {
+            if (next(2)) c.board[0][j] = 'X';
+        }
+    }
+    validatePrepare(c);
+}
+
+// Random piece and move on the case's board: mostly positions the piece fits
+// in, sometimes anything (collisions, walls)
+static void validateRandomPiece(uint64_t& rng, ValidateCase& c) {
+    auto next = [&rng](uint32_t n) { return validateRandom(rng, n); };
+    c.type = next(7);
+    c.rotation = next(rotationShapes(c.type).rotations);
+    const RotationShapes& s = rotationShapes(c.type);
+    for (int tries = 0; tries < 16; tries++) {
+        c.x = PLACE_X_MIN + (int)next(W + 1);
+        c.y = tries == 0 && next(2) ? 0 : (int)next(H - 1);
+        if (placementFits(c.rows, s, c.rotation, c.x, c.y) || next(8) == 0) break;
+    }
+    static const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, 1 }, { 0, 0 } };
+    int o = next(4);
+    c.dx = offsets[o][0];
+    c.dy = offsets[o][1];
+}
+
+// Clear filled cells one at a time while the case still fails
+static void validateShrink(ValidateCase& c, int check) {
+    string why;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = 0; i < H - 1; i++) {
+            for (int j = 1; j < W - 1; j++) {
+                if (c.board[i][j] == ' ') continue;
+                char cell = c.board[i][j];
+                c.board[i][j] = ' ';
+                validatePrepare(c);
+                if (!validateCheck(c, check, why)) {
+                    changed = true;
+                    continue;
+                }
+                c.board[i][j] = cell;
+                validatePrepare(c);
+            }
+        }
+    }
+}
+
+static void validatePrint(const ValidateCase& c, int check) {
+    string why;
+    validateCheck(c, check, why);
+    int filled = 0;
+    for (int i = 0; i < H - 1; i++) {
+        for (int j = 1; j < W - 1; j++) filled += c.board[i][j] != ' ';
+    }
+    printf("validate: %s differs: %s\n", VALIDATE_CHECK_NAMES[check], why.c_str());
+    printf("  %c piece, rotation %d, x %d, y %d", "IOTSZJL"[c.type], c.rotation, c.x, c.y);
+    if (check == CHECK_MOVE) printf(", move (%d, %d)", c.dx, c.dy);
+    printf("\n  board with %d filled cells (@ = piece):\n", filled);
+    const char (*shape)[4] = validateShapes()[c.type][c.rotation];
+    for (int i = 0; i < H; i++) {
+        char line[W + 1];
+        for (int j = 0; j < W; j++) {
+            int si = i - c.y, sj = j - c.x;
+            bool piece = si >= 0 && si < 4 && sj >= 0 && sj < 4 && shape[si][sj] != ' ';
+            line[j] = piece ? '@' : c.board[i][j] == ' ' ? '.' : c.board[i][j];
+        }
+        line[W] = '\0';
+        printf("  %s\n", line);
+    }
+}
+
+// Run for `seconds` on `threads` threads, or until the first difference
+int runValidation(double seconds, int threads) {
+    if (seconds <= 0) seconds = 10;
+    if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> counts[VALIDATE_CHECKS] = {};
+    std::atomic<bool> failed{false};
+    ValidateCase failure;
+    int failedCheck = -1;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+
+    auto worker = [&](int self) {
+        simSilent = true;
+        uint64_t rng = 0x9E3779B97F4A7C15ull * (self + 1) ^ (uint64_t)time(0);
+        uint64_t local[VALIDATE_CHECKS] = {};
+        ValidateCase c;
+        string why;
+        for (uint64_t n = 0; !stop.load(std::memory_order_relaxed); n++) {
+            if (n % VALIDATE_PIECES_PER_BOARD == 0) {
+                if (chrono::steady_clock::now() >= deadline) break;
+                validateRandomBoard(rng, c);
+            }
+            validateRandomPiece(rng, c);
+            for (int check = 0; check < VALIDATE_CHECKS; check++) {
+                if (check == CHECK_PATHS && n % VALIDATE_PATHS_EVERY) continue;
+                local[check]++;
+                if (validateCheck(c, check, why)) continue;
+                bool expected = false;
+                if (failed.compare_exchange_strong(expected, true)) {
+                    failure = c;
+                    failedCheck = check;
+                }
+                stop = true;
+                break;
+            }
+        }
+        for (int k = 0; k < VALIDATE_CHECKS; k++) counts[k] += local[k];
+        delete currentPiece;
+        currentPiece = nullptr;
+    };
+    vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) pool.emplace_back(worker, t);
+    for (std::thread& t : pool) t.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    uint64_t cases = counts[CHECK_MOVE];
+    printf("validate: %llu cases in %.1f s on %d threads (%.2f M/s)\n", (unsigned long long)cases, elapsed, threads,
+           cases / elapsed / 1e6);
+    for (int k = 0; k < VALIDATE_CHECKS; k++) {
+        printf("  %-16s %llu\n", VALIDATE_CHECK_NAMES[k], (unsigned long long)counts[k].load());
+    }
+    if (!failed) {
+        printf("validate: no differences\n");
+        return 0;
+    }
+    simSilent = true;
+    validateShrink(failure, failedCheck);
+    validatePrint(failure, failedCheck);
+    delete currentPiece;
+    currentPiece = nullptr;
+    return 1;
+}
+
+// ==================== VERSUS NETPLAY (ROLLBACK) ====================
+// Two processes play against each other over UDP. Each process simulates
+// both boards from both players' inputs. Remote input that hasn't arrived
+// yet is predicted (held keys stay held, presses don't repeat); when the real
+// input turns out different, both boards are restored from the snapshot of
+// that tick and re-simulated up to the present. Local input never waits for
+// the network, only a peer that falls NET_MAX_ROLLBACK ticks behind stalls us.
+const int NET_HISTORY = 64;           // Ticks of snapshots/inputs kept (power of two)
+const int NET_MAX_ROLLBACK = 30;      // Ticks we may run ahead of confirmed remote input
+const float NET_TIMEOUT = 5.f;        // Seconds without packets before giving up
+const float NET_HELLO_INTERVAL = 0.2f; // Seconds between connection attempts
+const uint8_t NET_MAGIC = 'T';
+const int NET_PACKET_MAX = 96;
+const int NET_CHECK_TICKS = 60;       // Ticks between board hash checks
+const int NET_CHECKS = 8;             // Recent checks kept per side
+
+enum NetPacketType : uint8_t {
+    NET_HELLO = 1,    // Client -> host: let me in
+    NET_WELCOME = 2,  // Host -> client: u32 seed
+    NET_INPUTS = 3,   // u32 ack, u32 first tick, u8 count, i8 advantage, inputs[count]
+    NET_CHECK = 4,    // u32 tick, u64 hash of both boards at that tick
+};
+
+enum class VersusPhase { CONNECTING, RUNNING, FINISHED, DISCONNECTED, DESYNC };
+
+// Hash of both boards at a confirmed tick
+struct NetCheck {
+    int tick = -1;
+    uint64_t hash = 0;
+};
+
+struct VersusMatch {
+    bool active = false;
+    bool isHost = false;
+    VersusPhase phase = VersusPhase::CONNECTING;
+
+    // Connection
+    sf::UdpSocket socket;
+    std::optional<sf::IpAddress> peerAddress;
+    unsigned short peerPort = 0;
+    float sinceLastPacket = 0.f;
+    float helloTimer = 0.f;
+
+    // Artificial send delay for testing rollback over loopback (--lag)
+    int lagMs = 0;
+    sf::Clock lagClock;
+    struct DelayedPacket { int32_t sendAtMs; int size; uint8_t data[NET_PACKET_MAX]; };
+    DelayedPacket lagQueue[128];
+    int lagHead = 0, lagCount = 0;
+
+    // Simulation
+    uint32_t seed = 0;
+    int localSide = 0;                      // Board index of this process (host = 0)
+    int frame = 0;                          // Next tick to simulate
+    int remoteKnown = 0;                    // Remote input is confirmed for all ticks before this
+    int peerAck = 0;                        // Peer has our input for all ticks before this
+    int peerFrame = 0;                      // Latest tick the peer reported
+    int peerAdvantage = 0;                  // How far the peer says it is ahead of us
+    int rollbackFrom = -1;                  // Earliest tick simulated with a wrong prediction
+    uint8_t lastRemoteInput = 0;            // Latest confirmed remote input
+    uint8_t remoteInputs[NET_HISTORY];      // Confirmed remote input per tick
+    uint8_t inputs[NET_HISTORY][2];         // Input each board used per tick
+    SimState current[2];                    // Both boards at tick `frame`
+    SimState history[NET_HISTORY][2];       // Both boards at the start of each recent tick
+    int winner = -1;                        // Winning board once FINISHED (-1 = draw)
+    int rollbacks = 0;
+
+    // Desync detection: both processes hash both boards every NET_CHECK_TICKS
+    // confirmed ticks and compare. Any difference means the simulations split.
+    int nextCheck = 0;                      // Next tick to hash
+    NetCheck localChecks[NET_CHECKS];
+    NetCheck peerChecks[NET_CHECKS];
+    int desyncTick = -1;
+};
+VersusMatch versus;
+
+static void putU32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t getU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Send a packet to the peer, through the lag queue if --lag is set
+static void versusSend(VersusMatch& m, const uint8_t* data, int size) {
+    if (!m.peerAddress) return;
+    if (m.lagMs <= 0) {
+        (void)m.socket.send(data, size, *m.peerAddress, m.peerPort);
+        return;
+    }
+    if (m.lagCount == 128) return;  // Queue full: behave like a lost packet
+    VersusMatch::DelayedPacket& d = m.lagQueue[(m.lagHead + m.lagCount) % 128];
+    d.sendAtMs = m.lagClock.getElapsedTime().asMilliseconds() + m.lagMs;
+    d.size = size;
+    memcpy(d.data, data, size);
+    m.lagCount++;
+}
+
+static void versusFlushLag(VersusMatch& m) {
+    int32_t now = m.lagClock.getElapsedTime().asMilliseconds();
+    while (m.lagCount > 0 && m.lagQueue[m.lagHead].sendAtMs <= now) {
+        const VersusMatch::DelayedPacket& d = m.lagQueue[m.lagHead];
+        (void)m.socket.send(d.data, d.size, *m.peerAddress, m.peerPort);
+        m.lagHead = (m.lagHead + 1) % 128;
+        m.lagCount--;
+    }
+}
+
+// Remote input for a tick: the real one if it arrived, otherwise a prediction
+static uint8_t versusRemoteInput(const VersusMatch& m, int tick) {
+    if (tick < m.remoteKnown) return m.remoteInputs[tick % NET_HISTORY];
+    return m.lastRemoteInput & IN_HELD_MASK;
+}
+
+// Simulate one tick of both boards, then hand over the garbage they produced
+static void versusStepTick(VersusMatch& m, int tick, bool resimulating) {
+    for (int side = 0; side < 2; side++) {
+        loadSim(m.current[side]);
+        simSilent = resimulating || side != m.localSide;
+        simTick(m.inputs[tick % NET_HISTORY][side]);
+        saveSim(m.current[side]);
+    }
+    simSilent = false;
+
+    for (int side = 0; side < 2; side++) {
+        m.current[1 - side].garbageIn += m.current[side].garbageOut;
+        m.current[side].garbageOut = 0;
+    }
+}
+
+// Restore the first mispredicted tick and re-simulate up to the present
+static void versusRollback(VersusMatch& m) {
+    if (m.rollbackFrom < 0) return;
+    int from = m.rollbackFrom;
+    m.rollbackFrom = -1;
+    m.rollbacks++;
+
+    m.current[0] = m.history[from % NET_HISTORY][0];
+    m.current[1] = m.history[from % NET_HISTORY][1];
+    for (int tick = from; tick < m.frame; tick++) {
+        int slot = tick % NET_HISTORY;
+        m.history[slot][0] = m.current[0];
+        m.history[slot][1] = m.current[1];
+        m.inputs[slot][1 - m.localSide] = versusRemoteInput(m, tick);
+        versusStepTick(m, tick, true);
+    }
+}
+
+// Simulate the next tick with the local input and the (predicted) remote input
+static void versusAdvance(VersusMatch& m, uint8_t localInput) {
+    int slot = m.frame % NET_HISTORY;
+    m.history[slot][0] = m.current[0];
+    m.history[slot][1] = m.current[1];
+    m.inputs[slot][m.localSide] = localInput;
+    m.inputs[slot][1 - m.localSide] = versusRemoteInput(m, m.frame);
+    versusStepTick(m, m.frame, false);
+    m.frame++;
+}
+
+// Compare a local and a peer check of the same tick
+static void versusCompareCheck(VersusMatch& m, const NetCheck& a, const NetCheck& b) {
+    if (a.tick != b.tick || a.tick < 0 || a.hash == b.hash || m.phase == VersusPhase::DESYNC) return;
+    m.phase = VersusPhase::DESYNC;
+    m.desyncTick = a.tick;
+    printf("versus: boards out of sync at tick %d\n", a.tick);
+}
+
+// Hash every checkpoint tick whose inputs are all confirmed. history[t]
+// holds the boards at the start of tick t, so it is final once t <= remoteKnown.
+static void versusMakeChecks(VersusMatch& m) {
+    while (m.nextCheck <= m.remoteKnown && m.nextCheck < m.frame) {
+        int t = m.nextCheck;
+        m.nextCheck += NET_CHECK_TICKS;
+        if (m.frame - t > NET_HISTORY) continue;  // Already overwritten
+        uint64_t b = simHash(m.history[t % NET_HISTORY][1]);
+        NetCheck& c = m.localChecks[t / NET_CHECK_TICKS % NET_CHECKS];
+        c.tick = t;
+        c.hash = simHash(m.history[t % NET_HISTORY][0]) ^ (b << 1 | b >> 63);
+        versusCompareCheck(m, c, m.peerChecks[t / NET_CHECK_TICKS % NET_CHECKS]);
+    }
+}
+
+static void versusReceiveCheck(VersusMatch& m, int tick, uint64_t hash) {
+    if (tick < 0 || tick % NET_CHECK_TICKS) return;
+    NetCheck& c = m.peerChecks[tick / NET_CHECK_TICKS % NET_CHECKS];
+    c.tick = tick;
+    c.hash = hash;
+    versusCompareCheck(m, m.localChecks[tick / NET_CHECK_TICKS % NET_CHECKS], c);
+}
+
+// Both processes start both boards from the same seed
+static void versusBegin(VersusMatch& m, uint32_t seed) {
+    m.seed = seed;
+    m.phase = VersusPhase::RUNNING;
+    m.frame = 0;
+    m.remoteKnown = 0;
+    m.peerAck = 0;
+    m.rollbackFrom = -1;
+    m.lastRemoteInput = 0;
+    m.sinceLastPacket = 0.f;
+    m.nextCheck = 0;
+    for (int i = 0; i < NET_CHECKS; i++) m.localChecks[i] = m.peerChecks[i] = NetCheck{};
+    resetGame(seed);
+    saveSim(m.current[0]);
+    m.current[1] = m.current[0];
+}
+
+// Store confirmed remote inputs and note the first one we predicted wrong
+static void versusReceiveInputs(VersusMatch& m, int first, const uint8_t* in, int count) {
+    for (int i = 0; i < count; i++) {
+        int tick = first + i;
+        if (tick != m.remoteKnown) continue;  // Already have it, or a gap before it
+        uint8_t input = in[i];
+        m.remoteInputs[tick % NET_HISTORY] = input;
+        if (tick < m.frame && m.inputs[tick % NET_HISTORY][1 - m.localSide] != input) {
+            if (m.rollbackFrom < 0 || tick < m.rollbackFrom) m.rollbackFrom = tick;
+        }
+        m.lastRemoteInput = input;
+        m.remoteKnown++;
+    }
+}
+
+static void versusPoll(VersusMatch& m) {
+    uint8_t buf[NET_PACKET_MAX];
+    std::size_t received = 0;
+    std::optional<sf::IpAddress> sender;
+    unsigned short senderPort = 0;
+
+    while (m.socket.receive(buf, sizeof(buf), received, sender, senderPort) == sf::Socket::Status::Done) {
+        if (received < 2 || buf[0] != NET_MAGIC || !sender) continue;
+
+        if (buf[1] == NET_HELLO && m.isHost) {
+            // First client wins; a repeated HELLO means our WELCOME got lost
+            if (m.phase == VersusPhase::CONNECTING) {
+                m.peerAddress = sender;
+                m.peerPort = senderPort;
+                versusBegin(m, m.seed);
+            }
+            if (sender == m.peerAddress && senderPort == m.peerPort) {
+                uint8_t welcome[6] = { NET_MAGIC, NET_WELCOME };
+                putU32(welcome + 2, m.seed);
+                versusSend(m, welcome, sizeof(welcome));
+            }
+            continue;
+        }
+
+        if (sender != m.peerAddress || senderPort != m.peerPort) continue;
+        m.sinceLastPacket = 0.f;
+
+        if (buf[1] == NET_WELCOME && !m.isHost && received >= 6) {
+            if (m.phase == VersusPhase::CONNECTING) versusBegin(m, getU32(buf + 2));
+        }
+        else if (buf[1] == NET_INPUTS && received >= 12 && m.phase != VersusPhase::CONNECTING) {
+            int count = buf[10];
+            if ((int)received < 12 + count) continue;
+            m.peerAck = max(m.peerAck, (int)getU32(buf + 2));
+            int first = (int)getU32(buf + 6);
+            m.peerFrame = max(m.peerFrame, first + count);
+            m.peerAdvantage = (int8_t)buf[11];
+            versusReceiveInputs(m, first, buf + 12, count);
+        }
+        else if (buf[1] == NET_CHECK && received >= 14 && m.phase != VersusPhase::CONNECTING) {
+            uint64_t hash = (uint64_t)getU32(buf + 6) | (uint64_t)getU32(buf + 10) << 32;
+            versusReceiveCheck(m, (int)getU32(buf + 2), hash);
+        }
+    }
+}
+
+// Send every local input the peer hasn't acknowledged yet
+static void versusSendInputs(VersusMatch& m) {
+    int first = max(m.peerAck, m.frame - (NET_HISTORY - 4));
+    int count = min(m.frame - first, NET_PACKET_MAX - 12);
+    uint8_t buf[NET_PACKET_MAX] = { NET_MAGIC, NET_INPUTS };
+    putU32(buf + 2, (uint32_t)m.remoteKnown);
+    putU32(buf + 6, (uint32_t)first);
+    buf[10] = (uint8_t)count;
+    buf[11] = (uint8_t)(int8_t)max(-127, min(127, m.frame - m.peerFrame));
+    for (int i = 0; i < count; i++) buf[12 + i] = m.inputs[(first + i) % NET_HISTORY][m.localSide];
+    versusSend(m, buf, 12 + count);
+
+    // The latest check rides along with every input packet; losing some is fine
+    if (m.nextCheck >= NET_CHECK_TICKS) {
+        const NetCheck& c = m.localChecks[(m.nextCheck / NET_CHECK_TICKS - 1) % NET_CHECKS];
+        if (c.tick < 0) return;
+        uint8_t check[14] = { NET_MAGIC, NET_CHECK };
+        putU32(check + 2, (uint32_t)c.tick);
+        putU32(check + 6, (uint32_t)c.hash);
+        putU32(check + 10, (uint32_t)(c.hash >> 32));
+        versusSend(m, check, sizeof(check));
+    }
+}
+
+// Open the socket: the host listens on `port`, the client talks to host:port
+bool versusStart(VersusMatch& m, bool host, const string& address, unsigned short port) {
+    m.active = true;
+    m.isHost = host;
+    m.localSide = host ? 0 : 1;
+    m.socket.setBlocking(false);
+    if (host) {
+        m.seed = makeSeed();
+        if (m.socket.bind(port) != sf::Socket::Status::Done) {
+            fprintf(stderr, "versus: cannot listen on port %u\n", port);
+            return false;
+        }
+        printf("versus: waiting for an opponent on port %u\n", port);
+    } else {
+        m.peerAddress = sf::IpAddress::resolve(address);
+        m.peerPort = port;
+        if (!m.peerAddress || m.socket.bind(sf::Socket::AnyPort) != sf::Socket::Status::Done) {
+            fprintf(stderr, "versus: cannot reach %s\n", address.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Per-frame update: network, rollback, then as many ticks as time allows.
+// Afterwards the global game state holds the local board for drawing.
+void versusUpdate(VersusMatch& m, float dt, float& tickTimer, uint8_t heldInput, uint8_t& pressedInput) {
+    m.sinceLastPacket += dt;
+    if (m.lagMs > 0) versusFlushLag(m);
+    versusPoll(m);
+
+    if (m.phase == VersusPhase::CONNECTING) {
+        tickTimer = 0.f;
+        pressedInput = 0;
+        m.helloTimer += dt;
+        if (!m.isHost && m.helloTimer >= NET_HELLO_INTERVAL) {
+            uint8_t hello[2] = { NET_MAGIC, NET_HELLO };
+            versusSend(m, hello, sizeof(hello));
+            m.helloTimer = 0.f;
+        }
+        return;
+    }
+
+    if (m.phase == VersusPhase::RUNNING) {
+        versusRollback(m);
+
+        while (tickTimer >= TICK_SECONDS) {
+            // Too far ahead of the peer: wait instead of predicting further
+            if (m.frame - m.remoteKnown >= NET_MAX_ROLLBACK) {
+                tickTimer = TICK_SECONDS;
+                break;
+            }
+            tickTimer -= TICK_SECONDS;
+
+            // Ahead of the peer by more than it is ahead of us: give up a tick now and then
+            if ((m.frame - m.peerFrame) - m.peerAdvantage >= 4 && m.frame % 4 == 0) continue;
+
+            versusAdvance(m, heldInput | pressedInput);
+            pressedInput = 0;
+        }
+
+        // The match ends once a top-out is confirmed by real inputs from both sides
+        const SimState* confirmed = (m.remoteKnown >= m.frame) ? m.current : m.history[m.remoteKnown % NET_HISTORY];
+        if (confirmed[0].isGameOver || confirmed[1].isGameOver) {
+            m.phase = VersusPhase::FINISHED;
+            if (confirmed[0].isGameOver != confirmed[1].isGameOver) {
+                m.winner = confirmed[0].isGameOver ? 1 : 0;
+            }
+            printf("versus: finished after %d ticks, %d rollbacks\n", m.frame, m.rollbacks);
+        }
+        versusMakeChecks(m);
+    }
+
+    // Keep sending after the end so the peer can confirm it too
+    versusSendInputs(m);
+    if (m.phase == VersusPhase::RUNNING && m.sinceLastPacket > NET_TIMEOUT) {
+        m.phase = VersusPhase::DISCONNECTED;
+    }
+
+    loadSim(m.current[m.localSide]);
+}
+
+// Draw a board snapshot at a horizontal offset (the opponent's board)
+void drawSimBoard(sf::RenderWindow& window, const SimState& s, float offsetX) {
+    static RectangleShape rect(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));
+    for (int i = 0; i < H; i++) {
+        for (int j = 0; j < W; j++) {
+            if (s.board[i][j] != ' ') {
+                rect.setPosition(Vector2f(offsetX + j * TILE_SIZE, i * TILE_SIZE));
+                rect.setFillColor(getColor(s.board[i][j]));
+                window.draw(rect);
+            }
+        }
+    }
+    if (!s.isGameOver) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (s.pieceShape[i][j] != ' ') {
+                    rect.setPosition(Vector2f(offsetX + (s.x + j) * TILE_SIZE, (s.y + i) * TILE_SIZE));
+                    rect.setFillColor(getColor(s.pieceShape[i][j]));
+                    window.draw(rect);
+                }
+            }
+        }
+    }
+}
+
+// Garbage waiting to come in, drawn as a red bar over a board's left wall
+static void drawGarbageMeter(sf::RenderWindow& window, int rows, float offsetX) {
+    if (rows <= 0) return;
+    float h = (float)min(rows, H - 1) * TILE_SIZE;
+    static RectangleShape bar;
+    bar.setSize(Vector2f(TILE_SIZE / 3.f, h));
+    bar.setPosition(Vector2f(offsetX + TILE_SIZE / 3.f, (H - 1) * TILE_SIZE - h));
+    bar.setFillColor(Color(255, 40, 40));
+    window.draw(bar);
+}
+
+// Opponent board, garbage meters and match status text
+void drawVersus(sf::RenderWindow& window, const sf::Font& font, const VersusMatch& m) {
+    const float opponentX = PLAY_W_PX + SIDEBAR_W;
+    const SimState& local = m.current[m.localSide];
+    const SimState& remote = m.current[1 - m.localSide];
+
+    if (m.phase != VersusPhase::CONNECTING) {
+        drawSimBoard(window, remote, opponentX);
+        drawGarbageMeter(window, local.garbageIn, 0.f);
+        drawGarbageMeter(window, remote.garbageIn, opponentX);
+        char label[32];
+        snprintf(label, sizeof(label), "OPPONENT %d", remote.gScore);
+        drawText(window, font, label, opponentX + 40.f, 4.f, 16);
+    }
+
+    const char* status = nullptr;
+    Color color = Color::White;
+    if (m.phase == VersusPhase::CONNECTING) {
+        status = m.isHost ? "WAITING FOR OPPONENT" : "CONNECTING...";
+    } else if (m.phase == VersusPhase::DISCONNECTED) {
+        status = "CONNECTION LOST";
+        color = Color::Red;
+    } else if (m.phase == VersusPhase::DESYNC) {
+        status = "OUT OF SYNC";
+        color = Color::Red;
+    } else if (m.phase == VersusPhase::FINISHED) {
+        status = (m.winner < 0) ? "DRAW" : (m.winner == m.localSide ? "YOU WIN" : "YOU LOSE");
+        color = (m.winner == m.localSide) ? Color::Green : Color::Red;
+    }
+    if (!status) return;
+
+    const float fullW = opponentX + PLAY_W_PX;
+    RectangleShape overlay(Vector2f(fullW, PLAY_H_PX));
+    overlay.setFillColor(Color(0, 0, 0, 160));
+    window.draw(overlay);
+
+    Text text(font, status, 40);
+    text.setFillColor(color);
+    text.setPosition(sf::Vector2f{(fullW - text.getLocalBounds().size.x) / 2.f, 240.f});
+    window.draw(text);
+    if (m.phase != VersusPhase::CONNECTING) {
+        Text hint(font, "Press Enter or click to exit", 18);
+        hint.setFillColor(Color::White);
+        hint.setPosition(sf::Vector2f{(fullW - hint.getLocalBounds().size.x) / 2.f, 310.f});
+        window.draw(hint);
+    }
+}
+
+// ==================== BATTLE ROYALE (--royale) ====================
+// Headless stress mode: many bot games at once that attack each other with
+// the garbage their clears produce (GARBAGE_TABLE, the same rules as
+// versus). Play advances in epochs of ROYALE_EPOCH_TICKS ticks. Within an
+// epoch every board is independent: workers take boards from per-worker
+// slices and steal from each other the way the replay analyzer does, run
+// the epoch on their own engine (loadSim/saveSim) and post the garbage they
+// send to the target's mailbox with one atomic add. Mailboxes alternate by
+// epoch parity, so garbage sent in epoch e is collected at the start of
+// e + 1 while e + 1's garbage goes to the other slot. The epoch barrier plus
+// targets picked from the seed and the boards alive at the epoch's start
+// make a result depend only on the seed and the player count, never on the
+// thread count or timing.
+const int ROYALE_EPOCH_TICKS = 6;            // Garbage arrives at most this late (100 ms)
+const int ROYALE_MAX_TICKS = 60 * 60 * 20;   // A match ends after 20 minutes of game time
+
+struct alignas(64) RoyalePlayer {
+    SimState sim;
+    BotPlan plan;
+    GameStats stats;
+    std::atomic<int> mailbox[2];             // Incoming garbage, by epoch parity
+    int linesSent = 0, linesReceived = 0;
+    int koTick = -1;                         // Game tick it topped out at, -1 = alive
+};
+
+struct RoyaleMatch {
+    vector<RoyalePlayer> players;
+    vector<uint32_t> alive;                  // Boards still playing when the epoch started
+    vector<TaskRange> ranges;                // One slice of `alive` per worker
+    uint64_t seed = 0;
+    int epoch = 0;
+    std::atomic<uint64_t> steals{0};
+};
+
+// Deterministic target of one player's garbage in an epoch: any other live board
+static uint32_t royaleTarget(const RoyaleMatch& m, uint32_t from) {
+    uint64_t state = m.seed ^ (uint64_t)from << 32 ^ (uint64_t)m.epoch * 0x9E3779B97F4A7C15ull;
+    uint32_t k = (uint32_t)(splitMix64(state) % (m.alive.size() - 1));
+    uint32_t target = m.alive[k];
+    return target == from ? m.alive.back() : target;  // Skip ourselves
+}
+
+// One board for one epoch, on the calling thread's engine
+static void royaleRunPlayer(RoyaleMatch& m, uint32_t i) {
+    RoyalePlayer& p = m.players[i];
+    loadSim(p.sim);
+    botPlan = p.plan;
+    gStats = p.stats;
+    int incoming = p.mailbox[m.epoch & 1].exchange(0, std::memory_order_relaxed);
+    garbageIn += incoming;
+    p.linesReceived += incoming;
+
+    for (int t = 0; t < ROYALE_EPOCH_TICKS && !isGameOver; t++) simTick(botInput());
+
+    if (garbageOut > 0 && m.alive.size() > 1) {
+        uint32_t target = royaleTarget(m, i);
+        m.players[target].mailbox[(m.epoch + 1) & 1].fetch_add(garbageOut, std::memory_order_relaxed);
+        p.linesSent += garbageOut;
+    }
+    garbageOut = 0;
+    if (isGameOver) p.koTick = gameTick;
+    saveSim(p.sim);
+    p.plan = botPlan;
+    p.stats = gStats;
+}
+
+static void royaleWork(RoyaleMatch& m, int self) {
+    uint32_t task;
+    while (true) {
+        if (takeTask(m.ranges[self], task)) {
+            royaleRunPlayer(m, m.alive[task]);
+        } else if (stealTasks(m.ranges, self)) {
+            m.steals.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            return;
+        }
+    }
+}
+
+// --royale [players] [seed] [threads] [depth]: play a match to the last
+// board standing and print the standings, throughput and a result hash that
+// must not change with the thread count
+int runRoyale(int playerCount, uint32_t seed, int threads, int depth) {
+    if (playerCount < 2) {
+        fprintf(stderr, "royale: needs at least 2 players\n");
+        return -1;
+    }
+    if (threads <= 0) threads = max(1u, std::thread::hardware_concurrency());
+    bot.depth = max(1, min(2, depth));       // Depth 3 starts its own threads every piece
+    bot.threads = 1;
+    ttInit(searchTable, TT_BITS);
+
+    RoyaleMatch m;
+    m.seed = seed;
+    m.players = vector<RoyalePlayer>(playerCount);
+    m.ranges = vector<TaskRange>(threads);
+    simSilent = true;
+    uint64_t seedState = seed;
+    for (int i = 0; i < playerCount; i++) {
+        RoyalePlayer& p = m.players[i];
+        gStats = GameStats{};
+        resetGame((uint32_t)splitMix64(seedState));
+        saveSim(p.sim);
+        p.stats = gStats;
+        p.mailbox[0] = 0;
+        p.mailbox[1] = 0;
+    }
+
+    // Workers wait for an epoch number, run it and report back; the calling
+    // thread works as worker 0 and closes every epoch
+    std::mutex lock;
+    std::condition_variable wake, done;
+    int started = 0, running = 0;
+    bool quit = false;
+    auto worker = [&](int self) {
+        traceSetThreadName("royale");
+        simSilent = true;
+        int seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> l(lock);
+                wake.wait(l, [&] { return quit || started != seen; });
+                if (quit) break;
+                seen = started;
+            }
+            royaleWork(m, self);
+            std::lock_guard<std::mutex> l(lock);
+            if (--running == 0) done.notify_one();
+        }
+        delete currentPiece;
+        delete nextPiece;
+        currentPiece = nextPiece = nullptr;
+    };
+    vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker, t);
+
+    auto start = chrono::steady_clock::now();
+    uint64_t playerTicks = 0;
+    int ticks = 0;
+    for (int i = 0; i < playerCount; i++) m.alive.push_back(i);
+    while (m.alive.size() > 1 && ticks < ROYALE_MAX_TICKS) {
+        TRACE_SCOPE("royale.epoch");
+        uint32_t n = (uint32_t)m.alive.size();
+        for (int t = 0; t < threads; t++) {
+            m.ranges[t].range.store(packRange(n * t / threads, n * (t + 1) / threads));
+        }
+        {
+            std::lock_guard<std::mutex> l(lock);
+            running = threads - 1;
+            started++;
+        }
+        wake.notify_all();
+        royaleWork(m, 0);
+        {
+            std::unique_lock<std::mutex> l(lock);
+            done.wait(l, [&] { return running == 0; });
+        }
+
+        playerTicks += (uint64_t)n * ROYALE_EPOCH_TICKS;
+        ticks += ROYALE_EPOCH_TICKS;
+        m.epoch++;
+        m.alive.erase(std::remove_if(m.alive.begin(), m.alive.end(),
+                                     [&](uint32_t i) { return m.players[i].koTick >= 0; }),
+                      m.alive.end());
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    {
+        std::lock_guard<std::mutex> l(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : pool) t.join();
+
+    // Standings: survivors first (by lines), then the latest knockouts
+    vector<uint32_t> order(playerCount);
+    for (int i = 0; i < playerCount; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const RoyalePlayer& pa = m.players[a];
+        const RoyalePlayer& pb = m.players[b];
+        int ka = pa.koTick < 0 ? INT32_MAX : pa.koTick, kb = pb.koTick < 0 ? INT32_MAX : pb.koTick;
+        if (ka != kb) return ka > kb;
+        return pa.sim.gLines > pb.sim.gLines;
+    });
+
+    uint64_t hash = 0, pieces = 0, sent = 0, lines = 0;
+    for (int rank = 0; rank < playerCount; rank++) {
+        const RoyalePlayer& p = m.players[order[rank]];
+        uint64_t h = simHash(p.sim) ^ (uint64_t)order[rank] << 40 ^ (uint64_t)rank;
+        hash = splitMix64(h) ^ hash * 31;
+        pieces += p.stats.pieces;
+        sent += p.linesSent;
+        lines += p.sim.gLines;
+    }
+
+    printf("%d players, depth %d, %d threads: %d ticks in %.2f s%s\n", playerCount, bot.depth, threads, ticks,
+           seconds, m.alive.size() > 1 ? " (time limit)" : "");
+    printf("  %.0f board ticks/s, %.0f pieces/s, %llu steals\n", playerTicks / seconds, pieces / seconds,
+           (unsigned long long)m.steals.load());
+    printf("  %llu lines cleared, %llu garbage lines sent\n", (unsigned long long)lines, (unsigned long long)sent);
+    for (int rank = 0; rank < min(playerCount, 5); rank++) {
+        const RoyalePlayer& p = m.players[order[rank]];
+        printf("  #%d board %3u: %5d lines, sent %4d, received %4d, %s\n", rank + 1, order[rank], p.sim.gLines,
+               p.linesSent, p.linesReceived, p.koTick < 0 ? "alive" : "out");
+    }
+    printf("  result hash %016llx\n", (unsigned long long)hash);
+    delete currentPiece;
+    delete nextPiece;
+    currentPiece = nextPiece = nullptr;
+    return 0;
+}
+
+// ==================== GIANT BOARD MODE ====================
+// --giant [cols] [rows]: a party/stress mode on a board up to GIANT_MAX_COLS
+// wide and thousands of rows tall. It plays the same pieces on its own small
+// engine; the main engine keeps its fixed W x H board. A row is a bit mask of
+// GIANT_WORDS words plus a letter per cell, and the stack is stored bottom-up
+// and only as high as it is. Rows live in fixed storage slots; which slot
+// holds stack row r is kept in blocks of up to GIANT_BLOCK_ROWS slot numbers.
+// A clear removes one slot number from its block and shifts the start row of
+// the blocks above, so it costs at most one block plus one int per block,
+// never the whole stack, and a lock only tests the rows the piece touched.
+// The view follows the falling piece and drawing only visits rows on screen,
+// so lock and frame costs stay flat as the board grows.
+const int GIANT_MAX_COLS = 128;
+const int GIANT_WORDS = GIANT_MAX_COLS / 64;
+const int GIANT_MAX_ROWS = 1 << 16;
+const int GIANT_BLOCK_ROWS = 256;            // Most slot numbers in one block of the row index
+const int GIANT_TILE = 16;                   // Tile size in pixels
+const int GIANT_VIEW_COLS = 64;              // Most columns and rows on screen at once
+const int GIANT_VIEW_ROWS = 40;
+const int GIANT_SIDEBAR_W = 200;
+const int GIANT_SPAWN_GAP = 20;              // Rows between the stack top and a new piece
+const int GIANT_FALL_TICKS = 20;             // Ticks per row of gravity
+const int GIANT_BENCH_PIECES = 200000;
+
+struct alignas(16) GiantRow {
+    uint64_t bits[GIANT_WORDS];              // Bit c % 64 of word c / 64 = column c filled
+    char cells[GIANT_MAX_COLS];              // Piece letter of each filled cell
+};
+
+struct GiantBlock {
+    int count = 0;
+    uint32_t slots[GIANT_BLOCK_ROWS];        // Storage slot of each of its rows, bottom first
+};
+
+// Two neighbouring blocks always hold more than GIANT_BLOCK_ROWS rows between
+// them (they are merged otherwise), so there are at most 2 * rows / GIANT_BLOCK_ROWS + 1
+struct GiantBoard {
+    int cols = 0, rows = 0;
+    int height = 0;                          // Rows in the stack
+    GiantRow full = {};                      // Bits of a complete row
+    std::vector<GiantRow> storage;           // A slot for every row, allocated up front
+    std::vector<uint32_t> spare;             // Slots not in the stack
+    std::vector<GiantBlock> blocks;          // Every block, allocated up front
+    std::vector<uint32_t> spareBlocks;       // Blocks not in use
+    std::vector<uint32_t> blockList;         // Blocks in use, bottom first
+    std::vector<int> blockStart;             // Stack row of each used block's first slot
+};
+
+struct GiantGame {
+    GiantBoard board;
+    Piece* piece = nullptr;
+    Piece* next = nullptr;
+    int x = 0, y = 0;                        // Column of shape column 0, row of shape row 0 (rows count up)
+    int fallTicks = 0, lockTicks = 0, lockResets = 0, inputTicks = 0;
+    int score = 0, lines = 0, locks = 0;
+    bool over = false;
+};
+
+// Size the board and allocate every row; false if the size is out of range
+bool giantInit(GiantBoard& b, int cols, int rows) {
+    if (cols < 4 || cols > GIANT_MAX_COLS || rows < 8 || rows > GIANT_MAX_ROWS) {
+        fprintf(stderr, "giant: board must be 4-%d columns and 8-%d rows (got %d x %d)\n", GIANT_MAX_COLS,
+                GIANT_MAX_ROWS, cols, rows);
+        return false;
+    }
+    b.cols = cols;
+    b.rows = rows;
+    b.full = GiantRow{};
+    for (int c = 0; c < cols; c++) b.full.bits[c / 64] |= 1ull << (c % 64);
+    b.height = 0;
+    b.storage.assign(rows, GiantRow{});
+    b.spare.resize(rows);
+    for (int i = 0; i < rows; i++) b.spare[i] = rows - 1 - i;  // Low slots come out first
+    int maxBlocks = 2 * rows / GIANT_BLOCK_ROWS + 2;
+    b.blocks.assign(maxBlocks, GiantBlock{});
+    b.spareBlocks.resize(maxBlocks);
+    for (int i = 0; i < maxBlocks; i++) b.spareBlocks[i] = maxBlocks - 1 - i;
+    b.blockList.clear();
+    b.blockList.reserve(maxBlocks);
+    b.blockStart.clear();
+    b.blockStart.reserve(maxBlocks);
+    return true;
+}
+
+// Index in blockList of the block holding stack row `row`
+static int giantBlockOf(const GiantBoard& b, int row) {
+    return (int)(std::upper_bound(b.blockStart.begin(), b.blockStart.end(), row) - b.blockStart.begin()) - 1;
+}
+
+// Storage slot of stack row `row` (below the stack height)
+static uint32_t giantSlot(const GiantBoard& b, int row) {
+    int k = giantBlockOf(b, row);
+    return b.blocks[b.blockList[k]].slots[row - b.blockStart[k]];
+}
+
+static bool giantFilled(const GiantBoard& b, int row, int col) {
+    if (row >= b.height) return false;
+    return b.storage[giantSlot(b, row)].bits[col / 64] >> (col % 64) & 1;
+}
+
+// Put an empty row on top of the stack
+static void giantPush(GiantBoard& b) {
+    if (b.blockList.empty() || b.blocks[b.blockList.back()].count == GIANT_BLOCK_ROWS) {
+        b.blockList.push_back(b.spareBlocks.back());
+        b.spareBlocks.pop_back();
+        b.blockStart.push_back(b.height);
+        b.blocks[b.blockList.back()].count = 0;
+    }
+    GiantBlock& block = b.blocks[b.blockList.back()];
+    block.slots[block.count++] = b.spare.back();
+    b.spare.pop_back();
+    b.height++;
+}
+
+// Merge block k + 1 into block k
+static void giantMergeBlocks(GiantBoard& b, int k) {
+    GiantBlock& low = b.blocks[b.blockList[k]];
+    GiantBlock& high = b.blocks[b.blockList[k + 1]];
+    memcpy(low.slots + low.count, high.slots, high.count * sizeof(uint32_t));
+    low.count += high.count;
+    b.spareBlocks.push_back(b.blockList[k + 1]);
+    b.blockList.erase(b.blockList.begin() + k + 1);
+    b.blockStart.erase(b.blockStart.begin() + k + 1);
+}
+
+// Take stack row `row` out of the stack and recycle its slot; rows above move down one
+static void giantRemoveRow(GiantBoard& b, int row) {
+    int k = giantBlockOf(b, row);
+    GiantBlock& block = b.blocks[b.blockList[k]];
+    int i = row - b.blockStart[k];
+    uint32_t slot = block.slots[i];
+    b.storage[slot] = GiantRow{};
+    b.spare.push_back(slot);
+    memmove(block.slots + i, block.slots + i + 1, (block.count - i - 1) * sizeof(uint32_t));
+    block.count--;
+    for (size_t j = k + 1; j < b.blockStart.size(); j++) b.blockStart[j]--;
+    b.height--;
+
+    int blockCount = (int)b.blockList.size();
+    if (k + 1 < blockCount && block.count + b.blocks[b.blockList[k + 1]].count <= GIANT_BLOCK_ROWS) {
+        giantMergeBlocks(b, k);
+    } else if (k > 0 && block.count + b.blocks[b.blockList[k - 1]].count <= GIANT_BLOCK_ROWS) {
+        giantMergeBlocks(b, k - 1);
+    } else if (block.count == 0) {  // The only block
+        b.spareBlocks.push_back(b.blockList[k]);
+        b.blockList.erase(b.blockList.begin() + k);
+        b.blockStart.erase(b.blockStart.begin() + k);
+    }
+}
+
+static bool giantRowFull(const GiantRow& r, const GiantRow& full) {
+#if defined(__SSE2__)
+    static_assert(GIANT_WORDS == 2, "a row mask must be one SSE register");
+    __m128i diff = _mm_xor_si128(_mm_load_si128((const __m128i*)r.bits), _mm_load_si128((const __m128i*)full.bits));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+#else
+    for (int w = 0; w < GIANT_WORDS; w++) {
+        if (r.bits[w] != full.bits[w]) return false;
+    }
+    return true;
+#endif
+}
+
+// Does a 4x4 shape fit with its top-left cell at column x, row y?
+static bool giantFits(const GiantBoard& b, const char shape[4][4], int x, int y) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (shape[i][j] == ' ') continue;
+            int col = x + j, row = y - i;
+            if (col < 0 || col >= b.cols || row < 0 || row >= b.rows) return false;
+            if (giantFilled(b, row, col)) return false;
+        }
+    }
+    return true;
+}
+
+// Remove the full rows among stack rows lo..hi. No row contents are copied,
+// only slot numbers within the cleared rows' blocks. Returns the rows cleared.
+int giantClearRows(GiantBoard& b, int lo, int hi) {
+    int cleared = 0;
+    for (int r = min(hi, b.height - 1); r >= max(lo, 0); r--) {  // Top down, so lower row numbers stay put
+        if (!giantRowFull(b.storage[giantSlot(b, r)], b.full)) continue;
+        giantRemoveRow(b, r);
+        cleared++;
+    }
+    return cleared;
+}
+
+// Write a shape into the stack (growing it as needed) and clear the rows it
+// completed. Returns the rows cleared.
+int giantLock(GiantBoard& b, const char shape[4][4], int x, int y) {
+    int top = -1, bottom = b.rows;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (shape[i][j] == ' ') continue;
+            int col = x + j, row = y - i;
+            while (b.height <= row) giantPush(b);
+            GiantRow& r = b.storage[giantSlot(b, row)];
+            r.bits[col / 64] |= 1ull << (col % 64);
+            r.cells[col] = shape[i][j];
+            top = max(top, row);
+            bottom = min(bottom, row);
+        }
+    }
+    return giantClearRows(b, bottom, top);
+}
+
+// Lowest row the current piece can drop to
+static int giantGhostY(const GiantGame& g) {
+    int y = g.y;
+    while (giantFits(g.board, g.piece->shape, g.x, y - 1)) y--;
+    return y;
+}
+
+// Bring in the next piece a few rows above the stack
+static void giantSpawn(GiantGame& g) {
+    delete g.piece;
+    g.piece = g.next;
+    g.next = createRandomPiece();
+    g.x = g.board.cols / 2 - 2;
+    g.y = min(g.board.rows - 1, g.board.height + GIANT_SPAWN_GAP);
+    g.fallTicks = g.lockTicks = g.lockResets = 0;
+    if (!giantFits(g.board, g.piece->shape, g.x, g.y)) g.over = true;
+}
+
+void giantReset(GiantGame& g, uint32_t seed) {
+    giantInit(g.board, g.board.cols, g.board.rows);
+    seedRandom(seed);
+    delete g.next;
+    g.next = createRandomPiece();
+    g.score = g.lines = g.locks = 0;
+    g.inputTicks = INPUT_REPEAT_TICKS;
+    g.over = false;
+    giantSpawn(g);
+}
+
+static void giantLockPiece(GiantGame& g) {
+    int cleared = giantLock(g.board, g.piece->shape, g.x, g.y);
+    g.lines += cleared;
+    g.score += 100 * cleared;
+    g.locks++;
+    giantSpawn(g);
+}
+
+// A successful move restarts the lock delay, a limited number of times
+static bool giantTry(GiantGame& g, int dx, int dy) {
+    if (!giantFits(g.board, g.piece->shape, g.x + dx, g.y + dy)) return false;
+    g.x += dx;
+    g.y += dy;
+    if (g.lockResets < MAX_LOCK_RESETS) {
+        g.lockResets++;
+        g.lockTicks = 0;
+    }
+    return true;
+}
+
+// Turn the piece clockwise with the same wall kicks as Piece::rotate
+static bool giantRotate(GiantGame& g) {
+    if (!g.piece->canRotate()) return false;
+    char turned[4][4];
+    g.piece->turnedShape(turned);
+    for (int kick : {0, -1, 1, -2, 2}) {
+        if (!giantFits(g.board, turned, g.x + kick, g.y)) continue;
+        memcpy(g.piece->shape, turned, sizeof(turned));
+        g.piece->rotation = (g.piece->rotation + 1) % 4;
+        giantTry(g, kick, 0);
+        return true;
+    }
+    return false;
+}
+
+// One 60 Hz step; input uses the same bits as simTick
+void giantTick(GiantGame& g, uint8_t input) {
+    if (g.over) return;
+    if (input & IN_ROTATE) giantRotate(g);
+    if (input & IN_DROP) {
+        g.y = giantGhostY(g);
+        giantLockPiece(g);
+        return;
+    }
+
+    if (g.inputTicks < INPUT_REPEAT_TICKS) g.inputTicks++;
+    if (g.inputTicks >= INPUT_REPEAT_TICKS && (input & IN_HELD_MASK)) {
+        if (input & IN_LEFT) giantTry(g, -1, 0);
+        else if (input & IN_RIGHT) giantTry(g, 1, 0);
+        else if (input & IN_DOWN) giantTry(g, 0, -1);
+        g.inputTicks = 0;
+    }
+
+    if (giantFits(g.board, g.piece->shape, g.x, g.y - 1)) {
+        g.lockTicks = 0;
+        if (++g.fallTicks >= GIANT_FALL_TICKS) {
+            g.fallTicks = 0;
+            g.y--;
+        }
+    } else if (++g.lockTicks >= LOCK_DELAY_TICKS) {
+        giantLockPiece(g);
+    }
+}
+
+// Pixel position of a cell: row 0 is the bottom of the board
+static Vector2f giantCellPos(const GiantBoard& b, int col, int row) {
+    return Vector2f((float)col * GIANT_TILE, (float)(b.rows - 1 - row) * GIANT_TILE);
+}
+
+static void giantPutCell(std::vector<sf::Vertex>& v, const GiantBoard& b, int col, int row, Color c) {
+    size_t n = v.size();
+    v.resize(n + 6);
+    Vector2f p = giantCellPos(b, col, row);
+    putQuad(&v[n], p.x, p.y, GIANT_TILE - 1, GIANT_TILE - 1, c);
+}
+
+// The board under `view`, the ghost and the falling piece in one draw call.
+// Only rows and words on screen are visited.
+void giantDraw(sf::RenderWindow& window, const GiantGame& g, const View& view, std::vector<sf::Vertex>& v) {
+    const GiantBoard& b = g.board;
+    v.clear();
+    FloatRect area(view.getCenter() - view.getSize() / 2.f, view.getSize());
+    size_t n = v.size();
+    v.resize(n + 6);
+    putQuad(&v[n], 0.f, 0.f, (float)b.cols * GIANT_TILE, (float)b.rows * GIANT_TILE, Color(20, 20, 28));
+
+    int rowHi = min(b.height - 1, b.rows - 1 - (int)(area.position.y / GIANT_TILE));
+    int rowLo = max(0, b.rows - 1 - (int)((area.position.y + area.size.y) / GIANT_TILE) - 1);
+    int colLo = max(0, (int)(area.position.x / GIANT_TILE));
+    int colHi = min(b.cols - 1, (int)((area.position.x + area.size.x) / GIANT_TILE));
+    for (int r = rowLo; r <= rowHi; r++) {
+        const GiantRow& row = b.storage[giantSlot(b, r)];
+        for (int w = colLo / 64; w <= colHi / 64; w++) {
+            for (uint64_t bits = row.bits[w]; bits; bits &= bits - 1) {
+                int col = w * 64 + __builtin_ctzll(bits);
+                if (col >= colLo && col <= colHi) giantPutCell(v, b, col, r, getColor(row.cells[col]));
+            }
+        }
+    }
+
+    if (!g.over) {
+        int ghostY = giantGhostY(g);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (g.piece->shape[i][j] != ' ') giantPutCell(v, b, g.x + j, ghostY - i, Color(255, 255, 255, 60));
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (g.piece->shape[i][j] != ' ') giantPutCell(v, b, g.x + j, g.y - i, getColor(g.piece->shape[i][j]));
+            }
+        }
+    }
+    window.draw(v.data(), v.size(), PrimitiveType::Triangles);
+}
+
+// Windowed giant mode. A/D/S move, W rotates, Space drops, Enter restarts, Esc quits.
+int runGiantMode(int cols, int rows) {
+    GiantGame g;
+    if (!giantInit(g.board, cols, rows)) return -1;
+    sf::Font font;
+    if (!font.openFromFile("assets/Monocraft.ttf")) return -1;
+    warmTextGlyphs(font);
+
+    const int viewW = min(cols, GIANT_VIEW_COLS) * GIANT_TILE;
+    const int viewH = min(rows, GIANT_VIEW_ROWS) * GIANT_TILE;
+    RenderWindow window(VideoMode(Vector2u(viewW + GIANT_SIDEBAR_W, viewH)), "SS008 - Tetris (giant board)");
+    window.setFramerateLimit(60);
+    const float windowW = (float)(viewW + GIANT_SIDEBAR_W);
+    View boardView(FloatRect({0.f, 0.f}, {(float)viewW, (float)viewH}));
+    boardView.setViewport(FloatRect({0.f, 0.f}, {viewW / windowW, 1.f}));
+    View uiView(FloatRect({0.f, 0.f}, {windowW, (float)viewH}));
+
+    std::vector<sf::Vertex> vertices;
+    vertices.reserve(6 * ((GIANT_VIEW_COLS + 2) * (GIANT_VIEW_ROWS + 2) + 33));
+    giantReset(g, makeSeed());
+    Vector2f camera = giantCellPos(g.board, g.x + 2, g.y);
+
+    Clock clock;
+    float tickTimer = 0.f;
+    uint8_t pressedInput = 0;
+    while (window.isOpen()) {
+        TRACE_SCOPE("frame");
+        beginTextFrame();
+        float dt = clock.restart().asSeconds();
+        tickTimer = min(tickTimer + dt, 0.25f);
+        while (const auto event = window.pollEvent()) {
+            if (event->is<Event::Closed>()) window.close();
+            if (const auto* key = event->getIf<Event::KeyPressed>()) {
+                if (key->code == Keyboard::Key::Escape) window.close();
+                else if (key->code == Keyboard::Key::W) pressedInput |= IN_ROTATE;
+                else if (key->code == Keyboard::Key::Space) pressedInput |= IN_DROP;
+                else if (key->code == Keyboard::Key::Enter && g.over) giantReset(g, makeSeed());
+            }
+        }
+        uint8_t heldInput = 0;
+        if (Keyboard::isKeyPressed(Keyboard::Key::A)) heldInput |= IN_LEFT;
+        else if (Keyboard::isKeyPressed(Keyboard::Key::D)) heldInput |= IN_RIGHT;
+        else if (Keyboard::isKeyPressed(Keyboard::Key::S)) heldInput |= IN_DOWN;
+        while (tickTimer >= TICK_SECONDS) {
+            giantTick(g, heldInput | pressedInput);
+            pressedInput = 0;
+            tickTimer -= TICK_SECONDS;
+        }
+
+        // The camera eases towards the piece and stops at the board's edges
+        Vector2f target = giantCellPos(g.board, g.x + 2, g.y - 1);
+        camera += (target - camera) * min(1.f, dt * 8.f);
+        Vector2f half(viewW / 2.f, viewH / 2.f);
+        camera.x = max(half.x, min((float)cols * GIANT_TILE - half.x, camera.x));
+        camera.y = max(half.y, min((float)rows * GIANT_TILE - half.y, camera.y));
+        boardView.setCenter(camera);
+
+        window.clear(Color::Black);
+        window.setView(boardView);
+        giantDraw(window, g, boardView, vertices);
+
+        window.setView(uiView);
+        char value[32];
+        float labelX = viewW + 16.f;
+        drawText(window, font, "SCORE", labelX, 20.f, 18);
+        snprintf(value, sizeof(value), "%d", g.score);
+        drawText(window, font, value, labelX, 44.f, 24);
+        drawText(window, font, "LINES", labelX, 90.f, 18);
+        snprintf(value, sizeof(value), "%d", g.lines);
+        drawText(window, font, value, labelX, 114.f, 24);
+        drawText(window, font, "HEIGHT", labelX, 160.f, 18);
+        snprintf(value, sizeof(value), "%d / %d", g.board.height, rows);
+        drawText(window, font, value, labelX, 184.f, 18);
+        snprintf(value, sizeof(value), "%d x %d", cols, rows);
+        drawText(window, font, value, labelX, viewH - 30.f, 14);
+        if (g.over) {
+            drawText(window, font, "GAME OVER", labelX, 240.f, 24);
+            drawText(window, font, "ENTER: AGAIN", labelX, 276.f, 14);
+        }
+        window.display();
+    }
+    delete g.piece;
+    delete g.next;
+    return 0;
+}
+
+// Fill stack row `row` (growing the stack to it) except the given columns
+static void giantFillRow(GiantBoard& b, int row, uint64_t const keep[GIANT_WORDS]) {
+    while (b.height <= row) giantPush(b);
+    GiantRow& r = b.storage[giantSlot(b, row)];
+    for (int c = 0; c < b.cols; c++) {
+        if (!(r.bits[c / 64] >> (c % 64) & 1) && !(keep[c / 64] >> (c % 64) & 1)) r.cells[c] = 'X';
+    }
+    for (int w = 0; w < GIANT_WORDS; w++) r.bits[w] = (r.bits[w] | b.full.bits[w]) & ~keep[w];
+}
+
+// --giant-bench: headless random drops on a giant board. Every
+// GIANT_BENCH_CLEAR_EVERY-th piece lands on a row completed around it, so it
+// clears a line at whatever height it is. Lock times with and without a clear
+// are grouped by stack height to show they don't grow with it, then single
+// clears at several heights of the final stack are timed.
+const int GIANT_BENCH_CLEAR_EVERY = 64;
+
+int runGiantBench(int cols, int rows, int pieces) {
+    GiantGame g;
+    if (!giantInit(g.board, cols, rows)) return -1;
+    giantReset(g, 12345);
+    uint32_t rng = 99;
+    const int BUCKETS = 17;                  // log2 of the stack height
+    double lockNs[BUCKETS][2] = {};          // [bucket][cleared a line]
+    int lockCount[BUCKETS][2] = {};
+    int maxHeight = 0;
+    for (int k = 0; k < pieces && !g.over; k++) {
+        for (int turns = nextRandom(rng) % 4; turns > 0; turns--) giantRotate(g);
+        int start = (int)(nextRandom(rng) % (uint32_t)cols);
+        int tries = 0;
+        for (g.x = start; tries < cols + 3 && !giantFits(g.board, g.piece->shape, g.x, g.y); tries++) {
+            g.x = (start + tries) % (cols + 3) - 3;
+        }
+        if (tries == cols + 3) break;
+        g.y = giantGhostY(g);
+        if (k % GIANT_BENCH_CLEAR_EVERY == GIANT_BENCH_CLEAR_EVERY - 1) {
+            int low = 3;  // Lowest shape row with a cell
+            while (low > 0 && !strncmp(g.piece->shape[low], "    ", 4)) low--;
+            uint64_t keep[GIANT_WORDS] = {};
+            for (int j = 0; j < 4; j++) {
+                if (g.piece->shape[low][j] != ' ') keep[(g.x + j) / 64] |= 1ull << ((g.x + j) % 64);
+            }
+            giantFillRow(g.board, g.y - low, keep);
+        }
+
+        int height = g.board.height;
+        int bucket = 0;
+        while ((2 << bucket) <= height + 1 && bucket < BUCKETS - 1) bucket++;
+        int linesBefore = g.lines;
+        auto t0 = std::chrono::steady_clock::now();
+        giantLockPiece(g);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        int cleared = g.lines > linesBefore;
+        lockNs[bucket][cleared] += ns;
+        lockCount[bucket][cleared]++;
+        maxHeight = max(maxHeight, g.board.height);
+    }
+
+    printf("%d x %d board: %d pieces, %d lines, stack up to %d rows%s\n", cols, rows, g.locks, g.lines, maxHeight,
+           g.over ? " (topped out)" : "");
+    for (int b = 0; b < BUCKETS; b++) {
+        if (!lockCount[b][0] && !lockCount[b][1]) continue;
+        printf("  height < %6d: %8d locks, %6.0f ns/lock; %7d clearing locks, %6.0f ns/lock\n", 2 << b,
+               lockCount[b][0], lockCount[b][0] ? lockNs[b][0] / lockCount[b][0] : 0.0, lockCount[b][1],
+               lockCount[b][1] ? lockNs[b][1] / lockCount[b][1] : 0.0);
+    }
+
+    // Complete a row at several heights of the final stack and clear it
+    GiantBoard& b = g.board;
+    const uint64_t keepNone[GIANT_WORDS] = {};
+    for (int eighth = 0; eighth < 8 && b.height > 0; eighth++) {
+        int row = (int)((int64_t)(b.height - 1) * eighth / 7);
+        int height = b.height;
+        giantFillRow(b, row, keepNone);
+        auto t0 = std::chrono::steady_clock::now();
+        giantClearRows(b, row, row);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        printf("  clearing row %6d of a %d-row stack: %.0f ns\n", row, height, ns);
+    }
+    delete g.piece;
+    delete g.next;
+    return 0;
+}
+
+// ==================== VIDEO CAPTURE ====================
+// F10 (or --capture) records what the window shows as numbered QOI images in
+// captures/capture_<date>_<time>_<n>/; ffmpeg -framerate 60 -i frame_%06d.qoi
+// turns them into a video. Reading the screen right after drawing would wait
+// for the GPU to finish the frame, so each frame is read into one of
+// CAPTURE_PBOS pixel buffer objects and only mapped CAPTURE_PBOS - 1 frames
+// later, when the copy is long done. The mapped pixels are copied into one of
+// CAPTURE_BUFFERS preallocated buffers and an encoder thread compresses and
+// writes them. The window thread never waits: with no free buffer the frame
+// is dropped and counted.
+const int CAPTURE_PBOS = 3;
+const uint32_t CAPTURE_BUFFERS = 8;          // Frames the encoder may fall behind; power of two
+const int CAPTURE_POLL_MS = 2;               // Encoder sleep when nothing is queued
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+// Buffer object entry points (OpenGL 1.5), loaded at the first capture
+struct CaptureGl {
+    void (APIENTRY* genBuffers)(GLsizei, GLuint*);
+    void (APIENTRY* deleteBuffers)(GLsizei, const GLuint*);
+    void (APIENTRY* bindBuffer)(GLenum, GLuint);
+    void (APIENTRY* bufferData)(GLenum, GLsizeiptr, const void*, GLenum);
+    void* (APIENTRY* mapBuffer)(GLenum, GLenum);
+    GLboolean (APIENTRY* unmapBuffer)(GLenum);
+    void (APIENTRY* readPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*);
+};
+
+struct VideoCapture {
+    bool active = false;
+    CaptureGl gl = {};
+    int width = 0, height = 0;
+    GLuint pbos[CAPTURE_PBOS] = {};
+    bool pboFilled[CAPTURE_PBOS] = {};
+    uint32_t frame = 0;                      // Frames read back since the start
+    std::vector<uint8_t> buffers[CAPTURE_BUFFERS];  // RGBA, bottom row first (as OpenGL reads)
+    // Buffer indices: filled ones go to the encoder, written ones come back
+    uint32_t filledRing[CAPTURE_BUFFERS], freeRing[CAPTURE_BUFFERS];
+    std::atomic<uint32_t> filledHead{0}, filledTail{0}, freeHead{0}, freeTail{0};
+    std::atomic<bool> running{false};
+    std::atomic<uint32_t> written{0};
+    uint32_t dropped = 0;
+    std::string folder;
+    std::thread encoder;
+};
+VideoCapture capture;
+
+// QOI image of a bottom-up RGBA frame, written top row first as RGB.
+// `out` must hold width * height * 4 + 22 bytes. Returns the size.
+static size_t qoiEncode(const uint8_t* rgba, int width, int height, uint8_t* out) {
+    size_t n = 0;
+    auto put32 = [&](uint32_t v) {
+        for (int s = 24; s >= 0; s -= 8) out[n++] = (uint8_t)(v >> s);
+    };
+    memcpy(out, "qoif", 4);
+    n = 4;
+    put32((uint32_t)width);
+    put32((uint32_t)height);
+    out[n++] = 3;                            // RGB
+    out[n++] = 0;                            // sRGB
+
+    uint32_t index[64] = {};                 // 0xFFRRGGBB of recently seen pixels; 0 = empty
+    uint32_t prev = 0xFF000000u;             // Opaque black, as the decoder starts
+    int run = 0;
+    for (int row = height - 1; row >= 0; row--) {
+        const uint8_t* p = rgba + (size_t)row * width * 4;
+        for (int i = 0; i < width; i++, p += 4) {
+            uint32_t px = 0xFF000000u | (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+            if (px == prev) {
+                if (++run == 62) {
+                    out[n++] = (uint8_t)(0xC0 | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out[n++] = (uint8_t)(0xC0 | (run - 1));
+                run = 0;
+            }
+            int slot = (p[0] * 3 + p[1] * 5 + p[2] * 7 + 255 * 11) % 64;
+            if (index[slot] == px) {
+                out[n++] = (uint8_t)slot;
+            } else {
+                index[slot] = px;
+                int dr = (int8_t)(p[0] - (uint8_t)(prev >> 16));
+                int dg = (int8_t)(p[1] - (uint8_t)(prev >> 8));
+                int db = (int8_t)(p[2] - (uint8_t)prev);
+                int drg = dr - dg, dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out[n++] = (uint8_t)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    out[n++] = (uint8_t)(0x80 | (dg + 32));
+                    out[n++] = (uint8_t)((drg + 8) << 4 | (dbg + 8));
+                } else {
+                    out[n++] = 0xFE;
+                    out[n++] = p[0];
+                    out[n++] = p[1];
+                    out[n++] = p[2];
+                }
+            }
+            prev = px;
+        }
+    }
+    if (run > 0) out[n++] = (uint8_t)(0xC0 | (run - 1));
+    static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    memcpy(out + n, end, 8);
+    return n + 8;
+}
+
+// Encoder thread: compress queued frames and give their buffers back
+static void captureEncoderLoop() {
+    traceSetThreadName("capture");
+    std::vector<uint8_t> encoded((size_t)capture.width * capture.height * 4 + 22);
+    char name[160];
+    while (true) {
+        uint32_t tail = capture.filledTail.load(std::memory_order_relaxed);
+        if (tail == capture.filledHead.load(std::memory_order_acquire)) {
+            if (!capture.running.load()) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_POLL_MS));
+            continue;
+        }
+        uint32_t buffer = capture.filledRing[tail & (CAPTURE_BUFFERS - 1)];
+        {
+            TRACE_SCOPE("capture.encode");
+            size_t size = qoiEncode(capture.buffers[buffer].data(), capture.width, capture.height, encoded.data());
+            uint32_t number = capture.written.load(std::memory_order_relaxed);
+            snprintf(name, sizeof(name), "%s/frame_%06u.qoi", capture.folder.c_str(), number);
+            FILE* f = fopen(name, "wb");
+            if (f) {
+                fwrite(encoded.data(), 1, size, f);
+                fclose(f);
+                capture.written.store(number + 1, std::memory_order_relaxed);
+            } else if (number == 0) {
+                fprintf(stderr, "capture: cannot write %s\n", name);
+            }
+        }
+        capture.filledTail.store(tail + 1, std::memory_order_release);
+
+        uint32_t head = capture.freeHead.load(std::memory_order_relaxed);
+        capture.freeRing[head & (CAPTURE_BUFFERS - 1)] = buffer;
+        capture.freeHead.store(head + 1, std::memory_order_release);
+    }
+}
+
+// Copy the mapped pixels of one PBO into a free buffer for the encoder
+static void captureQueue() {
+    const void* pixels = capture.gl.mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (!pixels) return;
+    uint32_t freeTail = capture.freeTail.load(std::memory_order_relaxed);
+    if (freeTail == capture.freeHead.load(std::memory_order_acquire)) {
+        if (capture.dropped++ == 0) printf("capture: the encoder is behind, dropping frames\n");
+    } else {
+        uint32_t buffer = capture.freeRing[freeTail & (CAPTURE_BUFFERS - 1)];
+        capture.freeTail.store(freeTail + 1, std::memory_order_release);
+        memcpy(capture.buffers[buffer].data(), pixels, capture.buffers[buffer].size());
+        uint32_t head = capture.filledHead.load(std::memory_order_relaxed);
+        capture.filledRing[head & (CAPTURE_BUFFERS - 1)] = buffer;
+        capture.filledHead.store(head + 1, std::memory_order_release);
+    }
+    capture.gl.unmapBuffer(GL_PIXEL_PACK_BUFFER);
+}
+
+// Start recording the window at its current size. The window's context must
+// be active. Returns false if the driver lacks buffer objects or the folder
+// can't be made.
+bool captureStart(const sf::RenderWindow& window) {
+    if (capture.active) return true;
+    CaptureGl& gl = capture.gl;
+    gl.genBuffers = reinterpret_cast<decltype(gl.genBuffers)>(sf::Context::getFunction("glGenBuffers"));
+    gl.deleteBuffers = reinterpret_cast<decltype(gl.deleteBuffers)>(sf::Context::getFunction("glDeleteBuffers"));
+    gl.bindBuffer = reinterpret_cast<decltype(gl.bindBuffer)>(sf::Context::getFunction("glBindBuffer"));
+    gl.bufferData = reinterpret_cast<decltype(gl.bufferData)>(sf::Context::getFunction("glBufferData"));
+    gl.mapBuffer = reinterpret_cast<decltype(gl.mapBuffer)>(sf::Context::getFunction("glMapBuffer"));
+    gl.unmapBuffer = reinterpret_cast<decltype(gl.unmapBuffer)>(sf::Context::getFunction("glUnmapBuffer"));
+    gl.readPixels = reinterpret_cast<decltype(gl.readPixels)>(sf::Context::getFunction("glReadPixels"));
+    if (!gl.genBuffers || !gl.deleteBuffers || !gl.bindBuffer || !gl.bufferData || !gl.mapBuffer ||
+        !gl.unmapBuffer || !gl.readPixels) {
+        fprintf(stderr, "capture: OpenGL buffer objects are not available\n");
+        return false;
+    }
+
+    static int captureNumber = 0;            // Two captures in the same second get their own folders
+    char stamp[32], folder[64];
+    time_t now = time(0);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+    snprintf(folder, sizeof(folder), "captures/capture_%s_%d", stamp, ++captureNumber);
+    std::error_code ec;
+    std::filesystem::create_directories(folder, ec);
+    if (ec) {
+        fprintf(stderr, "capture: cannot create %s\n", folder);
+        return false;
+    }
+
+    capture.folder = folder;
+    capture.width = (int)window.getSize().x;
+    capture.height = (int)window.getSize().y;
+    size_t frameBytes = (size_t)capture.width * capture.height * 4;
+    gl.genBuffers(CAPTURE_PBOS, capture.pbos);
+    for (int i = 0; i < CAPTURE_PBOS; i++) {
+        gl.bindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[i]);
+        gl.bufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)frameBytes, nullptr, GL_STREAM_READ);
+        capture.pboFilled[i] = false;
+    }
+    gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    for (uint32_t i = 0; i < CAPTURE_BUFFERS; i++) {
+        capture.buffers[i].resize(frameBytes);
+        capture.freeRing[i] = i;
+    }
+    capture.freeTail = 0;
+    capture.freeHead = CAPTURE_BUFFERS;
+    capture.filledHead = 0;
+    capture.filledTail = 0;
+    capture.written = 0;
+    capture.dropped = 0;
+    capture.frame = 0;
+    capture.running = true;
+    capture.encoder = std::thread(captureEncoderLoop);
+    capture.active = true;
+    printf("capture: recording %dx%d to %s\n", capture.width, capture.height, folder);
+    return true;
+}
+
+// Queue the frames still in flight, let the encoder finish and report.
+// Without the window's context (at exit) the frames in flight are lost and
+// the buffer objects go with the context.
+void captureStop(bool haveContext = true) {
+    if (!capture.active) return;
+    for (int k = 0; k < CAPTURE_PBOS && haveContext; k++) {
+        int slot = (int)(capture.frame % CAPTURE_PBOS);
+        if (capture.pboFilled[slot]) {
+            capture.gl.bindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+            captureQueue();
+            capture.pboFilled[slot] = false;
+        }
+        capture.frame++;
+    }
+    if (haveContext) {
+        capture.gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        capture.gl.deleteBuffers(CAPTURE_PBOS, capture.pbos);
+    }
+    capture.running = false;
+    if (capture.encoder.joinable()) capture.encoder.join();
+    capture.active = false;
+    printf("capture: %u frames written to %s, %u dropped\n", capture.written.load(), capture.folder.c_str(),
+           capture.dropped);
+}
+
+// Queue the frame just drawn; call before display(). A window resized since
+// the start ends the capture.
+void captureFrame(const sf::RenderWindow& window) {
+    if (!capture.active) return;
+    if ((int)window.getSize().x != capture.width || (int)window.getSize().y != capture.height) {
+        printf("capture: window resized, stopping\n");
+        captureStop();
+        return;
+    }
+    TRACE_SCOPE("capture.read");
+    int slot = (int)(capture.frame % CAPTURE_PBOS);
+    capture.gl.bindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+    if (capture.pboFilled[slot]) captureQueue();  // Read CAPTURE_PBOS frames ago
+    capture.gl.readPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    capture.pboFilled[slot] = true;
+    capture.gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture.frame++;
+}
+
+// ==================== AUTOSAVE ====================
+// The settings and the game in progress, with its replay recording so far,
+// live in saves/autosave.dat, so closing the window or a crash costs at most
+// AUTOSAVE_TICKS of play. Saving only copies them into one of two
+// preallocated buffers on the main thread; a background thread checksums the
+// buffer, writes saves/autosave.tmp, flushes it to disk and renames it over
+// the old save, so a crash mid-write leaves the previous save intact. When
+// the file holds a game the main menu offers RESUME.
+const uint32_t AUTOSAVE_MAGIC = 0x56415354;   // "TSAV"
+const uint32_t AUTOSAVE_VERSION = 1;
+const int AUTOSAVE_TICKS = 600;               // 10 s of play between saves
+const char* const AUTOSAVE_PATH = "saves/autosave.dat";
+const char* const AUTOSAVE_TEMP_PATH = "saves/autosave.tmp";
+const uint32_t AUTOSAVE_GAME = 1;             // Flag: a game in progress follows the settings
+const uint32_t AUTOSAVE_RECORDING = 2;        // Flag: and its recording's keyframes and runs after that
+
+struct AutosaveHeader {
+    uint32_t magic, version;
+    uint32_t size;                            // Bytes after the header
+    uint32_t flags;
+    uint64_t checksum;                        // FNV-1a of the bytes after the header
+};
+
+// Followed by ReplayKeyframe[keyframeCount] and uint32 runs[runCount]
+struct AutosaveSession {
+    float musicVolume, sfxVolume, brightness;
+    uint32_t ghostPieceEnabled;
+    SimState sim;
+    GameStats stats;
+    ArchiveEntry entry;                       // Of the recording
+    uint32_t keyframeCount, runCount;
+};
+
+const size_t AUTOSAVE_BYTES = sizeof(AutosaveHeader) + sizeof(AutosaveSession) +
+                              REPLAY_RESERVE_KEYFRAMES * sizeof(ReplayKeyframe) + REPLAY_RESERVE_RUNS * sizeof(uint32_t);
+
+enum AutosaveSlot : uint8_t { SLOT_FREE, SLOT_FILLED, SLOT_BUSY };
+
+struct Autosave {
+    alignas(8) uint8_t buffers[2][AUTOSAVE_BYTES];
+    std::atomic<uint8_t> slots[2] = {};       // AutosaveSlot of each buffer
+    std::atomic<bool> running{false};
+    std::thread writer;
+    vector<uint8_t> resume;                   // The save read at startup while it offers a game
+    // What the last save held, to tell when the next one is due
+    bool savedGame = false;
+    bool savedPaused = false;
+    int savedTick = 0;
+    float savedSettings[4] = {};
+};
+Autosave autosave;
+
+// The player's own game is running (not versus, a replay, the bot or an agent)
+bool autosaveGameInProgress() {
+    return gStats.active && !isGameOver && !versus.active && !playback.active && !bot.enabled && !agent.shared;
+}
+
+static void autosaveReadSettings(float out[4]) {
+    out[0] = musicVolume;
+    out[1] = sfxVolume;
+    out[2] = brightness;
+    out[3] = ghostPieceEnabled ? 1.f : 0.f;
+}
+
+// Copy the settings and the game into a buffer for the writer thread
+void autosaveNow() {
+    TRACE_SCOPE("autosave.copy");
+    // A save the writer hasn't taken yet is replaced, so at most one is waiting
+    // and the writer holds at most the other
+    int b = -1;
+    for (uint8_t from : {SLOT_FILLED, SLOT_FREE}) {
+        for (int i = 0; i < 2 && b < 0; i++) {
+            uint8_t expected = from;
+            if (autosave.slots[i].compare_exchange_strong(expected, SLOT_BUSY)) b = i;
+        }
+    }
+    if (b < 0) return;
+
+    uint8_t* p = autosave.buffers[b];
+    AutosaveHeader* h = reinterpret_cast<AutosaveHeader*>(p);
+    AutosaveSession* s = reinterpret_cast<AutosaveSession*>(p + sizeof(AutosaveHeader));
+    uint8_t* tail = p + sizeof(AutosaveHeader) + sizeof(AutosaveSession);
+    h->magic = AUTOSAVE_MAGIC;
+    h->version = AUTOSAVE_VERSION;
+    h->flags = 0;
+    s->keyframeCount = s->runCount = 0;
+
+    bool game = autosaveGameInProgress();
+    if (game) {
+        h->flags |= AUTOSAVE_GAME;
+        saveSim(s->sim);
+        s->stats = gStats;
+        const ReplayRecord& g = recorder.game;
+        if (recorder.active && g.keyframes.size() <= REPLAY_RESERVE_KEYFRAMES && g.runs.size() <= REPLAY_RESERVE_RUNS) {
+            h->flags |= AUTOSAVE_RECORDING;
+            s->entry = g.entry;
+            s->keyframeCount = (uint32_t)g.keyframes.size();
+            s->runCount = (uint32_t)g.runs.size();
+            memcpy(tail, g.keyframes.data(), g.keyframes.size() * sizeof(ReplayKeyframe));
+            tail += g.keyframes.size() * sizeof(ReplayKeyframe);
+            memcpy(tail, g.runs.data(), g.runs.size() * sizeof(uint32_t));
+            tail += g.runs.size() * sizeof(uint32_t);
+        }
+    } else if (!autosave.resume.empty()) {
+        // The game offered for RESUME stays saved until it is resumed or replaced
+        const AutosaveHeader* old = reinterpret_cast<const AutosaveHeader*>(autosave.resume.data());
+        h->flags = old->flags;
+        memcpy(s, autosave.resume.data() + sizeof(AutosaveHeader), old->size);
+        tail = p + sizeof(AutosaveHeader) + old->size;
+    }
+    s->musicVolume = musicVolume;
+    s->sfxVolume = sfxVolume;
+    s->brightness = brightness;
+    s->ghostPieceEnabled = ghostPieceEnabled;
+    h->size = (uint32_t)(tail - p - sizeof(AutosaveHeader));
+    autosave.slots[b].store(SLOT_FILLED, std::memory_order_release);
+
+    autosave.savedGame = game;
+    autosave.savedPaused = gameState != GameState::PLAYING;
+    autosave.savedTick = gameTick;
+    autosaveReadSettings(autosave.savedSettings);
+}
+
+// Called once a frame: save when a game starts or ends, pauses or resumes,
+// every AUTOSAVE_TICKS of play, and when a setting changes
+void autosaveUpdate() {
+    if (!autosave.running) return;
+    bool game = autosaveGameInProgress();
+    float settings[4];
+    autosaveReadSettings(settings);
+    bool due = game != autosave.savedGame || memcmp(settings, autosave.savedSettings, sizeof(settings)) != 0;
+    if (game) {
+        due = due || gameTick - autosave.savedTick >= AUTOSAVE_TICKS ||
+              (gameState != GameState::PLAYING) != autosave.savedPaused;
+    }
+    if (due) autosaveNow();
+}
+
+static uint64_t autosaveChecksum(const uint8_t* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+// Write a save next to the old one, then swap it in
+static bool autosaveWrite(uint8_t* p) {
+    AutosaveHeader* h = reinterpret_cast<AutosaveHeader*>(p);
+    h->checksum = autosaveChecksum(p + sizeof(AutosaveHeader), h->size);
+    size_t bytes = sizeof(AutosaveHeader) + h->size;
+
+    std::error_code ec;
+    std::filesystem::create_directories("saves", ec);
+    FILE* f = fopen(AUTOSAVE_TEMP_PATH, "wb");
+    if (!f) {
+        fprintf(stderr, "autosave: cannot create %s\n", AUTOSAVE_TEMP_PATH);
+        return false;
+    }
+    bool ok = fwrite(p, 1, bytes, f) == bytes;
+    ok = fflush(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(f)) == 0;  // On disk before it replaces the old save
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(AUTOSAVE_TEMP_PATH, AUTOSAVE_PATH, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    ok = ok && rename(AUTOSAVE_TEMP_PATH, AUTOSAVE_PATH) == 0;
+#endif
+    if (!ok) fprintf(stderr, "autosave: cannot write %s\n", AUTOSAVE_PATH);
+    return ok;
+}
+
+// Background thread: write each filled buffer, newest last
+static void autosaveWriterLoop() {
+    traceSetThreadName("autosave");
+    while (true) {
+        bool running = autosave.running.load();  // Before the slots, so the last save is written
+        bool wrote = false;
+        for (int i = 0; i < 2; i++) {
+            uint8_t expected = SLOT_FILLED;
+            if (!autosave.slots[i].compare_exchange_strong(expected, SLOT_BUSY)) continue;
+            TRACE_SCOPE("autosave.write");
+            autosaveWrite(autosave.buffers[i]);
+            autosave.slots[i].store(SLOT_FREE, std::memory_order_release);
+            wrote = true;
+        }
+        if (!running) break;
+        if (!wrote) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+// Read the save: apply its settings and keep a game for RESUME.
+// A missing file is a first start; a damaged one is ignored.
+void autosaveLoad() {
+    FILE* f = fopen(AUTOSAVE_PATH, "rb");
+    if (!f) return;
+    vector<uint8_t> data;
+    uint8_t chunk[4096];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), f)) > 0;) data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+
+    const AutosaveHeader* h = reinterpret_cast<const AutosaveHeader*>(data.data());
+    const AutosaveSession* s = reinterpret_cast<const AutosaveSession*>(data.data() + sizeof(AutosaveHeader));
+    bool ok = data.size() >= sizeof(AutosaveHeader) + sizeof(AutosaveSession) && h->magic == AUTOSAVE_MAGIC &&
+              h->version == AUTOSAVE_VERSION && h->size == data.size() - sizeof(AutosaveHeader) &&
+              h->checksum == autosaveChecksum(data.data() + sizeof(AutosaveHeader), h->size);
+    ok = ok && s->keyframeCount <= REPLAY_RESERVE_KEYFRAMES && s->runCount <= REPLAY_RESERVE_RUNS &&
+         h->size == sizeof(AutosaveSession) + s->keyframeCount * sizeof(ReplayKeyframe) + s->runCount * sizeof(uint32_t);
+    if (!ok) {
+        fprintf(stderr, "autosave: %s is damaged, starting without it\n", AUTOSAVE_PATH);
+        return;
+    }
+
+    musicVolume = max(0.f, min(100.f, s->musicVolume));
+    sfxVolume = max(0.f, min(100.f, s->sfxVolume));
+    brightness = max(51.f, min(255.f, s->brightness));
+    ghostPieceEnabled = s->ghostPieceEnabled != 0;
+    autosaveReadSettings(autosave.savedSettings);
+    if (h->flags & AUTOSAVE_GAME) autosave.resume = std::move(data);
+}
+
+void autosaveStart() {
+    autosave.running = true;
+    autosave.writer = std::thread(autosaveWriterLoop);
+}
+
+// Save the final state and wait for the writer. A game in progress stays in
+// the save, so its recording doesn't go to the archive yet.
+void autosaveStop() {
+    if (!autosave.running) return;
+    autosaveNow();
+    if (autosave.savedGame) recorder.active = false;
+    autosave.running = false;
+    autosave.writer.join();
+}
+
+// Put the saved game back in place, recording included
+static void autosaveRestore() {
+    const uint8_t* p = autosave.resume.data();
+    const AutosaveHeader* h = reinterpret_cast<const AutosaveHeader*>(p);
+    const AutosaveSession* s = reinterpret_cast<const AutosaveSession*>(p + sizeof(AutosaveHeader));
+    loadSim(s->sim);
+    gStats = s->stats;
+    if ((h->flags & AUTOSAVE_RECORDING) && recorder.enabled) {
+        const ReplayKeyframe* keyframes = reinterpret_cast<const ReplayKeyframe*>(p + sizeof(AutosaveHeader) + sizeof(AutosaveSession));
+        const uint32_t* runs = reinterpret_cast<const uint32_t*>(keyframes + s->keyframeCount);
+        ReplayRecord& g = recorder.game;
+        g.entry = s->entry;
+        g.keyframes.clear();
+        g.keyframes.reserve(REPLAY_RESERVE_KEYFRAMES);
+        g.keyframes.insert(g.keyframes.end(), keyframes, keyframes + s->keyframeCount);
+        g.runs.clear();
+        g.runs.reserve(REPLAY_RESERVE_RUNS);
+        g.runs.insert(g.runs.end(), runs, runs + s->runCount);
+        recorder.active = true;
+    }
+    vector<uint8_t>().swap(autosave.resume);
+}
+
+// RESUME: continue the saved game from the pause menu
+void autosaveResumeGame() {
+    if (autosave.resume.empty()) return;
+    autosaveRestore();
+    telemetryPush(TelemetryEvent::GAME_START, (int)time(0), gStats.gameNumber);  // A new CSV for the rest of the game
+    effectsClear();
+    stateBeforePause = GameState::PLAYING;
+    gameState = GameState::PAUSE;
+    emitEvent(EngineEvent::MUSIC_PAUSE);
+}
+
+// A new game replaces the saved one; its recording still goes to the archive
+void autosaveDiscardGame() {
+    if (autosave.resume.empty()) return;
+    autosaveRestore();
+    gStats.active = false;  // Its telemetry ended with the session that saved it
+    resetGame();            // Ends the recording as abandoned
+}
+
+// ==================== IDLE SCREENS ====================
+// The menu, settings, pause and game-over screens only change when an event
+// arrives. On them the main loop blocks in waitEvent instead of redrawing 60
+// times a second, and a wake-up with no event presents nothing. The timeout
+// keeps spectator keyframes and agent states going while nobody plays.
+const int IDLE_WAIT_MS = 250;
+
+bool screenIsIdle() {
+    if (versus.active) return false;  // The connection screens and the network need every frame
+    if (gameState == GameState::PLAYING) return isGameOver && !effectsActive();  // Effects only run while playing
+    return true;
+}
+
+// ==================== FAST FORWARD ====================
+// Bot games and replays can run faster than real time: +/- step through
+// FAST_FORWARD_SPEEDS. The simulation runs speed ticks per 60th of a second
+// in one tight batch per frame and only the last state is drawn, so the
+// frame rate stays at the display's. A batch gets FAST_FORWARD_BUDGET_SECONDS;
+// ticks the CPU can't reach in it are dropped rather than owed to the next
+// frame. Sounds that would repeat many times a frame are thinned, and above
+// FAST_FORWARD_AUDIO_MAX_SPEED the flight recorder keeps one tick per frame.
+const int FAST_FORWARD_SPEEDS[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1000};
+const int FAST_FORWARD_MAX_SPEED = 1000;
+const int FAST_FORWARD_AUDIO_MAX_SPEED = 4;           // Above this, lock/clear/level-up sounds are muted
+const double FAST_FORWARD_BUDGET_SECONDS = 0.010;     // Simulation time per frame before ticks are dropped
+
+int playSpeed = 1;                                    // --speed, or +/- while watching
+
+// The speed the current game runs at: only bot games and replays are sped up
+int fastForwardSpeed() {
+    if (versus.active || !(bot.enabled || playback.active)) return 1;
+    return playSpeed;
+}
+
+// Step to the next faster (dir > 0) or slower speed
+void fastForwardChange(int dir) {
+    const int count = (int)(sizeof(FAST_FORWARD_SPEEDS) / sizeof(FAST_FORWARD_SPEEDS[0]));
+    int i = 0;
+    while (i + 1 < count && FAST_FORWARD_SPEEDS[i + 1] <= playSpeed) i++;
+    if (dir < 0 && FAST_FORWARD_SPEEDS[i] == playSpeed) i--;  // A --speed between two steps slows to the lower one
+    else if (dir > 0) i++;
+    playSpeed = FAST_FORWARD_SPEEDS[max(0, min(count - 1, i))];
+}
+
+// Before a frame's ticks: how sounds are thinned, and until when the batch may run
+std::chrono::steady_clock::time_point fastForwardBeginFrame(int speed) {
+    eventsThisFrame = 0;
+    if (speed <= 1) {
+        eventThinning = EventThinning::OFF;
+        return std::chrono::steady_clock::time_point::max();
+    }
+    eventThinning = speed <= FAST_FORWARD_AUDIO_MAX_SPEED ? EventThinning::ONCE_PER_FRAME : EventThinning::MUTED;
+    return std::chrono::steady_clock::now() +
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(FAST_FORWARD_BUDGET_SECONDS));
+}
+
+// The top-left status line of a replay or fast-forwarded bot game; false if there is none
+bool fastForwardStatus(char* out, size_t size) {
+    int speed = fastForwardSpeed();
+    if (playback.active) {
+        int now = gameTick / 60;
+        int total = (int)playback.cursor.replay.header->ticks / 60;
+        int n = snprintf(out, size, "REPLAY #%llu  %d:%02d / %d:%02d",
+                         (unsigned long long)playback.number, now / 60, now % 60, total / 60, total % 60);
+        if (speed > 1 && n > 0 && (size_t)n < size) snprintf(out + n, size - n, "  %dX", speed);
+        return true;
+    }
+    if (speed > 1) {
+        snprintf(out, size, "BOT  %dX", speed);
+        return true;
+    }
+    return false;
+}
+
+// ==================== SOFTWARE RENDERER (--soft-render) ====================
+// For machines without a GPU, where SFML's OpenGL path runs on a slow
+// software GL and every shape and text is an expensive draw call.
+// --soft-render draws the playing and pause screens into a CPU pixel buffer
+// instead and uploads it as one texture per frame. A frame is first listed
+// as commands (filled rectangles, blended rectangles, glyphs). Each
+// TILE_SIZE tile of the screen hashes the commands that touch it; only tiles
+// whose hash changed since the last frame are rasterized again, and only the
+// rows holding them are uploaded. Spans are filled and blended four pixels at
+// a time with SSE2, text uses Monocraft glyphs rasterized once at startup,
+// and the brightness setting darkens each redrawn tile in the same pass
+// instead of as an overlay. Menus and settings (idle screens, see IDLE
+// SCREENS) and versus keep the SFML path.
+const int SOFT_W = PLAY_W_PX + SIDEBAR_W;
+const int SOFT_H = PLAY_H_PX;
+const int SOFT_TILES_X = (SOFT_W + TILE_SIZE - 1) / TILE_SIZE;
+const int SOFT_TILES_Y = (SOFT_H + TILE_SIZE - 1) / TILE_SIZE;
+const int SOFT_MAX_COMMANDS = MAX_PARTICLES + 2048;       // Particles plus everything else
+const unsigned SOFT_TEXT_SIZES[] = { 14, 18, 24, 40, 48 };  // Every size the soft screens use
+const int SOFT_FONT_SIZES = sizeof(SOFT_TEXT_SIZES) / sizeof(SOFT_TEXT_SIZES[0]);
+const int SOFT_GLYPHS = 95;                                // Printable ASCII, ' ' to '~'
+
+enum class SoftOp : uint8_t { FILL, BLEND, GLYPH };
+
+struct SoftCommand {
+    int16_t x0, y0, x1, y1;                  // Pixels covered, x1/y1 exclusive; clipped to the screen,
+                                             // except a glyph's x0/y0 (its bitmap origin)
+    SoftOp op;
+    uint8_t alpha;                           // BLEND
+    uint16_t glyph;                          // GLYPH: index into SoftRenderer::glyphs
+    uint32_t color;                          // Pixel value, see softPixel()
+};
+static_assert(sizeof(SoftCommand) == 16, "soft commands are hashed as two words");
+
+// A glyph's coverage bitmap, placed relative to the pen on the baseline
+struct SoftGlyph {
+    int16_t left, top;
+    uint16_t w, h;
+    uint32_t offset;                         // Into SoftRenderer::coverage
+    float advance;
+};
+
+struct SoftRenderer {
+    bool enabled = false;                    // --soft-render
+    vector<uint32_t> pixels;                 // SOFT_W x SOFT_H, what the texture holds
+    SoftCommand commands[SOFT_MAX_COMMANDS];
+    int commandCount = 0;
+    uint64_t tileHash[SOFT_TILES_Y][SOFT_TILES_X];
+    uint64_t drawnHash[SOFT_TILES_Y][SOFT_TILES_X];  // Hash of what each tile shows
+    bool drawn = false;                      // drawnHash is valid
+    SoftGlyph glyphs[SOFT_FONT_SIZES * SOFT_GLYPHS];
+    vector<uint8_t> coverage;
+    sf::Texture texture;
+    std::optional<sf::Sprite> sprite;
+};
+SoftRenderer soft;
+
+static inline uint64_t softHash(uint64_t v) {
+    return splitMix64(v);
+}
+
+// Pixel value of a color in the texture's byte order (R, G, B, A)
+static inline uint32_t softPixel(Color c) {
+    return (uint32_t)c.r | (uint32_t)c.g << 8 | (uint32_t)c.b << 16 | 0xFF000000u;
+}
+
+// Rasterize the glyphs of every SOFT_TEXT_SIZES size and make the texture
+void softInit(const sf::Font& font) {
+    soft.pixels.assign((size_t)SOFT_W * SOFT_H, 0xFF000000u);
+    for (int s = 0; s < SOFT_FONT_SIZES; s++) {
+        unsigned size = SOFT_TEXT_SIZES[s];
+        sf::Glyph loaded[SOFT_GLYPHS];
+        for (int c = 0; c < SOFT_GLYPHS; c++) loaded[c] = font.getGlyph((char32_t)(' ' + c), size, false);
+        sf::Image page = font.getTexture(size).copyToImage();  // After loading: the page may have grown
+        for (int c = 0; c < SOFT_GLYPHS; c++) {
+            const sf::Glyph& g = loaded[c];
+            SoftGlyph& out = soft.glyphs[s * SOFT_GLYPHS + c];
+            out.left = (int16_t)lroundf(g.bounds.position.x);
+            out.top = (int16_t)lroundf(g.bounds.position.y);
+            out.w = (uint16_t)max(0, g.textureRect.size.x);
+            out.h = (uint16_t)max(0, g.textureRect.size.y);
+            out.offset = (uint32_t)soft.coverage.size();
+            out.advance = g.advance;
+            for (int y = 0; y < out.h; y++) {
+                for (int x = 0; x < out.w; x++) {
+                    unsigned px = (unsigned)(g.textureRect.position.x + x), py = (unsigned)(g.textureRect.position.y + y);
+                    bool inside = px < page.getSize().x && py < page.getSize().y;
+                    soft.coverage.push_back(inside ? page.getPixel({px, py}).a : 0);
+                }
+            }
+        }
+    }
+    if (!soft.texture.resize({(unsigned)SOFT_W, (unsigned)SOFT_H})) {
+        fprintf(stderr, "soft render: cannot make a %dx%d texture, using SFML drawing\n", SOFT_W, SOFT_H);
+        soft.enabled = false;
+        return;
+    }
+    soft.sprite.emplace(soft.texture);
+}
+
+// ----- Commands -----
+// A filled rectangle; translucent colors blend
+void softRect(float x, float y, float w, float h, Color c) {
+    int x0 = (int)lroundf(x), y0 = (int)lroundf(y);
+    int x1 = min(x0 + (int)lroundf(w), SOFT_W), y1 = min(y0 + (int)lroundf(h), SOFT_H);
+    x0 = max(x0, 0);
+    y0 = max(y0, 0);
+    if (c.a == 0 || x0 >= x1 || y0 >= y1 || soft.commandCount == SOFT_MAX_COMMANDS) return;
+    soft.commands[soft.commandCount++] = { (int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)y1,
+                                           c.a == 255 ? SoftOp::FILL : SoftOp::BLEND, c.a, 0, softPixel(c) };
+}
+
+// An outline drawn outside the rectangle, like an sf::Shape outline
+void softOutline(float x, float y, float w, float h, float thickness, Color c) {
+    softRect(x - thickness, y - thickness, w + 2 * thickness, thickness, c);
+    softRect(x - thickness, y + h, w + 2 * thickness, thickness, c);
+    softRect(x - thickness, y, thickness, h, c);
+    softRect(x + w, y, thickness, h, c);
+}
+
+static int softFontIndex(unsigned size) {
+    for (int s = 0; s < SOFT_FONT_SIZES; s++) {
+        if (SOFT_TEXT_SIZES[s] == size) return s;
+    }
+    return 0;
+}
+
+// Laid out like sf::Text: the baseline is `size` below y (Monocraft has no kerning)
+void softText(const char* s, float x, float y, unsigned size, Color c) {
+    int font = softFontIndex(size);
+    float penX = x;
+    int baseline = (int)lroundf(y) + (int)size;
+    for (; *s; s++) {
+        int k = (unsigned char)*s - ' ';
+        if (k < 0 || k >= SOFT_GLYPHS) continue;
+        const SoftGlyph& g = soft.glyphs[font * SOFT_GLYPHS + k];
+        if (g.w && g.h) {
+            int gx = (int)lroundf(penX) + g.left, gy = baseline + g.top;
+            int glyph = font * SOFT_GLYPHS + k;
+            int x0 = max(gx, 0), y0 = max(gy, 0), x1 = min(gx + g.w, SOFT_W), y1 = min(gy + g.h, SOFT_H);
+            if (x0 < x1 && y0 < y1 && soft.commandCount < SOFT_MAX_COMMANDS) {
+                soft.commands[soft.commandCount++] = { (int16_t)gx, (int16_t)gy, (int16_t)x1, (int16_t)y1,
+                                                       SoftOp::GLYPH, 0, (uint16_t)glyph, softPixel(c) };
+            }
+        }
+        penX += g.advance;
+    }
+}
+
+// Width of the text's ink, like sf::Text::getLocalBounds().size.x
+float softTextWidth(const char* s, unsigned size) {
+    int font = softFontIndex(size);
+    float penX = 0.f, minX = (float)size, maxX = 0.f;
+    for (; *s; s++) {
+        int k = (unsigned char)*s - ' ';
+        if (k < 0 || k >= SOFT_GLYPHS) continue;
+        const SoftGlyph& g = soft.glyphs[font * SOFT_GLYPHS + k];
+        if (*s == ' ') {
+            minX = min(minX, penX);
+            penX += g.advance;
+            maxX = max(maxX, penX);
+            continue;
+        }
+        minX = min(minX, penX + g.left);
+        maxX = max(maxX, penX + g.left + g.w);
+        penX += g.advance;
+    }
+    return max(0.f, maxX - minX);
+}
+
+// A menu button: filled box with its label centered
+static void softButton(const char* label, float bx, float by, float bw, Color fill) {
+    softRect(bx, by, bw, 50.f, fill);
+    softText(label, bx + (bw - softTextWidth(label, 24)) / 2.f, by + 10.f, 24, Color::White);
+}
 
-    // Draw text labels and values
-    float labelX = ui.scoreBox.position.x + 12.f;
-    drawText(window, font, "SCORE", labelX, ui.scoreBox.position.y + 10.f, 18);
-    drawText(window, font, std::to_string(score), labelX, ui.scoreBox.position.y + 42.f, 24);
-    drawText(window, font, "LEVEL", labelX, ui.levelBox.position.y + 10.f, 18);
-    drawText(window, font, std::to_string(level), labelX, ui.levelBox.position.y + 42.f, 24);
-    drawText(window, font, "LINES", labelX, ui.linesBox.position.y + 10.f, 18);
-    drawText(window, font, std::to_string(lines), labelX, ui.linesBox.position.y + 42.f, 24);
-    drawText(window, font, "NEXT", labelX, ui.nextBox.position.y + 10.f, 18);
-    drawNextPreview(window, ui, next);
+// ----- Rasterizing -----
+static inline void softFillSpan(uint32_t* p, int n, uint32_t color) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i c = _mm_set1_epi32((int)color);
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i*)(p + i), c);
+#endif
+    for (; i < n; i++) p[i] = color;
 }
 
-// ==================== GAME LOGIC ====================
-Piece* currentPiece = nullptr;       // Currently falling piece
-Piece* nextPiece = nullptr;          // Next piece to spawn
+// dst = (src * a + dst * (255 - a)) / 255 per channel, alpha stays opaque
+static inline uint32_t softBlendPixel(uint32_t dst, uint32_t src, unsigned a) {
+    uint32_t out = 0xFF000000u;
+    for (int shift = 0; shift < 24; shift += 8) {
+        unsigned v = ((src >> shift) & 0xFF) * a + ((dst >> shift) & 0xFF) * (255 - a) + 128;
+        out |= ((v + (v >> 8)) >> 8) << shift;
+    }
+    return out;
+}
 
-// ==================== 7-BAG SHUFFLE ALGORITHM ====================
-// Ensures fair piece distribution - all 7 pieces appear before repeating
-vector<int> pieceQueue;              // Queue of piece types
-int queueIndex = 0;                  // Current position in queue
+static inline void softBlendSpan(uint32_t* p, int n, uint32_t color, unsigned a) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i src = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero),
+                                                      _mm_set1_epi16((short)a)), _mm_set1_epi16(128));
+    const __m128i inv = _mm_set1_epi16((short)(255 - a));
+    const __m128i opaque = _mm_set1_epi32((int)0xFF000000u);
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv), src);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv), src);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i*)(p + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+#endif
+    for (; i < n; i++) p[i] = softBlendPixel(p[i], color, a);
+}
 
-// Refill queue with randomized bag of 7 pieces
-void refillPieceQueue() {
-    vector<int> bag = {0, 1, 2, 3, 4, 5, 6};  // All 7 piece types
-    
-    // Fisher-Yates shuffle algorithm
-    for (int i = 0; i < 7; i++) {
-        int r = rand() % (7 - i);
-        pieceQueue.push_back(bag[r]);
-        swap(bag[r], bag[6 - i]);
+// Replay the commands touching one tile, clipped to it
+static void softDrawTile(int tx, int ty, unsigned darken) {
+    int cx0 = tx * TILE_SIZE, cy0 = ty * TILE_SIZE;
+    int cx1 = min(cx0 + TILE_SIZE, SOFT_W), cy1 = min(cy0 + TILE_SIZE, SOFT_H);
+    for (int k = 0; k < soft.commandCount; k++) {
+        const SoftCommand& c = soft.commands[k];
+        int x0 = max<int>(c.x0, cx0), y0 = max<int>(c.y0, cy0), x1 = min<int>(c.x1, cx1), y1 = min<int>(c.y1, cy1);
+        if (x0 >= x1 || y0 >= y1) continue;
+        if (c.op == SoftOp::FILL) {
+            for (int y = y0; y < y1; y++) softFillSpan(&soft.pixels[(size_t)y * SOFT_W + x0], x1 - x0, c.color);
+        } else if (c.op == SoftOp::BLEND) {
+            for (int y = y0; y < y1; y++) softBlendSpan(&soft.pixels[(size_t)y * SOFT_W + x0], x1 - x0, c.color, c.alpha);
+        } else {
+            const SoftGlyph& g = soft.glyphs[c.glyph];
+            for (int y = y0; y < y1; y++) {
+                const uint8_t* cov = &soft.coverage[g.offset + (size_t)(y - c.y0) * g.w];
+                uint32_t* p = &soft.pixels[(size_t)y * SOFT_W];
+                for (int x = x0; x < x1; x++) {
+                    unsigned a = cov[x - c.x0];
+                    if (a == 255) p[x] = c.color;
+                    else if (a) p[x] = softBlendPixel(p[x], c.color, a);
+                }
+            }
+        }
+    }
+    if (darken) {
+        for (int y = cy0; y < cy1; y++) softBlendSpan(&soft.pixels[(size_t)y * SOFT_W + cx0], cx1 - cx0, 0xFF000000u, darken);
     }
 }
 
-// Create piece from type ID
-Piece* createPieceFromType(int type) {
-    switch (type) {
-        case 0: return new IPiece();
-        case 1: return new OPiece();
-        case 2: return new TPiece();
-        case 3: return new SPiece();
-        case 4: return new ZPiece();
-        case 5: return new JPiece();
-        case 6: return new LPiece();
-        default: return new IPiece();
+// Redraw the tiles whose commands changed, upload their rows and draw the frame
+void softPresent(sf::RenderWindow& window) {
+    TRACE_SCOPE("soft.present");
+    unsigned darken = 255 - (unsigned)max(0.f, min(255.f, brightness));
+    uint64_t seed = softHash(darken);
+    for (int ty = 0; ty < SOFT_TILES_Y; ty++) {
+        for (int tx = 0; tx < SOFT_TILES_X; tx++) soft.tileHash[ty][tx] = seed;
     }
+    for (int k = 0; k < soft.commandCount; k++) {
+        const SoftCommand& c = soft.commands[k];
+        uint64_t words[2];
+        memcpy(words, &c, sizeof(words));
+        uint64_t h = softHash(words[0] ^ softHash(words[1]));
+        int tx1 = (c.x1 - 1) / TILE_SIZE, ty1 = (c.y1 - 1) / TILE_SIZE;
+        for (int ty = max(0, (int)c.y0) / TILE_SIZE; ty <= ty1; ty++) {
+            for (int tx = max(0, (int)c.x0) / TILE_SIZE; tx <= tx1; tx++) {
+                soft.tileHash[ty][tx] = softHash(soft.tileHash[ty][tx] ^ h);
+            }
+        }
+    }
+
+    int firstRow = SOFT_H, lastRow = 0;
+    for (int ty = 0; ty < SOFT_TILES_Y; ty++) {
+        for (int tx = 0; tx < SOFT_TILES_X; tx++) {
+            if (soft.drawn && soft.tileHash[ty][tx] == soft.drawnHash[ty][tx]) continue;
+            softDrawTile(tx, ty, darken);
+            soft.drawnHash[ty][tx] = soft.tileHash[ty][tx];
+            firstRow = min(firstRow, ty * TILE_SIZE);
+            lastRow = max(lastRow, min((ty + 1) * TILE_SIZE, SOFT_H));
+        }
+    }
+    soft.drawn = true;
+    if (firstRow < lastRow) {
+        TRACE_SCOPE("soft.upload");
+        soft.texture.update(reinterpret_cast<const uint8_t*>(&soft.pixels[(size_t)firstRow * SOFT_W]),
+                            {(unsigned)SOFT_W, (unsigned)(lastRow - firstRow)}, {0u, (unsigned)firstRow});
+    }
+    window.draw(*soft.sprite);
 }
 
-// Get next random piece using 7-bag shuffle
-Piece* createRandomPiece() {
-    // Refill queue when empty
-    if (queueIndex >= pieceQueue.size()) {
-        refillPieceQueue();
-        queueIndex = 0;
+// ----- Screens -----
+static void softDrawSidebar(const SidebarUI& ui, int score, int level, int lines, const Piece* next) {
+    softRect(ui.x, ui.y, ui.w, ui.h, Color(30, 30, 30));
+    for (const sf::FloatRect* r : { &ui.scoreBox, &ui.levelBox, &ui.linesBox, &ui.nextBox }) {
+        softRect(r->position.x, r->position.y, r->size.x, r->size.y, Color(200, 200, 200));  // The 3 px border
+        softRect(r->position.x + 3.f, r->position.y + 3.f, r->size.x - 6.f, r->size.y - 6.f, Color::Black);
+    }
+
+    float labelX = ui.scoreBox.position.x + 12.f;
+    char value[16];
+    softText("SCORE", labelX, ui.scoreBox.position.y + 10.f, 18, Color::White);
+    snprintf(value, sizeof(value), "%d", score);
+    softText(value, labelX, ui.scoreBox.position.y + 42.f, 24, Color::White);
+    softText("LEVEL", labelX, ui.levelBox.position.y + 10.f, 18, Color::White);
+    snprintf(value, sizeof(value), "%d", level);
+    softText(value, labelX, ui.levelBox.position.y + 42.f, 24, Color::White);
+    softText("LINES", labelX, ui.linesBox.position.y + 10.f, 18, Color::White);
+    snprintf(value, sizeof(value), "%d", lines);
+    softText(value, labelX, ui.linesBox.position.y + 42.f, 24, Color::White);
+    softText("NEXT", labelX, ui.nextBox.position.y + 10.f, 18, Color::White);
+
+    // Next piece, centered in its box as drawNextPreview() does
+    int minR = 4, minC = 4, maxR = -1, maxC = -1;
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            if (next->shape[r][c] == ' ') continue;
+            minR = min(minR, r); minC = min(minC, c);
+            maxR = max(maxR, r); maxC = max(maxC, c);
+        }
+    }
+    if (maxR < 0) return;
+    int mini = TILE_SIZE / 2;
+    float startX = ui.nextBox.position.x + 16.f + (ui.nextBox.size.x - 32.f - (maxC - minC + 1) * mini) * 0.5f;
+    float startY = ui.nextBox.position.y + 60.f + (ui.nextBox.size.y - 80.f - (maxR - minR + 1) * mini) * 0.5f;
+    for (int r = minR; r <= maxR; r++) {
+        for (int c = minC; c <= maxC; c++) {
+            if (next->shape[r][c] == ' ') continue;
+            softRect(startX + (c - minC) * mini, startY + (r - minR) * mini, mini - 1.f, mini - 1.f, getColor(next->shape[r][c]));
+        }
     }
-    Piece* p = createPieceFromType(pieceQueue[queueIndex]);
-    queueIndex++;
-    return p;
 }
 
-// ==================== BOARD OPERATIONS ====================
-// Commit current piece to board
-void block2Board() {
+static void softDrawHint() {
+    if (!hint.active) return;
+    char status[64];
+    if (!hint.ready.load(std::memory_order_acquire)) {
+        softText("SOLVING...", 6.f, 4.f, 14, Color::White);
+        return;
+    }
+    if (!hint.result.found) {
+        snprintf(status, sizeof(status), "NO PERFECT CLEAR IN %d PIECES", hint.request.count);
+        softText(status, 6.f, 4.f, 14, Color::White);
+        return;
+    }
+    snprintf(status, sizeof(status), "PERFECT CLEAR: %d PIECES", hint.result.length - hint.step);
+    softText(status, 6.f, 4.f, 14, Color::White);
+    const Placement& m = hint.result.moves[hint.step];
     for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            if (currentPiece->shape[i][j] != ' ') {
-                board[y + i][x + j] = currentPiece->shape[i][j];
-            }
+        for (RowMask bits = m.cells[i]; bits; bits &= bits - 1) {
+            float cx = (__builtin_ctz(bits) + 1) * TILE_SIZE, cy = (m.y + i) * TILE_SIZE;
+            softRect(cx, cy, TILE_SIZE - 1, TILE_SIZE - 1, Color(255, 215, 0, 60));
+            softOutline(cx, cy, TILE_SIZE - 1, TILE_SIZE - 1, 2.f, Color(255, 215, 0, 220));
         }
     }
 }
 
-// Initialize empty board with walls
-void initBoard() {
+// The soft backend draws this frame: playing or paused, outside versus
+bool softScreen() {
+    return soft.enabled && !versus.active && (gameState == GameState::PLAYING || gameState == GameState::PAUSE);
+}
+
+// The playing or pause screen as the SFML path draws it
+void softDrawScreen(const SidebarUI& ui) {
+    TRACE_SCOPE("soft.commands");
+    soft.commandCount = 0;
+    bool paused = gameState == GameState::PAUSE;
+    softRect(0.f, 0.f, SOFT_W, SOFT_H, Color::Black);
+
+    // Board (rows above a fresh clear are still falling into place)
     for (int i = 0; i < H; i++) {
         for (int j = 0; j < W; j++) {
-            // Add borders (walls marked with '#')
-            if ((i == H - 1) || (j == 0) || (j == W - 1)) {
-                board[i][j] = '#';
-            } else {
-                board[i][j] = ' ';
-            }
+            if (board[i][j] == ' ') continue;
+            float fall = (!paused && j > 0 && j < W - 1) ? effects.rowOffset[i] : 0.f;
+            softRect(j * TILE_SIZE, i * TILE_SIZE - fall, TILE_SIZE - 1, TILE_SIZE - 1, getColor(board[i][j]));
         }
     }
-}
 
-// Check if current piece can move in direction (dx, dy)
-bool canMove(int dx, int dy) {
-    if (!currentPiece) return false;
-    
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            if (currentPiece->shape[i][j] != ' ') {
-                int tx = x + j + dx;
-                int ty = y + i + dy;
-                
-                // Check bounds and collision
-                if (tx < 1 || tx >= W - 1 || ty >= H - 1) return false;
-                if (board[ty][tx] != ' ') return false;
+    // Ghost piece, hint and current piece
+    if (!isGameOver && ghostPieceEnabled) {
+        int ghostY = getGhostY();
+        for (int i = 0; i < 4 && ghostY != y; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (currentPiece->shape[i][j] == ' ') continue;
+                softOutline((x + j) * TILE_SIZE, (ghostY + i) * TILE_SIZE, TILE_SIZE - 1, TILE_SIZE - 1, 2.f,
+                            Color(255, 255, 255, 150));
             }
         }
     }
-    return true;
-}
-
-// Calculate Y position for ghost piece (preview of landing position)
-int getGhostY() {
-    int ghostY = y;
-    while (true) {
-        bool canGo = true;
+    if (!paused) softDrawHint();
+    if (!isGameOver) {
         for (int i = 0; i < 4; i++) {
             for (int j = 0; j < 4; j++) {
-                if (currentPiece->shape[i][j] != ' ') {
-                    int tx = x + j;
-                    int ty = ghostY + i + 1;
-                    // Check if we hit bottom or collision
-                    if (ty >= H - 1 || board[ty][tx] != ' ') {
-                        canGo = false;
-                        break;
-                    }
-                }
+                if (currentPiece->shape[i][j] == ' ') continue;
+                softRect((x + j) * TILE_SIZE, (y + i) * TILE_SIZE, TILE_SIZE - 1, TILE_SIZE - 1,
+                         getColor(currentPiece->shape[i][j]));
             }
-            if (!canGo) break;
         }
-        if (!canGo) break;
-        ghostY++;
     }
-    return ghostY;
-}
 
-// ==================== GAME PROGRESSION ====================
-// Increase game speed (gravity) when leveling up
-void SpeedIncrement() {
-    if (gameDelay > 0.1f) {
-        gameDelay -= 0.08f;
+    // Row flashes and particles
+    if (!paused) {
+        for (int i = 0; i < H; i++) {
+            if (effects.rowFlash[i] <= 0.f) continue;
+            uint8_t alpha = (uint8_t)(200.f * effects.rowFlash[i] / ROW_FLASH_SECONDS);
+            softRect(TILE_SIZE, i * TILE_SIZE, (W - 2) * TILE_SIZE, TILE_SIZE, Color(255, 255, 255, alpha));
+        }
+        const ParticlePool& p = effects.particles;
+        for (int k = 0; k < p.count; k++) {
+            uint32_t rgb = p.color[k];
+            uint8_t alpha = (uint8_t)(255.f * min(1.f, p.life[k] * p.fade[k]));
+            softRect(p.x[k] - PARTICLE_SIZE / 2, p.y[k] - PARTICLE_SIZE / 2, PARTICLE_SIZE, PARTICLE_SIZE,
+                     Color((uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb, alpha));
+        }
     }
-}
 
-// Update score and level based on lines cleared
-void applyLineClearScore(int cleared) {
-    if (cleared <= 0) return;
-    
-    gLines += cleared;
-    gScore += 100 * cleared;           // 100 points per line
-    gLevel = gLines / 10;              // Level up every 10 lines
-    
-    // Increase game speed when leveling up
-    if (gLevel > currentLevel) {
-        SpeedIncrement();
-        currentLevel = gLevel;
+    softDrawSidebar(ui, gScore, gLevel, gLines, nextPiece);
+
+    const float fullW = SOFT_W;
+    const float btnW = 200.f;
+    const float btnX = (fullW - btnW) / 2.f;
+    if (paused) {
+        softRect(0.f, 0.f, fullW, SOFT_H, Color(0, 0, 0, 100));
+        softText("PAUSED", (fullW - softTextWidth("PAUSED", 48)) / 2.f, 80.f, 48, Color::Yellow);
+        softButton("RESUME", btnX, 200.f, btnW, Color(0, 150, 100));
+        softButton("SETTINGS", btnX, 270.f, btnW, Color(100, 100, 150));
+        softButton("MENU", btnX, 340.f, btnW, Color(150, 100, 100));
+        return;
+    }
+    char status[64];
+    if (fastForwardStatus(status, sizeof(status))) softText(status, 6.f, 4.f, 14, Color::White);
+    if (isGameOver) {
+        softRect(0.f, 0.f, fullW, SOFT_H, Color(0, 0, 0, 200));
+        softText("GAME OVER", (fullW - softTextWidth("GAME OVER", 40)) / 2.f, 150.f, 40, Color::Red);
+        softButton("RESTART", btnX, 230.f, btnW, Color(0, 100, 255));
+        softButton("MENU", btnX, 300.f, btnW, Color(100, 100, 100));
+        softButton("EXIT", btnX, 370.f, btnW, Color(255, 50, 50));
     }
 }
 
-// Detect and remove completed lines
-int removeLine() {
-    int cleared = 0;
-    
-    // Check each row from bottom up
-    for (int i = H - 2; i > 0; i--) {
-        bool isFull = true;
-        
-        // Check if row is completely filled
-        for (int j = 1; j < W - 1; j++) {
-            if (board[i][j] == ' ') { 
-                isFull = false; 
-                break; 
-            }
-        }
-        
-        // If full, remove and drop lines above
-        if (isFull) {
-            cleared++;
-            clearSound->play();
-            
-            // Move all rows above down by one
-            for (int k = i; k > 0; k--) {
-                for (int j = 1; j < W - 1; j++) {
-                    board[k][j] = (k != 1) ? board[k - 1][j] : ' ';
-                }
+// ==================== MAIN GAME LOOP ====================
+int main(int argc, char* argv[]) {
+    // ==================== COMMAND LINE ====================
+    //   --host <port>             Host a versus match
+    //   --join <address> <port>   Join a versus match
+    //   --lag <ms>                Delay outgoing versus packets (rollback testing on loopback)
+    //   --spectate <file|udp:port> Stream the game to a spectator viewer
+    //   --watch <file|udp:port>   Headless spectator viewer (prints the board)
+    //   --replay <archive> <n>    Watch game n of a replay archive
+    //   --list <archive> [seed|player|score|date] [value]  Print an archive's index
+    //   --verify <archive>        Re-simulate every game in an archive and check it
+    //   --analyze <dir|archive> [threads]  Aggregate statistics over recorded games
+    //   --bench-eval [batches]    Check the vector board evaluators against the scalar one
+    //   --validate [seconds] [threads]  Check the row-mask fast paths against the board code
+    //   --giant [cols] [rows]     Play on a giant board (up to 128 x 65536, default 128 x 2000)
+    //   --giant-bench [cols] [rows] [pieces]  Headless lock and clear timings on a giant board
+    //   --bot [depth]             Let the built-in bot play (depth 1-3, default 2)
+    //   --bot-threads <n>         Search threads for the depth 3 bot
+    //   --bot-bench [games] [threads] [depth]  Headless bot games with search statistics
+    //   --solve <board> <pieces> [lines] [threads]  Find a perfect clear (or lines) for a board file
+    //   --royale [players] [seed] [threads] [depth]  Headless bot battle royale with garbage between boards
+    //   --agent <name>            Let an external agent play through shared memory
+    //   --agent-demo <name> [depth]  Reference agent for a game started with --agent <name>
+    //   --player <name>           Name stored with recorded games
+    //   --no-record               Don't record games to replays/replays.tra
+    //   --trace                   Record scope timings from the start (F9 saves them)
+    //   --no-audio                Don't load or play any sound
+    //   --speed <x>               Fast-forward bot games and replays (1-1000, +/- change it while watching)
+    //   --soft-render             Draw the playing and pause screens on the CPU (machines without a GPU)
+    //   --capture                 Record the window to captures/ from the start (F10 toggles)
+    //   --hitch-ms <ms>           Frame time that writes a flight recorder dump (default 50, 0 = never)
+    //   --flight <file>           Print a flight recorder dump
+    //   --alloc-stats             Print allocations per frame and phase (-DTETRIS_ALLOC_TRACKING builds)
+    //   --alloc-assert            Abort when a steady gameplay frame allocates (same builds)
+    traceSetThreadName("main");
+    bool captureOnStart = false;
+    if (const char* user = getenv("USERNAME")) recorder.player = user;
+    else if (const char* user = getenv("USER")) recorder.player = user;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--host" && i + 1 < argc) {
+            if (!versusStart(versus, true, "", (unsigned short)atoi(argv[++i]))) return -1;
+        } else if (arg == "--join" && i + 2 < argc) {
+            string address = argv[++i];
+            if (!versusStart(versus, false, address, (unsigned short)atoi(argv[++i]))) return -1;
+        } else if (arg == "--lag" && i + 1 < argc) {
+            versus.lagMs = atoi(argv[++i]);
+        } else if (arg == "--spectate" && i + 1 < argc) {
+            if (!spectatorOpen(argv[++i])) {
+                fprintf(stderr, "Cannot open spectator output %s\n", argv[i]);
+                return -1;
             }
-            i++;  // Check same row again (shifted down)
+        } else if (arg == "--watch" && i + 1 < argc) {
+            return runSpectatorViewer(argv[++i]);
+        } else if (arg == "--replay" && i + 2 < argc) {
+            const char* path = argv[++i];
+            if (!playbackOpen(path, strtoull(argv[++i], nullptr, 10))) return -1;
+        } else if (arg == "--list" && i + 1 < argc) {
+            const char* path = argv[++i];
+            const char* order = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : nullptr;
+            const char* value = (order && i + 1 < argc) ? argv[++i] : nullptr;
+            return runArchiveList(path, order, value);
+        } else if (arg == "--analyze" && i + 1 < argc) {
+            const char* path = argv[++i];
+            int threads = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 0;
+            return runReplayAnalyzer(path, threads);
+        } else if (arg == "--bench-eval") {
+            int batches = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 100000;
+            return runEvalBenchmark(batches);
+        } else if (arg == "--validate") {
+            double seconds = (i + 1 < argc && argv[i + 1][0] != '-') ? atof(argv[++i]) : 10.0;
+            int threads = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 0;
+            return runValidation(seconds, threads);
+        } else if (arg == "--verify" && i + 1 < argc) {
+            return runArchiveVerify(argv[++i]);
+        } else if (arg == "--giant" || arg == "--giant-bench") {
+            int cols = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : GIANT_MAX_COLS;
+            int rows = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 2000;
+            if (arg == "--giant") return runGiantMode(cols, rows);
+            int pieces = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : GIANT_BENCH_PIECES;
+            return runGiantBench(cols, rows, pieces);
+        } else if (arg == "--solve" && i + 2 < argc) {
+            const char* boardPath = argv[++i];
+            const char* pieces = argv[++i];
+            int lines = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 0;
+            int threads = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 0;
+            return runSolve(boardPath, pieces, lines, threads);
+        } else if (arg == "--royale") {
+            int players = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 100;
+            uint32_t seed = (i + 1 < argc && argv[i + 1][0] != '-') ? (uint32_t)strtoul(argv[++i], nullptr, 10) : 1;
+            int threads = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 0;
+            int depth = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 1;
+            return runRoyale(players, seed, threads, depth);
+        } else if (arg == "--bot") {
+            bot.enabled = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') bot.depth = max(1, min(BOT_MAX_DEPTH, atoi(argv[++i])));
+            recorder.player = "bot";
+        } else if (arg == "--bot-threads" && i + 1 < argc) {
+            bot.threads = atoi(argv[++i]);
+        } else if (arg == "--bot-bench") {
+            int games = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 20;
+            int threads = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 0;
+            if (i + 1 < argc && argv[i + 1][0] != '-') bot.depth = max(1, min(BOT_MAX_DEPTH, atoi(argv[++i])));
+            return runBotBench(games, threads);
+        } else if (arg == "--agent" && i + 1 < argc) {
+            if (!agentOpen(agent, argv[++i], true)) return -1;
+            recorder.player = "agent";
+        } else if (arg == "--agent-demo" && i + 1 < argc) {
+            const char* name = argv[++i];
+            int depth = (i + 1 < argc && argv[i + 1][0] != '-') ? max(1, min(BOT_MAX_DEPTH, atoi(argv[++i]))) : 2;
+            return runAgentDemo(name, depth);
+        } else if (arg == "--player" && i + 1 < argc) {
+            recorder.player = argv[++i];
+        } else if (arg == "--no-record") {
+            recorder.enabled = false;
+        } else if (arg == "--trace") {
+            traceEnabled = true;
+        } else if (arg == "--no-audio") {
+            audioEnabled = false;
+        } else if (arg == "--speed" && i + 1 < argc) {
+            playSpeed = max(1, min(FAST_FORWARD_MAX_SPEED, atoi(argv[++i])));
+        } else if (arg == "--soft-render") {
+            soft.enabled = true;
+        } else if (arg == "--capture") {
+            captureOnStart = true;
+        } else if (arg == "--hitch-ms" && i + 1 < argc) {
+            flight.hitchMs = (uint32_t)max(0, atoi(argv[++i]));
+        } else if (arg == "--flight" && i + 1 < argc) {
+            return runFlightPrint(argv[++i]);
+        } else if (arg == "--alloc-stats" || arg == "--alloc-assert") {
+#ifndef TETRIS_ALLOC_TRACKING
+            fprintf(stderr, "%s needs a build with -DTETRIS_ALLOC_TRACKING\n", arg.c_str());
+            return -1;
+#endif
+            if (arg == "--alloc-stats") allocStats = true;
+            else allocAssert = true;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return -1;
         }
     }
-    return cleared;
-}
 
-// Reset game to initial state
-void resetGame() {
-    initBoard();
-    delete currentPiece;
-    delete nextPiece;
-    currentPiece = createRandomPiece();
-    nextPiece = createRandomPiece();
-    x = 4;
-    y = 0;
-    gameDelay = 0.8f;
-    isGameOver = false;
-    gScore = 0;
-    gLines = 0;
-    gLevel = 0;
-    currentLevel = 0;
-}
+    // Settings come back in every mode; a saved game only in normal play, the
+    // only mode that saves (see AUTOSAVE)
+    bool autosaving = !versus.active && !playback.active && !bot.enabled && !agent.shared;
+    autosaveLoad();
+    if (!autosaving) vector<uint8_t>().swap(autosave.resume);
 
-// ==================== MAIN GAME LOOP ====================
-int main() {
-    // Window setup
-    RenderWindow window(VideoMode(Vector2u(PLAY_W_PX + SIDEBAR_W, PLAY_H_PX)), "SS008 - Tetris");
+    // Window setup (versus shows the opponent's board on the right)
+    TraceScope windowTrace("load.window");
+    const int windowW = PLAY_W_PX + SIDEBAR_W + (versus.active ? PLAY_W_PX : 0);
+    RenderWindow window(VideoMode(Vector2u(windowW, PLAY_H_PX)), "SS008 - Tetris");
     window.setFramerateLimit(60);  // 60 FPS cap
 
     // Load window icon
@@ -612,43 +7911,51 @@ int main() {
     if (icon.loadFromFile("assets/logo.png")) {
         window.setIcon(icon);
     }
+    windowTrace.end();
+    if (captureOnStart && !captureStart(window)) return -1;
 
     SidebarUI ui = makeSidebarUI();
 
     // ==================== AUDIO LOADING ====================
     // Load music and sound effects from assets folder
-    if (!bgMusic.openFromFile("assets/loop_theme.ogg")) return -1;
-    if (!clearBuffer.loadFromFile("assets/line_clear.ogg")) return -1;
-    if (!landBuffer.loadFromFile("assets/bumper_end.ogg")) return -1;
-    if (!gameOverBuffer.loadFromFile("assets/game_over.ogg")) return -1;
-    if (!settingClickBuffer.loadFromFile("assets/insetting_click.ogg")) return -1;
-
-    // Create sound objects from buffers
-    clearSound = new sf::Sound(clearBuffer);
-    landSound = new sf::Sound(landBuffer);
-    gameOverSound = new sf::Sound(gameOverBuffer);
-    settingClickSound = new sf::Sound(settingClickBuffer);
-
-    // Setup audio
-    bgMusic.setLooping(true);
-    bgMusic.setVolume(musicVolume);
-    bgMusic.play();
+    if (audioEnabled) {
+        TraceScope audioTrace("load.audio");
+        if (!bgMusic.openFromFile("assets/loop_theme.ogg")) return -1;
+        if (!clearBuffer.loadFromFile("assets/line_clear.ogg")) return -1;
+        if (!landBuffer.loadFromFile("assets/bumper_end.ogg")) return -1;
+        if (!gameOverBuffer.loadFromFile("assets/game_over.ogg")) return -1;
+        if (!settingClickBuffer.loadFromFile("assets/insetting_click.ogg")) return -1;
+        audioTrace.end();
+
+        // Sounds now only play on the audio thread
+        audioStart();
+        emitEvent(EngineEvent::MUSIC_PLAY);
+    }
+
+    telemetryStart();
+    if (autosaving) autosaveStart();
+    flightStart();
 
     // ==================== GAME INITIALIZATION ====================
-    srand((unsigned)time(0));  // Random seed
-    refillPieceQueue();         // Initialize 7-bag shuffle
-    currentPiece = createRandomPiece();
-    nextPiece = createRandomPiece();
-    initBoard();
+    resetGame();
+    if (versus.active) gameState = GameState::PLAYING;  // Versus skips the menu
+    if (playback.active) {
+        playbackSeek(0);
+        gameState = GameState::PLAYING;
+    }
 
     Clock clock;
-    float timer = 0.f;           // Gravity timer
-    float inputTimer = 0.f;      // Input delay timer
-    const float inputDelay = 0.1f;  // Minimum time between left/right moves
+    float tickTimer = 0.f;       // Time not yet consumed by fixed simulation ticks
+    uint8_t pressedInput = 0;    // Rotate/drop presses waiting for the next tick
+    bool presentedIdle = false;  // The last frame presented already shows the idle screen
 
     // ==================== UI FONT LOADING ====================
     Font font;
+    TraceScope fontTrace("load.font");
     if (!font.openFromFile("assets/Monocraft.ttf")) return -1;
+    warmTextGlyphs(font);
+    if (soft.enabled) softInit(font);
+    fontTrace.end();
 
     // ===== MAIN MENU TITLE =====
     Text title(font);
@@ -675,10 +7982,24 @@ int main() {
     };
 
     // Create menu buttons
+    auto [resumeBtn, resumeText]   = createButton("RESUME",   160);
     auto [startBtn, startText]     = createButton("START",    160);
     auto [settingBtn, settingText] = createButton("SETTINGS", 230);
     auto [exitBtn, exitText]       = createButton("EXIT",     300);
 
+    // RESUME heads the menu while there is a saved game, the rest move down
+    auto layoutMenu = [&]() {
+        float top = autosave.resume.empty() ? 160.f : 230.f;
+        RectangleShape* btns[] = { &startBtn, &settingBtn, &exitBtn };
+        Text* texts[] = { &startText, &settingText, &exitText };
+        for (int i = 0; i < 3; i++) {
+            float by = top + 70.f * i;
+            btns[i]->setPosition(sf::Vector2f{btnX, by});
+            texts[i]->setPosition(sf::Vector2f{texts[i]->getPosition().x, by + 10.f});
+        }
+    };
+    layoutMenu();
+
     auto isClicked = [&](RectangleShape& btn, Vector2f mousePos) {
         return btn.getGlobalBounds().contains(mousePos);    
     };
@@ -688,30 +8009,67 @@ int main() {
     auto handCursor = sf::Cursor::createFromSystem(sf::Cursor::Type::Hand);
 
     // ==================== VIEW SETUP (For Aspect Ratio) ====================
-    float baseW = static_cast<float>(PLAY_W_PX + SIDEBAR_W);
+    float baseW = static_cast<float>(windowW);
     float baseH = static_cast<float>(PLAY_H_PX);
     View view(FloatRect({0.f, 0.f}, {baseW, baseH}));
     window.setView(view);
 
     // ==================== MAIN GAME LOOP ====================
     while (window.isOpen()) {
+        TRACE_SCOPE("frame");
+        allocSetPhase(ALLOC_OTHER);
+        flightPhase(ALLOC_OTHER);
+        beginTextFrame();
         float dt = clock.restart().asSeconds();
+        bool steadyFrame = gameState == GameState::PLAYING && !isGameOver && gameTick >= ALLOC_WARMUP_TICKS;
         
         // Only update timer during active gameplay
-        if (!isGameOver && gameState == GameState::PLAYING) {
-            timer += dt;
-            inputTimer += dt;
+        int speed = fastForwardSpeed();
+        if (gameState == GameState::PLAYING && (!isGameOver || versus.active)) {
+            tickTimer = min(tickTimer + dt * speed, 0.25f * speed);  // Don't try to catch up after long stalls
         }
+        if (gameState == GameState::PLAYING) effectsUpdate(dt);  // Effects freeze with the pause menu
 
         // ==================== EVENT HANDLING ====================
-        while (const auto event = window.pollEvent()) {
+        TraceScope eventsTrace("events");
+        allocSetPhase(ALLOC_EVENTS);
+        flightPhase(ALLOC_EVENTS);
+        // An idle screen that is already on display sleeps until an event
+        bool idle = screenIsIdle();
+        bool waited = idle && presentedIdle;
+        optional<Event> event = waited ? window.waitEvent(sf::milliseconds(IDLE_WAIT_MS)) : window.pollEvent();
+        bool gotEvent = event.has_value();
+        if (waited) clock.restart();  // The wait isn't play time
+        for (; event; event = window.pollEvent()) {
+            flightRecordEvent(*event);
+            // ===== TRACING: F9 starts recording, then saves what was recorded =====
+            if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                if (keyPressed->code == Keyboard::Key::F9) {
+                    if (traceEnabled) traceDump();
+                    else {
+                        traceEnabled = true;
+                        printf("trace: recording, press F9 again to save\n");
+                    }
+                }
+                // ===== FLIGHT RECORDER: F8 writes what it holds =====
+                if (keyPressed->code == Keyboard::Key::F8 && !flightDump(FLIGHT_HOTKEY)) {
+                    printf("flight: still writing the last dump\n");
+                }
+                // ===== VIDEO CAPTURE: F10 starts and stops recording =====
+                if (keyPressed->code == Keyboard::Key::F10) {
+                    if (capture.active) captureStop();
+                    else captureStart(window);
+                    steadyFrame = false;  // Starting allocates the frame buffers
+                }
+            }
+
             // ===== PAUSE TOGGLE (press P or Esc from PLAYING to enter PAUSE) =====
             // This is checked first to intercept pause key before other handlers
             if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
-                if ((keyPressed->code == Keyboard::Key::P || keyPressed->code == Keyboard::Key::Escape) && gameState == GameState::PLAYING && !isGameOver) {
+                if ((keyPressed->code == Keyboard::Key::P || keyPressed->code == Keyboard::Key::Escape) && gameState == GameState::PLAYING && !isGameOver && !versus.active) {
                     stateBeforePause = GameState::PLAYING;
                     gameState = GameState::PAUSE;
-                    bgMusic.pause();
+                    emitEvent(EngineEvent::MUSIC_PAUSE);
                     continue;
                 }
             }
@@ -724,9 +8082,19 @@ int main() {
                         Vector2i pixelPos = Mouse::getPosition(window);
                         Vector2f mousePos = window.mapPixelToCoords(pixelPos);
 
+                        // RESUME button - continue the saved game (paused)
+                        if (!autosave.resume.empty() && isClicked(resumeBtn, mousePos)) {
+                            autosaveResumeGame();
+                            layoutMenu();
+                            continue;
+                        }
                         // START button - begin new game
                         if (isClicked(startBtn, mousePos)) {
+                            autosaveDiscardGame();
+                            layoutMenu();
                             resetGame();
+                            telemetryBeginGame();
+                            replayBeginGame();
                             gameState = GameState::PLAYING;
                             continue;
                         }
@@ -771,9 +8139,49 @@ int main() {
                 window.setView(view);
             }
 
+            // ===== VERSUS EXIT =====
+            // Esc leaves a match; once it is over, Enter or a click closes the game too
+            if (versus.active) {
+                bool matchOver = versus.phase == VersusPhase::FINISHED || versus.phase == VersusPhase::DISCONNECTED ||
+                                 versus.phase == VersusPhase::DESYNC;
+                if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                    if (keyPressed->code == Keyboard::Key::Escape || (matchOver && keyPressed->code == Keyboard::Key::Enter)) {
+                        window.close();
+                    }
+                }
+                if (matchOver && event->is<Event::MouseButtonPressed>()) {
+                    window.close();
+                }
+            }
+
+            // ===== REPLAY SEEKING =====
+            // Left/Right jump 5 seconds, 0-9 jump to that tenth of the game, Home restarts
+            if (playback.active && gameState == GameState::PLAYING) {
+                if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                    int64_t total = playback.cursor.replay.header->ticks;
+                    int key = (int)keyPressed->code - (int)Keyboard::Key::Num0;
+                    bool wasOver = isGameOver;
+                    if (keyPressed->code == Keyboard::Key::Left) playbackSeek(gameTick - 300);
+                    else if (keyPressed->code == Keyboard::Key::Right) playbackSeek(gameTick + 300);
+                    else if (keyPressed->code == Keyboard::Key::Home) playbackSeek(0);
+                    else if (key >= 0 && key <= 9) playbackSeek(total * key / 10);
+                    if (wasOver && !isGameOver) emitEvent(EngineEvent::MUSIC_PLAY);
+                }
+            }
+
+            // ===== FAST FORWARD =====
+            // + speeds a bot game or replay up, - slows it down
+            if ((playback.active || bot.enabled) && !versus.active && gameState == GameState::PLAYING) {
+                if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                    Keyboard::Key code = keyPressed->code;
+                    if (code == Keyboard::Key::Equal || code == Keyboard::Key::Add) fastForwardChange(1);
+                    else if (code == Keyboard::Key::Hyphen || code == Keyboard::Key::Subtract) fastForwardChange(-1);
+                }
+            }
+
             // ===== GAME OVER CLICK HANDLING =====
             // Process mouse clicks on game over menu buttons
-            if (isGameOver && gameState == GameState::PLAYING) {
+            if (isGameOver && gameState == GameState::PLAYING && !versus.active) {
                 if (const auto* mouse = event->getIf<Event::MouseButtonPressed>()) {
                     if (mouse->button == Mouse::Button::Left) {
                         Vector2i pixelPos = Mouse::getPosition(window);
@@ -783,16 +8191,23 @@ int main() {
                         const float goBtnW = 200.f;
                         const float goBtnX = (fullW - goBtnW) / 2.f;
                         
-                        // RESTART button - reset and play again
+                        // RESTART button - reset and play again (a replay starts over)
                         if (mousePos.x > goBtnX && mousePos.x < goBtnX + goBtnW && mousePos.y > 230 && mousePos.y < 280) {
-                            resetGame();
-                            bgMusic.play();
+                            if (playback.active) {
+                                playbackSeek(0);
+                            } else {
+                                resetGame();
+                                telemetryBeginGame();
+                                replayBeginGame();
+                            }
+                            emitEvent(EngineEvent::MUSIC_PLAY);
                         }
                         // MENU button - return to main menu
                         if (mousePos.x > goBtnX && mousePos.x < goBtnX + goBtnW && mousePos.y > 300 && mousePos.y < 350) {
+                            playbackClose();
                             resetGame();
                             gameState = GameState::MENU;
-                            bgMusic.play();
+                            emitEvent(EngineEvent::MUSIC_PLAY);
                         }
                         // EXIT button - close game
                         if (mousePos.x > goBtnX && mousePos.x < goBtnX + goBtnW && mousePos.y > 370 && mousePos.y < 420) {
@@ -808,12 +8223,16 @@ int main() {
                 if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
                     // W key - ROTATE piece
                     if (keyPressed->code == Keyboard::Key::W) {
-                        currentPiece->rotate(x, y);
+                        pressedInput |= IN_ROTATE;
                     }
                     // SPACE - HARD DROP (instantly drop piece to bottom)
                     else if (keyPressed->code == Keyboard::Key::Space) {
-                        while (canMove(0, 1)) y++;
-                        timer = gameDelay + 10.0f;  // Force immediate landing
+                        pressedInput |= IN_DROP;
+                    }
+                    // F5 - look for a perfect clear from here
+                    else if (keyPressed->code == Keyboard::Key::F5 && !versus.active && !playback.active) {
+                        solverHintStart();
+                        steadyFrame = false;  // Starts the search thread
                     }
                 }
             }
@@ -821,9 +8240,19 @@ int main() {
             // Handle keyboard shortcuts in main menu
             else if (gameState == GameState::MENU) {
                 if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                    // R - Resume the saved game
+                    if (keyPressed->code == Keyboard::Key::R && !autosave.resume.empty()) {
+                        autosaveResumeGame();
+                        layoutMenu();
+                        continue;
+                    }
                     // ENTER - Start game
                     if (keyPressed->code == Keyboard::Key::Enter) {
+                        autosaveDiscardGame();
+                        layoutMenu();
                         resetGame();
+                        telemetryBeginGame();
+                        replayBeginGame();
                         gameState = GameState::PLAYING;
                     }
                     // ESC - Exit application
@@ -845,51 +8274,42 @@ int main() {
                         // Left arrow (decrease volume)
                         if (mousePos.x >= 255 && mousePos.x <= 280 && mousePos.y >= 125 && mousePos.y <= 155) {
                             musicVolume = max(0.f, musicVolume - 5.f);
-                            bgMusic.setVolume(musicVolume);
-                            settingClickSound->play();
+                            emitVolume();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                         // Right arrow (increase volume)
                         if (mousePos.x >= 485 && mousePos.x <= 510 && mousePos.y >= 125 && mousePos.y <= 155) {
                             musicVolume = min(100.f, musicVolume + 5.f);
-                            bgMusic.setVolume(musicVolume);
-                            settingClickSound->play();
+                            emitVolume();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                         // Slider drag
                         if (mousePos.x >= 285 && mousePos.x <= 485 && mousePos.y >= 127 && mousePos.y <= 157) {
                             musicVolume = static_cast<float>(mousePos.x - 285) / 2.f;
                             musicVolume = max(0.f, min(100.f, musicVolume));
-                            bgMusic.setVolume(musicVolume);
-                            settingClickSound->play();
+                            emitVolume();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
 
                         // ===== SFX VOLUME SLIDER =====
                         // Left arrow
                         if (mousePos.x >= 255 && mousePos.x <= 280 && mousePos.y >= 185 && mousePos.y <= 215) {
                             sfxVolume = max(0.f, sfxVolume - 5.f);
-                            clearSound->setVolume(sfxVolume);
-                            landSound->setVolume(sfxVolume);
-                            gameOverSound->setVolume(sfxVolume);
-                            settingClickSound->setVolume(sfxVolume);
-                            settingClickSound->play();
+                            emitVolume();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                         // Right arrow
                         if (mousePos.x >= 485 && mousePos.x <= 510 && mousePos.y >= 185 && mousePos.y <= 215) {
                             sfxVolume = min(100.f, sfxVolume + 5.f);
-                            clearSound->setVolume(sfxVolume);
-                            landSound->setVolume(sfxVolume);
-                            gameOverSound->setVolume(sfxVolume);
-                            settingClickSound->setVolume(sfxVolume);
-                            settingClickSound->play();
+                            emitVolume();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                         // Slider drag
                         if (mousePos.x >= 285 && mousePos.x <= 485 && mousePos.y >= 187 && mousePos.y <= 217) {
                             sfxVolume = static_cast<float>(mousePos.x - 285) / 2.f;
                             sfxVolume = max(0.f, min(100.f, sfxVolume));
-                            clearSound->setVolume(sfxVolume);
-                            landSound->setVolume(sfxVolume);
-                            gameOverSound->setVolume(sfxVolume);
-                            settingClickSound->setVolume(sfxVolume);
-                            settingClickSound->play();
+                            emitVolume();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
 
                         // ===== BRIGHTNESS SLIDER =====
@@ -897,25 +8317,25 @@ int main() {
                         // Left arrow
                         if (mousePos.x >= 255 && mousePos.x <= 280 && mousePos.y >= 245 && mousePos.y <= 275) {
                             brightness = max(51.f, brightness - 10.f);
-                            settingClickSound->play();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                         // Right arrow
                         if (mousePos.x >= 485 && mousePos.x <= 510 && mousePos.y >= 245 && mousePos.y <= 275) {
                             brightness = min(255.f, brightness + 10.f);
-                            settingClickSound->play();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                         // Slider drag - map 0-200px to 51-255 brightness
                         if (mousePos.x >= 285 && mousePos.x <= 485 && mousePos.y >= 247 && mousePos.y <= 277) {
                             float normalized = static_cast<float>(mousePos.x - 285) / 200.f;
                             brightness = normalized * (255.f - 51.f) + 51.f;
-                            settingClickSound->play();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
 
                         // ===== GHOST PIECE TOGGLE =====
                         // Click checkbox to toggle ghost piece display
                         if (mousePos.x >= 280 && mousePos.x <= 315 && mousePos.y >= 303 && mousePos.y <= 337) {
                             ghostPieceEnabled = !ghostPieceEnabled;
-                            settingClickSound->play();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
 
                         // ===== BACK BUTTON =====
@@ -926,12 +8346,12 @@ int main() {
                             // Return to where we came from
                             if (stateBeforePause == GameState::PAUSE) {
                                 gameState = GameState::PAUSE;
-                                bgMusic.pause();
+                                emitEvent(EngineEvent::MUSIC_PAUSE);
                             } else {
                                 gameState = GameState::MENU;
-                                bgMusic.play();
+                                emitEvent(EngineEvent::MUSIC_PLAY);
                             }
-                            settingClickSound->play();
+                            emitEvent(EngineEvent::UI_CLICK);
                         }
                     }
                 }
@@ -941,10 +8361,10 @@ int main() {
                         // Return to where we came from
                         if (stateBeforePause == GameState::PAUSE) {
                             gameState = GameState::PAUSE;
-                            bgMusic.pause();
+                            emitEvent(EngineEvent::MUSIC_PAUSE);
                         } else {
                             gameState = GameState::MENU;
-                            bgMusic.play();
+                            emitEvent(EngineEvent::MUSIC_PLAY);
                         }
                     }
                 }
@@ -965,7 +8385,7 @@ int main() {
                         // RESUME button - continue game
                         if (mousePos.x > pauseBtnX && mousePos.x < pauseBtnX + pauseBtnW && mousePos.y > 200 && mousePos.y < 250) {
                             gameState = GameState::PLAYING;
-                            bgMusic.play();
+                            emitEvent(EngineEvent::MUSIC_PLAY);
                         }
                         // SETTINGS button - open settings from pause
                         if (mousePos.x > pauseBtnX && mousePos.x < pauseBtnX + pauseBtnW && mousePos.y > 270 && mousePos.y < 320) {
@@ -974,9 +8394,10 @@ int main() {
                         }
                         // MENU button - return to main menu
                         if (mousePos.x > pauseBtnX && mousePos.x < pauseBtnX + pauseBtnW && mousePos.y > 340 && mousePos.y < 390) {
+                            playbackClose();
                             resetGame();
                             gameState = GameState::MENU;
-                            bgMusic.play();
+                            emitEvent(EngineEvent::MUSIC_PLAY);
                         }
                     }
                 }
@@ -984,68 +8405,80 @@ int main() {
                 if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
                     if (keyPressed->code == Keyboard::Key::P || keyPressed->code == Keyboard::Key::Escape) {
                         gameState = GameState::PLAYING;
-                        bgMusic.play();
+                        emitEvent(EngineEvent::MUSIC_PLAY);
                     }
                 }
             }
         }
 
-        // ==================== CONTINUOUS INPUT (Held Keys) ====================
-        // Handle continuous input for movement (separate from discrete event input)
-        if (gameState == GameState::PLAYING && !isGameOver) {
-            if (inputTimer > inputDelay) {  // Check movement every inputDelay seconds
-                // Handle LEFT movement
-                if (Keyboard::isKeyPressed(Keyboard::Key::A)) {
-                    if (canMove(-1, 0)) x--;
-                    inputTimer = 0;
-                }
-                else if (Keyboard::isKeyPressed(Keyboard::Key::D)) {
-                    if (canMove(1, 0)) x++;
-                    inputTimer = 0;
-                }
-                else if (Keyboard::isKeyPressed(Keyboard::Key::S)) {
-                    if (canMove(0, 1)) y++;
-                    inputTimer = 0;
-                }
-            }
+        eventsTrace.end();
 
-            // ===== GRAVITY (Piece Falling) =====
-            // Apply gravity - move piece down if possible
-            if (timer > gameDelay) {  // Check gravity every gameDelay seconds
-                if (canMove(0, 1)) {
-                    y++;  // Move piece down
-                } else {
-                    // Piece cannot move down - it lands
-                    landSound->play();
-                    block2Board();  // Commit piece to board
-                    int cleared = removeLine();  // Check for completed lines
-                    applyLineClearScore(cleared);  // Update score and level
-                    
-                    // Spawn next piece
-                    delete currentPiece;
-                    currentPiece = nextPiece;
-                    nextPiece = createRandomPiece();
-                    x = 4;  // Spawn at center top
-                    y = 0;
-                    
-                    // Check if new piece can spawn (game over condition)
-                    if (!canMove(0, 0)) {
-                        isGameOver = true;
-                        gameOverSound->play();
-                        bgMusic.stop();
-                    }
+        // ==================== CONTINUOUS INPUT (Held Keys) ====================
+        // Held movement keys are sampled once per frame and repeated by the simulation
+        uint8_t heldInput = 0;
+        if (Keyboard::isKeyPressed(Keyboard::Key::A)) heldInput |= IN_LEFT;
+        else if (Keyboard::isKeyPressed(Keyboard::Key::D)) heldInput |= IN_RIGHT;
+        else if (Keyboard::isKeyPressed(Keyboard::Key::S)) heldInput |= IN_DOWN;
+
+        // ==================== SIMULATION ====================
+        TraceScope simulationTrace("simulation");
+        allocSetPhase(ALLOC_SIMULATION);
+        flightPhase(ALLOC_SIMULATION);
+        // Run one fixed tick per TICK_SECONDS of play, independent of frame rate
+        auto tickDeadline = fastForwardBeginFrame(fastForwardSpeed());
+        if (versus.active) {
+            versusUpdate(versus, dt, tickTimer, heldInput, pressedInput);
+        }
+        else if (playback.active) {
+            playbackUpdate(tickTimer, tickDeadline);
+            pressedInput = 0;
+        }
+        else if (gameState == GameState::PLAYING && !isGameOver) {
+            while (tickTimer >= TICK_SECONDS && !isGameOver) {
+                if (std::chrono::steady_clock::now() >= tickDeadline) {
+                    tickTimer = 0.f;  // Fast forward ran out of frame time
+                    break;
                 }
-                timer = 0;
+                simTick(bot.enabled ? botInput() : agent.shared ? agentInput() : heldInput | pressedInput);
+                gStats.gameTime += TICK_SECONDS;  // Ticks fast forward dropped weren't played
+                agentPublish();
+                pressedInput = 0;
+                tickTimer -= TICK_SECONDS;
             }
         }
+        else {
+            pressedInput = 0;
+        }
+        // A fast-forwarded batch records only where it ended, so the flight recorder still holds seconds of play
+        if (eventThinning == EventThinning::MUTED) flightRecord(FlightEvent::TICK, 0, gameTick);
+        spectatorFrame();
+        agentPublish();
+        solverHintUpdate();
+        autosaveUpdate();
+        simulationTrace.end();
+
+        // Nothing happened on an idle screen: keep what is shown
+        if (waited && !gotEvent) {
+            allocEndFrame(dt, false);
+            flightEndFrame(true);
+            continue;
+        }
+        presentedIdle = idle && screenIsIdle();
 
         // ==================== RENDERING ====================
+        TraceScope renderTrace("render");
+        allocSetPhase(ALLOC_RENDER);
+        flightPhase(ALLOC_RENDER);
         window.clear(Color::Black);  // Clear screen for new frame
 
         // ===== MENU RENDERING =====
         // Draw main menu with title and buttons
         if (gameState == GameState::MENU) {
             window.draw(title);
+            if (!autosave.resume.empty()) {
+                window.draw(resumeBtn);
+                window.draw(resumeText);
+            }
             window.draw(startBtn);
             window.draw(startText);
             window.draw(settingBtn);
@@ -1054,15 +8487,23 @@ int main() {
             window.draw(exitText);
         }
 
+        // ===== SOFTWARE RENDERER: playing and pause screens as one texture =====
+        bool softFrame = softScreen();
+        if (softFrame) {
+            softDrawScreen(ui);
+            softPresent(window);
+        }
+
         // ===== GAME PLAYING STATE RENDERING =====
         // Draw the active game board, pieces, and sidebar
-        if (gameState == GameState::PLAYING) {
-            // Draw Board
+        if (gameState == GameState::PLAYING && !softFrame) {
+            // Draw Board (rows above a fresh clear are still falling into place)
+            static RectangleShape rect(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));  // Reused: shapes allocate their vertices
             for (int i = 0; i < H; i++) {
                 for (int j = 0; j < W; j++) {
                     if (board[i][j] != ' ') {
-                        RectangleShape rect(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));
-                        rect.setPosition(Vector2f(j * TILE_SIZE, i * TILE_SIZE));
+                        float fall = (j > 0 && j < W - 1) ? effects.rowOffset[i] : 0.f;
+                        rect.setPosition(Vector2f(j * TILE_SIZE, i * TILE_SIZE - fall));
                         rect.setFillColor(getColor(board[i][j]));
                         window.draw(rect);
                     }
@@ -1076,24 +8517,26 @@ int main() {
                     for (int i = 0; i < 4; i++) {
                         for (int j = 0; j < 4; j++) {
                             if (currentPiece->shape[i][j] != ' ') {
-                                RectangleShape rect(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));
-                                rect.setPosition(Vector2f((x + j) * TILE_SIZE, (ghostY + i) * TILE_SIZE));
-                                rect.setFillColor(Color::Transparent);
-                                rect.setOutlineThickness(2.f);
-                                rect.setOutlineColor(Color(255, 255, 255, 150));
-                                window.draw(rect);
+                                static RectangleShape ghost(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));
+                                ghost.setPosition(Vector2f((x + j) * TILE_SIZE, (ghostY + i) * TILE_SIZE));
+                                ghost.setFillColor(Color::Transparent);
+                                ghost.setOutlineThickness(2.f);
+                                ghost.setOutlineColor(Color(255, 255, 255, 150));
+                                window.draw(ghost);
                             }
                         }
                     }
                 }
             }
 
+            // Draw the perfect clear hint (F5)
+            solverHintDraw(window, font);
+
             // Draw Current Piece
             if (!isGameOver) {
                 for (int i = 0; i < 4; i++) {
                     for (int j = 0; j < 4; j++) {
                         if (currentPiece->shape[i][j] != ' ') {
-                            RectangleShape rect(Vector2f(TILE_SIZE - 1, TILE_SIZE - 1));
                             rect.setPosition(Vector2f((x + j) * TILE_SIZE, (y + i) * TILE_SIZE));
                             rect.setFillColor(getColor(currentPiece->shape[i][j]));
                             window.draw(rect);
@@ -1102,11 +8545,23 @@ int main() {
                 }
             }
 
+            // Draw Line Clear and Lock Effects
+            effectsDraw(window);
+
             // Draw Sidebar
             drawSidebar(window, ui, font, gScore, gLevel, gLines, nextPiece);
 
+            // ===== VERSUS: OPPONENT BOARD AND MATCH STATUS =====
+            if (versus.active) {
+                drawVersus(window, font, versus);
+            }
+
+            // ===== REPLAY: POSITION IN THE RECORDED GAME (AND FAST-FORWARD SPEED) =====
+            char status[64];
+            if (fastForwardStatus(status, sizeof(status))) drawText(window, font, status, 6.f, 4.f, 14);
+
             // ===== GAME OVER SCREEN =====
-            if (isGameOver) {
+            if (isGameOver && !versus.active) {
                 // Overlay for play area
                 RectangleShape overlay(Vector2f(PLAY_W_PX, PLAY_H_PX));
                 overlay.setFillColor(Color(0, 0, 0, 200));
@@ -1172,7 +8627,7 @@ int main() {
 
         // ===== PAUSE MENU RENDERING =====
         // Draw game in background with semi-transparent overlay and pause menu
-        if (gameState == GameState::PAUSE) {
+        if (gameState == GameState::PAUSE && !softFrame) {
             // Draw Board (from game)
             for (int i = 0; i < H; i++) {
                 for (int j = 0; j < W; j++) {
@@ -1458,9 +8913,9 @@ int main() {
         }
 
         // ===== BRIGHTNESS OVERLAY =====
-        // Apply darkening overlay based on brightness setting
-        if (brightness < 255.f) {
-            RectangleShape darkenOverlay(Vector2f(PLAY_W_PX + SIDEBAR_W, PLAY_H_PX));
+        // Apply darkening overlay based on brightness setting (the software renderer already did)
+        if (brightness < 255.f && !softFrame) {
+            RectangleShape darkenOverlay(Vector2f(baseW, baseH));
             darkenOverlay.setFillColor(Color(0, 0, 0, static_cast<uint8_t>(255 - brightness)));
             window.draw(darkenOverlay);
         }
@@ -1474,7 +8929,8 @@ int main() {
 
             if (gameState == GameState::MENU) {
                 // Check menu buttons
-                if (isClicked(startBtn, mp) || isClicked(settingBtn, mp) || isClicked(exitBtn, mp)) {
+                if (isClicked(startBtn, mp) || isClicked(settingBtn, mp) || isClicked(exitBtn, mp) ||
+                    (!autosave.resume.empty() && isClicked(resumeBtn, mp))) {
                     isHovering = true;
                 }
             }
@@ -1519,7 +8975,7 @@ int main() {
                     isHovering = true;
                 }
             }
-            else if (gameState == GameState::PLAYING && isGameOver) {
+            else if (gameState == GameState::PLAYING && isGameOver && !versus.active) {
                 const float fullW = PLAY_W_PX + SIDEBAR_W;
                 const float goBtnW = 200.f;
                 const float goBtnX = (fullW - goBtnW) / 2.f;
@@ -1535,17 +8991,38 @@ int main() {
                 window.setMouseCursor(isHovering ? *handCursor : *arrowCursor);
             }
         }
+        renderTrace.end();
 
+        captureFrame(window);
+
+        TRACE_SCOPE("display");  // Includes the wait for the frame limit
+        allocSetPhase(ALLOC_DISPLAY);
+        flightPhase(ALLOC_DISPLAY);
         window.display();
+
+        // Steady = playing from start to end of the frame, outside versus
+        // connection screens and the threaded depth 3 search (it starts threads)
+        steadyFrame = steadyFrame && gameState == GameState::PLAYING && !isGameOver
+                      && (!versus.active || versus.phase == VersusPhase::RUNNING)
+                      && !(bot.enabled && bot.depth >= 3 && bot.threads != 1);
+        allocEndFrame(dt, steadyFrame);
+        flightEndFrame(waited);
     }
 
     // Cleanup
+    if (traceEnabled) traceDump();
+    solverHintStop();
+    captureStop(false);  // The window is closed
+    autosaveStop();      // Before the recording would be archived
+    flightStop();
+    telemetryStop();
+    audioStop();
+    replayStop();
+    playbackClose();
+    spectatorClose();
+    agentClose(agent);
     delete currentPiece;
     delete nextPiece;
-    delete clearSound;
-    delete landSound;
-    delete gameOverSound;
-    delete settingClickSound;
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,380 @@
+// ╔════════════════════════════════════════════════════════════════╗
+// ║         TETRIS GAME - SS008 Batch Environment (C API)           ║
+// ║  See tetris_env.h. Rules follow main.cpp's engine exactly       ║
+// ╚════════════════════════════════════════════════════════════════╝
+
+#include "tetris_env.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+// ==================== CONFIGURATION ====================
+const int ROWS = TETRIS_ENV_ROWS;           // Board rows above the floor (main.cpp: H - 1)
+const int COLS = TETRIS_ENV_COLS;           // Columns between the walls (main.cpp: W - 2)
+const int SPAWN_X = 4, SPAWN_Y = 0;         // Spawn position of the 4x4 box, in board columns (wall = 0)
+const uint16_t FULL_ROW = (1 << COLS) - 1;
+const int ENV_CHUNK = 256;                  // Environments per work item
+
+// ==================== PIECE SHAPES ====================
+// shapes[type][rotation][i] = bits of row i of the 4x4 box, bit j = column j.
+// Built once the way the game's Piece classes turn: the 4x4 grid turns
+// clockwise, T steps through fixed states, O never turns.
+struct ShapeTable {
+    uint8_t rows[7][4][4];
+    int8_t minCol[7][4], maxCol[7][4];     // Filled columns of each shape
+    int8_t maxRow[7][4];                   // Lowest filled row of each shape
+
+    ShapeTable() {
+        static const char* const spawn[7][4] = {
+            { " I  ", " I  ", " I  ", " I  " },  // I
+            { "    ", " OO ", " OO ", "    " },  // O
+            { " T  ", "TTT ", "    ", "    " },  // T
+            { "    ", " SS ", "SS  ", "    " },  // S
+            { "    ", "ZZ  ", " ZZ ", "    " },  // Z
+            { "    ", "J   ", "JJJ ", "    " },  // J
+            { "    ", "  L ", "LLL ", "    " },  // L
+        };
+        static const char* const tStates[4][4] = {
+            { " T  ", "TTT ", "    ", "    " },
+            { " T  ", " TT ", " T  ", "    " },
+            { "    ", "TTT ", " T  ", "    " },
+            { " T  ", "TT  ", " T  ", "    " },
+        };
+        for (int t = 0; t < 7; t++) {
+            char cur[4][4];
+            for (int i = 0; i < 4; i++) memcpy(cur[i], spawn[t][i], 4);
+            for (int r = 0; r < 4; r++) {
+                if (t == 2) {
+                    for (int i = 0; i < 4; i++) memcpy(cur[i], tStates[r][i], 4);
+                }
+                minCol[t][r] = 4;
+                maxCol[t][r] = -1;
+                maxRow[t][r] = -1;
+                for (int i = 0; i < 4; i++) {
+                    rows[t][r][i] = 0;
+                    for (int j = 0; j < 4; j++) {
+                        if (cur[i][j] == ' ') continue;
+                        rows[t][r][i] |= 1 << j;
+                        minCol[t][r] = min<int8_t>(minCol[t][r], j);
+                        maxCol[t][r] = max<int8_t>(maxCol[t][r], j);
+                        maxRow[t][r] = i;
+                    }
+                }
+                if (t != 1 && t != 2) {  // Generic clockwise turn of the grid
+                    char turned[4][4];
+                    for (int i = 0; i < 4; i++) {
+                        for (int j = 0; j < 4; j++) turned[j][3 - i] = cur[i][j];
+                    }
+                    memcpy(cur, turned, sizeof(cur));
+                }
+            }
+        }
+    }
+};
+const ShapeTable shapes;
+
+// ==================== ENVIRONMENT STATE ====================
+// Structure of arrays: one array per field, indexed by environment. A board
+// is ROWS row masks (bit c = column c, row 0 = top), contiguous per
+// environment so one placement touches one or two cache lines.
+struct EnvPool;
+
+struct TetrisEnv {
+    int count = 0;
+    uint32_t firstSeed = 0;
+    vector<uint16_t> boards;                // count * ROWS
+    vector<uint8_t> current, next;          // Piece types
+    vector<uint8_t> bags;                   // count * 7, the current 7-bag
+    vector<uint8_t> bagIndex;               // Next bag slot (7 = empty)
+    vector<uint32_t> rng;                   // xorshift32 state of the bag
+    vector<uint32_t> episode;               // Games started, for the next seed
+    EnvPool* pool = nullptr;
+};
+
+// xorshift32, identical to main.cpp's nextRandom
+static inline uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// main.cpp's createRandomPiece (refillPieceQueue on an empty bag)
+static int drawPiece(TetrisEnv& e, int i) {
+    uint8_t* bag = &e.bags[(size_t)i * 7];
+    if (e.bagIndex[i] >= 7) {
+        for (int k = 0; k < 7; k++) bag[k] = (uint8_t)k;
+        for (int k = 6; k > 0; k--) {
+            int r = nextRandom(e.rng[i]) % (k + 1);
+            swap(bag[k], bag[r]);
+        }
+        e.bagIndex[i] = 0;
+    }
+    return bag[e.bagIndex[i]++];
+}
+
+// main.cpp's seedRandom + resetGame
+static void startGame(TetrisEnv& e, int i) {
+    uint32_t seed = e.firstSeed + (uint32_t)i + e.episode[i]++ * (uint32_t)e.count;
+    e.rng[i] = seed ? seed : 0x9E3779B9u;
+    e.bagIndex[i] = 7;
+    memset(&e.boards[(size_t)i * ROWS], 0, ROWS * sizeof(uint16_t));
+    e.current[i] = (uint8_t)drawPiece(e, i);
+    e.next[i] = (uint8_t)drawPiece(e, i);
+}
+
+// ==================== PLACEMENT ====================
+// Row bits of shape row m with its box at board column x (bit c = column c + 1)
+static inline uint16_t placeRow(uint16_t m, int x) {
+    return (uint16_t)(x >= 1 ? m << (x - 1) : m >> (1 - x));
+}
+
+// Does shape (type, rot) fit with its box at board column x, row y? Board
+// columns count the left wall as 0, like main.cpp's x.
+static inline bool fits(const uint16_t* rows, int type, int rot, int x, int y) {
+    if (x + shapes.minCol[type][rot] < 1 || x + shapes.maxCol[type][rot] > COLS) return false;
+    if (y + shapes.maxRow[type][rot] >= ROWS) return false;
+    for (int i = 0; i < 4; i++) {
+        uint16_t m = shapes.rows[type][rot][i];
+        if (m && (rows[y + i] & placeRow(m, x))) return false;
+    }
+    return true;
+}
+
+// Place the current piece of game i as `action` says and spawn the next one.
+// Returns the lines cleared; sets `over` if the next piece can't spawn.
+static int placePiece(TetrisEnv& e, int i, int action, bool& over) {
+    uint16_t* rows = &e.boards[(size_t)i * ROWS];
+    int type = e.current[i];
+    if (action < 0 || action >= TETRIS_ENV_ACTIONS) action = 0;
+    int turns = action / COLS, column = action % COLS;
+
+    // Turn at the spawn point with Piece::rotate's kicks
+    int x = SPAWN_X, y = SPAWN_Y, rot = 0;
+    if (type != 1) {
+        for (int t = 0; t < turns; t++) {
+            int turned = (rot + 1) % 4;
+            for (int kick : {0, -1, 1, -2, 2}) {
+                if (fits(rows, type, turned, x + kick, y)) {
+                    x += kick;
+                    rot = turned;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Slide towards the column, then hard drop
+    int targetX = column + 1 - shapes.minCol[type][rot];
+    int step = targetX > x ? 1 : -1;
+    while (x != targetX && fits(rows, type, rot, x + step, y)) x += step;
+    while (fits(rows, type, rot, x, y + 1)) y++;
+
+    for (int r = 0; r < 4; r++) {
+        uint16_t m = shapes.rows[type][rot][r];
+        if (m) rows[y + r] |= placeRow(m, x);
+    }
+
+    // main.cpp's removeLine: rows 1..ROWS-1 only, row 0 never clears and
+    // row 1 comes back empty
+    int cleared = 0;
+    for (int r = ROWS - 1; r > 0; r--) {
+        if (rows[r] != FULL_ROW) continue;
+        cleared++;
+        for (int k = r; k > 1; k--) rows[k] = rows[k - 1];
+        rows[1] = 0;
+        r++;
+    }
+
+    e.current[i] = e.next[i];
+    e.next[i] = (uint8_t)drawPiece(e, i);
+    over = !fits(rows, e.current[i], 0, SPAWN_X, SPAWN_Y);
+    return cleared;
+}
+
+// ==================== OBSERVATIONS ====================
+// Byte expansion of 8 mask bits (byte j = bit j)
+struct ExpandTable {
+    uint64_t bytes[256];
+    ExpandTable() {
+        for (int v = 0; v < 256; v++) {
+            bytes[v] = 0;
+            for (int b = 0; b < 8; b++) {
+                if (v >> b & 1) bytes[v] |= (uint64_t)1 << (8 * b);
+            }
+        }
+    }
+};
+const ExpandTable expand;
+
+static void observe(const TetrisEnv& e, int i, const TetrisEnvOutput* out) {
+    if (out->boards) {
+        const uint16_t* rows = &e.boards[(size_t)i * ROWS];
+        uint8_t* plane = out->boards + (size_t)i * ROWS * COLS;
+        for (int r = 0; r < ROWS; r++) {
+            uint64_t lo = expand.bytes[rows[r] & 0xFF], hi = expand.bytes[rows[r] >> 8];
+            memcpy(plane + r * COLS, &lo, 8);
+            memcpy(plane + r * COLS + 8, &hi, COLS - 8);
+        }
+    }
+    if (out->pieces) {
+        out->pieces[2 * (size_t)i] = e.current[i];
+        out->pieces[2 * (size_t)i + 1] = e.next[i];
+    }
+}
+
+// ==================== WORKER POOL ====================
+// Threads that live as long as the environment. A call hands out ENV_CHUNK
+// sized ranges through an atomic counter; the calling thread works too, and
+// returns once every range is done.
+struct EnvJob {
+    TetrisEnv* env;
+    const int32_t* actions;                 // NULL = reset
+    const TetrisEnvOutput* out;
+};
+
+static void runRange(const EnvJob& job, int begin, int end) {
+    TetrisEnv& e = *job.env;
+    for (int i = begin; i < end; i++) {
+        float reward = 0.f;
+        uint8_t done = 0;
+        if (job.actions) {
+            bool over = false;
+            reward = (float)placePiece(e, i, job.actions[i], over);
+            if (over) {
+                startGame(e, i);
+                done = 1;
+            }
+        } else {
+            e.episode[i] = 0;
+            startGame(e, i);
+        }
+        if (job.out->rewards) job.out->rewards[i] = reward;
+        if (job.out->dones) job.out->dones[i] = done;
+        observe(e, i, job.out);
+    }
+}
+
+struct EnvPool {
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake, finished;
+    uint64_t generation = 0;                // Bumped for every job
+    int busy = 0;                           // Workers still on the current job
+    bool quit = false;
+    EnvJob job = {};
+    atomic<int> nextChunk{0};
+    int chunks = 0;
+
+    void work() {
+        for (int c; (c = nextChunk.fetch_add(1)) < chunks;) {
+            int begin = c * ENV_CHUNK;
+            runRange(job, begin, min(job.env->count, begin + ENV_CHUNK));
+        }
+    }
+
+    void workerLoop() {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> l(lock);
+                wake.wait(l, [&] { return quit || generation != seen; });
+                if (quit) return;
+                seen = generation;
+            }
+            work();
+            lock_guard<mutex> l(lock);
+            if (--busy == 0) finished.notify_one();
+        }
+    }
+
+    void run(const EnvJob& j) {
+        chunks = (j.env->count + ENV_CHUNK - 1) / ENV_CHUNK;
+        if (workers.empty() || chunks == 1) {  // Not worth waking anyone
+            runRange(j, 0, j.env->count);
+            return;
+        }
+        {
+            lock_guard<mutex> l(lock);
+            job = j;
+            nextChunk = 0;
+            busy = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        work();
+        unique_lock<mutex> l(lock);
+        finished.wait(l, [&] { return busy == 0; });
+    }
+
+    ~EnvPool() {
+        {
+            lock_guard<mutex> l(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (thread& t : workers) t.join();
+    }
+};
+
+// ==================== C API ====================
+extern "C" {
+
+TetrisEnv* tetris_env_create(int count, uint32_t seed, int threads) {
+    if (count <= 0) return nullptr;
+    TetrisEnv* e = new (nothrow) TetrisEnv;
+    if (!e) return nullptr;
+    try {
+        e->count = count;
+        e->firstSeed = seed;
+        e->boards.assign((size_t)count * ROWS, 0);
+        e->current.assign(count, 0);
+        e->next.assign(count, 0);
+        e->bags.assign((size_t)count * 7, 0);
+        e->bagIndex.assign(count, 7);
+        e->rng.assign(count, 1);
+        e->episode.assign(count, 0);
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        threads = min(threads, (count + ENV_CHUNK - 1) / ENV_CHUNK);
+        e->pool = new EnvPool;
+        for (int t = 1; t < threads; t++) e->pool->workers.emplace_back(&EnvPool::workerLoop, e->pool);
+    } catch (...) {
+        tetris_env_destroy(e);
+        return nullptr;
+    }
+    for (int i = 0; i < count; i++) startGame(*e, i);
+    return e;
+}
+
+void tetris_env_destroy(TetrisEnv* env) {
+    if (!env) return;
+    delete env->pool;
+    delete env;
+}
+
+int tetris_env_reset(TetrisEnv* env, const TetrisEnvOutput* out) {
+    if (!env) return -1;
+    TetrisEnvOutput none = {};
+    env->pool->run({ env, nullptr, out ? out : &none });
+    return 0;
+}
+
+int tetris_env_step(TetrisEnv* env, const int32_t* actions, const TetrisEnvOutput* out) {
+    if (!env || !actions) return -1;
+    TetrisEnvOutput none = {};
+    env->pool->run({ env, actions, out ? out : &none });
+    return 0;
+}
+
+int tetris_env_count(const TetrisEnv* env) {
+    return env ? env->count : 0;
+}
+
+}
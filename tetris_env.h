@@ -0,0 +1,74 @@
+// ╔════════════════════════════════════════════════════════════════╗
+// ║         TETRIS GAME - SS008 Batch Environment (C API)           ║
+// ║  N independent games stepped in one call, no SFML, no globals   ║
+// ╚════════════════════════════════════════════════════════════════╝
+//
+// Build as a shared library (no other dependencies):
+//   g++ -O2 -shared -fPIC tetris_env.cpp -o libtetris_env.so -lpthread
+//   g++ -O2 -shared tetris_env.cpp -o tetris_env.dll            (MinGW)
+//
+// The rules are the game's (main.cpp): 15 x 20 board with walls, the same
+// pieces, 7-bag order for a seed, rotation wall kicks, 100 points per line,
+// and the quirk that the top row is never cleared. One step places one
+// piece: action = rotation * TETRIS_ENV_COLS + column. The piece turns
+// `rotation` times at the spawn point (with kicks), slides until its
+// leftmost cell reaches `column` or it is blocked, then hard drops.
+// A finished game is reset at once with the next seed of that environment
+// (environment i of n plays seeds seed + i, seed + i + n, seed + i + 2n...);
+// its done flag is set and the observation already shows the new game.
+
+#ifndef TETRIS_ENV_H
+#define TETRIS_ENV_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define TETRIS_ENV_API __declspec(dllexport)
+#else
+#define TETRIS_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TETRIS_ENV_ROWS 19                           /* Playfield rows in an observation, top first */
+#define TETRIS_ENV_COLS 13                           /* Playfield columns in an observation */
+#define TETRIS_ENV_ACTIONS (4 * TETRIS_ENV_COLS)     /* rotation * TETRIS_ENV_COLS + column */
+#define TETRIS_ENV_PIECE_TYPES 7                     /* 0=I 1=O 2=T 3=S 4=Z 5=J 6=L */
+
+typedef struct TetrisEnv TetrisEnv;
+
+/* Output buffers for `count` environments; any pointer may be NULL to skip it.
+   boards:  count * TETRIS_ENV_ROWS * TETRIS_ENV_COLS bytes, 1 = filled
+   pieces:  count * 2 (current type, next type)
+   rewards: count, lines cleared by the step
+   dones:   count, 1 if the step ended that game */
+typedef struct TetrisEnvOutput {
+    uint8_t* boards;
+    int32_t* pieces;
+    float* rewards;
+    uint8_t* dones;
+} TetrisEnvOutput;
+
+/* Make `count` games; environment i starts from seed + i. threads <= 0 uses
+   every core. Returns NULL on bad arguments or out of memory. */
+TETRIS_ENV_API TetrisEnv* tetris_env_create(int count, uint32_t seed, int threads);
+TETRIS_ENV_API void tetris_env_destroy(TetrisEnv* env);
+
+/* Start every game over from its first seed and write the observations.
+   rewards and dones are zeroed. Returns 0, or -1 if env is NULL. */
+TETRIS_ENV_API int tetris_env_reset(TetrisEnv* env, const TetrisEnvOutput* out);
+
+/* Place one piece in every game. actions holds `count` values in
+   [0, TETRIS_ENV_ACTIONS); others are treated as 0. Returns 0, or -1 on
+   NULL arguments. */
+TETRIS_ENV_API int tetris_env_step(TetrisEnv* env, const int32_t* actions, const TetrisEnvOutput* out);
+
+TETRIS_ENV_API int tetris_env_count(const TetrisEnv* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif